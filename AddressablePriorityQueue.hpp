@@ -0,0 +1,228 @@
+#pragma once
+#include "BasicPriorityQueue.hpp"
+#include "DAryHeap.hpp"
+#include <unordered_map>
+
+namespace kp {
+
+namespace detail {
+
+    /**
+     * \brief Index policy that keeps the heap position of every node.
+     *
+     * The handles of AddressablePriorityQueue are node identifiers, and this
+     * map follows every node the heap moves. It offers no lookup by value,
+     * so contains(), find() and count() by priority and value still scan.
+     */
+    class HandlePositions {
+    private:
+        std::unordered_map<size_t, size_t> m_positions;
+
+        /**
+         * \brief Callback that records where the heap moved a node.
+         */
+        struct Tracker {
+            HandlePositions* index;
+
+            template <typename Node>
+            void operator()(const Node& node, size_t position) const {
+                index->m_positions[node.getId()]=position;
+            }
+        };
+
+    public:
+        static constexpr bool enabled=false;
+
+        template <typename Node>
+        void add(const Node& node, size_t position) {
+            m_positions[node.getId()]=position;
+        }
+
+        template <typename Node>
+        void remove(const Node& node) {
+            m_positions.erase(node.getId());
+        }
+
+        template <typename Container>
+        void rebuild(const Container& queue) {
+            m_positions.clear();
+            reindex(queue);
+        }
+
+        template <typename Container>
+        void reindex(const Container& queue) {
+            for (size_t i=0; i<queue.size(); ++i) {
+                m_positions[queue[i].getId()]=i;
+            }
+        }
+
+        Tracker tracker() {
+            return Tracker{this};
+        }
+
+        /**
+         * \brief Gets the position of a node.
+         * \param id - identifier of the node.
+         * \return Position of the node, or SIZE_MAX if it left the queue.
+         */
+        size_t position(size_t id) const {
+            auto it=m_positions.find(id);
+            return it==m_positions.end() ? SIZE_MAX : it->second;
+        }
+
+        size_t memoryUsage() const {
+            return m_positions.bucket_count()*sizeof(void*)+m_positions.size()*(sizeof(std::pair<const size_t, size_t>)+sizeof(void*));
+        }
+    };
+
+}
+
+/**
+ * \brief An unbounded d-ary heap whose elements can be changed while queued.
+ *
+ * Every element gets a handle, which is its node identifier, and the queue
+ * keeps a map from handles to heap positions up to date on every move. That
+ * allows changing the priority of a queued element or removing it in
+ * O(log n), as needed for decrease-key in Dijkstra-style schedulers or for
+ * cancelling timeouts.
+ *
+ * An element keeps its identifier when its priority changes, so among equal
+ * priorities it still leaves in the order it was first inserted.
+ *
+ * This is DAryHeapPriorityQueue with the handle map as its index policy, so
+ * every operation of BasicPriorityQueue, tryPop() and popN() included, keeps
+ * the handles valid.
+ *
+ * \tparam T The type of the elements in the queue.
+ * \tparam Arity Number of children of every heap node.
+ * \tparam ErrorPolicy Reaction to pop() on an empty queue.
+ */
+template <typename T, size_t Arity = 4, typename ErrorPolicy = PrintErrors>
+class AddressablePriorityQueue : public BasicPriorityQueue<T, DAryHeapStorage<Arity>, NodeCompare, Unbounded, ErrorPolicy, std::allocator<Node<T>>, detail::HandlePositions> {
+private:
+    using Base=BasicPriorityQueue<T, DAryHeapStorage<Arity>, NodeCompare, Unbounded, ErrorPolicy, std::allocator<Node<T>>, detail::HandlePositions>;
+
+public:
+    using Handle=size_t;
+
+    using Base::contains;
+    using Base::find;
+
+private:
+    /**
+     * \brief Removes the node at the given heap position.
+     * \param index - position of the node.
+     * \return The removed node.
+     */
+    Node<T> removeAt(size_t index) {
+        auto& queue=this->m_queue;
+        auto track=this->m_index.tracker();
+        size_t last=queue.size()-1;
+        if (index!=last) {
+            std::swap(queue[index], queue[last]);
+            track(queue[index], index);
+            updateDAryHeap<Arity>(queue.begin(), queue.begin()+last, queue.begin()+index, this->m_compare, track);
+        }
+        Node<T> node=std::move(queue.back());
+        queue.pop_back();
+        this->m_index.remove(node);
+        return node;
+    }
+
+public:
+    /**
+     * \brief Default constructor.
+     *
+     * Creates an empty queue.
+     */
+    AddressablePriorityQueue()=default;
+
+    /**
+     * \brief Inserts a new element and returns its handle.
+     * \param priority - priority of the element.
+     * \param value - value of the element.
+     * \return Handle that stays valid until the element leaves the queue.
+     */
+    Handle push(int priority, const T& value) {
+        return emplace(priority, value);
+    }
+
+    /**
+     * \brief Inserts a new element by moving it and returns its handle.
+     * \param priority - priority of the element.
+     * \param value - value of the element.
+     * \return Handle that stays valid until the element leaves the queue.
+     */
+    Handle push(int priority, T&& value) {
+        return emplace(priority, std::move(value));
+    }
+
+    /**
+     * \brief Constructs a new element directly in the queue.
+     * \param priority - priority of the element.
+     * \param args - arguments forwarded to the constructor of the value.
+     * \return Handle that stays valid until the element leaves the queue.
+     */
+    template <typename... Args>
+    Handle emplace(int priority, Args&&... args) {
+        Handle handle=this->m_currentId;
+        this->tryEmplace(priority, std::forward<Args>(args)...);
+        return handle;
+    }
+
+    /**
+     * \brief Checks if the element behind a handle is still queued.
+     * \param handle - handle returned by push() or emplace().
+     * \return True if the element has not left the queue yet.
+     */
+    bool contains(Handle handle) const {
+        return this->m_index.position(handle)!=SIZE_MAX;
+    }
+
+    /**
+     * \brief Gets the queued node behind a handle.
+     * \param handle - handle of a queued element.
+     * \return Pointer to the node, or nullptr if the element left the queue.
+     */
+    const Node<T>* find(Handle handle) const {
+        size_t position=this->m_index.position(handle);
+        return position==SIZE_MAX ? nullptr : &this->m_queue[position];
+    }
+
+    /**
+     * \brief Changes the priority of a queued element in O(log n).
+     *
+     * Works for both raising and lowering the priority.
+     *
+     * \param handle - handle of the element.
+     * \param priority - new priority of the element.
+     * \return True if the element was found, false if it already left.
+     */
+    bool updatePriority(Handle handle, int priority) {
+        size_t position=this->m_index.position(handle);
+        if (position==SIZE_MAX) {
+            return false;
+        }
+        auto& queue=this->m_queue;
+        auto pos=queue.begin()+position;
+        pos->setPriority(priority);
+        updateDAryHeap<Arity>(queue.begin(), queue.end(), pos, this->m_compare, this->m_index.tracker());
+        return true;
+    }
+
+    /**
+     * \brief Removes a queued element in O(log n).
+     * \param handle - handle of the element.
+     * \return True if the element was removed, false if it already left.
+     */
+    bool erase(Handle handle) {
+        size_t position=this->m_index.position(handle);
+        if (position==SIZE_MAX) {
+            return false;
+        }
+        removeAt(position);
+        return true;
+    }
+};
+
+}
@@ -0,0 +1,416 @@
+#pragma once
+#include "ConcurrentPriorityQueue.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace kp {
+
+/**
+ * \brief Thread-safe queue whose consumers sleep until an element arrives.
+ *
+ * Wraps a concurrent engine, ConcurrentPriorityQueue by default, and adds
+ * blocking pops: waitPop() parks a thread on a condition variable, and
+ * co_await popAsync() suspends a C++20 coroutine. The engine's insert() and
+ * tryPop() stay lock-free of the wrapper, so producers only touch the
+ * wrapper's mutex when a consumer is actually waiting.
+ *
+ * Wakeups are batched. Once a producer has woken a consumer, further
+ * inserts skip the wakeup until that consumer runs. The woken consumer then
+ * wakes the next one if elements are left, so a burst of inserts costs the
+ * producer a single notification. insertRange() inserts a whole batch and
+ * then wakes up to one consumer per element at once.
+ *
+ * A suspended coroutine is resumed on the thread that hands it an element,
+ * usually a producer inside insert(), with the element already taken for it.
+ * close() wakes every consumer, after which waits return std::nullopt once
+ * the queue is drained. A coroutine suspended in popAsync() must not be
+ * destroyed before it is resumed.
+ *
+ * \tparam T The type of the elements in the queue.
+ * \tparam Queue Thread-safe engine with emplace(), tryPop() and isEmpty().
+ */
+template <typename T, typename Queue = ConcurrentPriorityQueue<T>>
+class AsyncPriorityQueue {
+public:
+    class PopAwaiter;
+
+private:
+    Queue m_queue;
+    std::mutex m_mutex;
+    std::condition_variable m_ready;
+    PopAwaiter* m_firstAwaiter=nullptr;
+    PopAwaiter* m_lastAwaiter=nullptr;
+    size_t m_threadWaiters=0;
+    size_t m_tokens=0;
+    bool m_closed=false;
+    alignas(CacheLineSize) std::atomic<size_t> m_waiting{0};
+    std::atomic<bool> m_wakePending{false};
+
+    /**
+     * \brief Wakes waiting consumers if elements are queued.
+     *
+     * Called after an insert and by a consumer that leaves elements behind.
+     * The fence pairs with the one in the waiters, so either the waiter sees
+     * the element or this call sees the waiter.
+     *
+     * \param count - number of consumers that may be woken.
+     */
+    void signal(size_t count = 1) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_waiting.load(std::memory_order_relaxed)==0 || m_wakePending.exchange(true)) {
+            return;
+        }
+        wake(count);
+    }
+
+    /**
+     * \brief Hands elements to suspended coroutines and tokens to waiting threads.
+     *
+     * Every suspended coroutine that can get an element has it taken under
+     * the lock and is resumed after the lock is released. Threads only get
+     * tokens, and m_wakePending stays set until one of them picks its token
+     * up, which is what keeps further inserts from notifying again.
+     *
+     * If nobody is woken, m_wakePending is cleared before the queue is
+     * checked once more: a producer that inserted in between saw the flag
+     * still set and skipped its own wakeup, so its element is handed out by
+     * the next round of the loop.
+     *
+     * \param count - maximum number of threads to wake.
+     */
+    void wake(size_t count) {
+        std::vector<std::coroutine_handle<>> resumed;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (;;) {
+                while (m_firstAwaiter) {
+                    std::optional<T> value=m_queue.tryPop();
+                    if (!value) {
+                        break;
+                    }
+                    PopAwaiter* awaiter=unlinkFirst();
+                    awaiter->m_value=std::move(value);
+                    resumed.push_back(awaiter->m_handle);
+                }
+                size_t idle=m_threadWaiters-std::min(m_tokens, m_threadWaiters);
+                size_t woken=std::min(idle, count);
+                if (woken>0 && !m_queue.isEmpty()) {
+                    m_tokens+=woken;
+                    if (woken==1) {
+                        m_ready.notify_one();
+                    } else {
+                        m_ready.notify_all();
+                    }
+                    break;
+                }
+                m_wakePending.store(false);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                bool waiting=m_firstAwaiter || idle>0;
+                if (!waiting || m_queue.isEmpty() || m_wakePending.exchange(true)) {
+                    break;
+                }
+            }
+        }
+        for (auto handle : resumed) {
+            handle.resume();
+        }
+    }
+
+    /**
+     * \brief Wakes the next consumer if the caller took an element and left some.
+     */
+    void passOn() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!m_queue.isEmpty()) {
+            signal();
+        }
+    }
+
+    PopAwaiter* unlinkFirst() {
+        PopAwaiter* awaiter=m_firstAwaiter;
+        m_firstAwaiter=awaiter->m_next;
+        if (!m_firstAwaiter) {
+            m_lastAwaiter=nullptr;
+        }
+        m_waiting.fetch_sub(1, std::memory_order_relaxed);
+        return awaiter;
+    }
+
+    /**
+     * \brief Blocks until an element is taken, the deadline passes or the queue is closed.
+     * \param deadline - time to give up, std::nullopt to wait without limit.
+     */
+    std::optional<T> waitPopImpl(const std::optional<std::chrono::steady_clock::time_point>& deadline) {
+        for (;;) {
+            if (std::optional<T> value=m_queue.tryPop()) {
+                passOn();
+                return value;
+            }
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_closed) {
+                lock.unlock();
+                return m_queue.tryPop();
+            }
+            ++m_threadWaiters;
+            m_waiting.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            bool woken=!m_queue.isEmpty();
+            if (!woken) {
+                auto ready=[this] { return m_tokens>0 || m_closed; };
+                if (deadline) {
+                    woken=m_ready.wait_until(lock, *deadline, ready);
+                } else {
+                    m_ready.wait(lock, ready);
+                    woken=true;
+                }
+            }
+            --m_threadWaiters;
+            m_waiting.fetch_sub(1, std::memory_order_relaxed);
+            if (m_tokens>0) {
+                --m_tokens;
+                m_wakePending.store(false);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+            }
+            lock.unlock();
+            if (!woken) {
+                std::optional<T> value=m_queue.tryPop();
+                if (value) {
+                    passOn();
+                }
+                return value;
+            }
+        }
+    }
+
+public:
+    /**
+     * \brief Awaitable returned by popAsync().
+     *
+     * Resumes with the popped element, or std::nullopt if the queue was
+     * closed while empty.
+     */
+    class PopAwaiter {
+    private:
+        friend class AsyncPriorityQueue;
+
+        AsyncPriorityQueue* m_owner;
+        std::optional<T> m_value;
+        std::coroutine_handle<> m_handle;
+        PopAwaiter* m_next=nullptr;
+
+    public:
+        explicit PopAwaiter(AsyncPriorityQueue& owner) : m_owner(&owner) {}
+
+        bool await_ready() {
+            m_value=m_owner->m_queue.tryPop();
+            if (m_value) {
+                m_owner->passOn();
+            }
+            return m_value.has_value();
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            std::unique_lock<std::mutex> lock(m_owner->m_mutex);
+            if (m_owner->m_closed) {
+                lock.unlock();
+                m_value=m_owner->m_queue.tryPop();
+                return false;
+            }
+            m_owner->m_waiting.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            m_value=m_owner->m_queue.tryPop();
+            if (m_value) {
+                m_owner->m_waiting.fetch_sub(1, std::memory_order_relaxed);
+                lock.unlock();
+                m_owner->passOn();
+                return false;
+            }
+            m_handle=handle;
+            if (m_owner->m_lastAwaiter) {
+                m_owner->m_lastAwaiter->m_next=this;
+            } else {
+                m_owner->m_firstAwaiter=this;
+            }
+            m_owner->m_lastAwaiter=this;
+            return true;
+        }
+
+        std::optional<T> await_resume() {
+            return std::move(m_value);
+        }
+    };
+
+    /**
+     * \brief Constructor.
+     * \param args - arguments forwarded to the constructor of the engine,
+     *        e.g. the number of threads of a ConcurrentPriorityQueue.
+     */
+    template <typename... Args>
+    explicit AsyncPriorityQueue(Args&&... args) : m_queue(std::forward<Args>(args)...) {}
+
+    AsyncPriorityQueue(const AsyncPriorityQueue&)=delete;
+    AsyncPriorityQueue& operator=(const AsyncPriorityQueue&)=delete;
+
+    /**
+     * \brief Inserts a new element and wakes a waiting consumer. Thread-safe.
+     * \param priority - priority of the element.
+     * \param value - value of the element.
+     */
+    void insert(int priority, const T& value) {
+        emplace(priority, value);
+    }
+
+    /**
+     * \brief Inserts a new element by moving it and wakes a waiting consumer. Thread-safe.
+     * \param priority - priority of the element.
+     * \param value - value of the element.
+     */
+    void insert(int priority, T&& value) {
+        emplace(priority, std::move(value));
+    }
+
+    /**
+     * \brief Constructs a new element in the queue and wakes a waiting consumer. Thread-safe.
+     * \param priority - priority of the element.
+     * \param args - arguments forwarded to the constructor of the value.
+     */
+    template <typename... Args>
+    void emplace(int priority, Args&&... args) {
+        m_queue.emplace(priority, std::forward<Args>(args)...);
+        signal();
+    }
+
+    /**
+     * \brief Inserts a batch of elements, then wakes up to one consumer per element.
+     * \param first - iterator to the first (priority, value) pair.
+     * \param last - iterator past the last pair.
+     */
+    template <typename InputIt>
+    void insertRange(InputIt first, InputIt last) {
+        size_t count=0;
+        for (; first!=last; ++first, ++count) {
+            m_queue.emplace(first->first, first->second);
+        }
+        if (count>0) {
+            signal(count);
+        }
+    }
+
+    /**
+     * \brief Removes an element without waiting. Thread-safe.
+     * \return A high-priority element, or std::nullopt if the queue is empty.
+     */
+    std::optional<T> tryPop() {
+        std::optional<T> value=m_queue.tryPop();
+        if (value) {
+            passOn();
+        }
+        return value;
+    }
+
+    /**
+     * \brief Removes an element, blocking the thread until one is available.
+     * \return The element, or std::nullopt once the queue is closed and empty.
+     */
+    std::optional<T> waitPop() {
+        return waitPopImpl(std::nullopt);
+    }
+
+    /**
+     * \brief Removes an element, blocking the thread for at most the timeout.
+     * \param timeout - longest time to wait.
+     * \return The element, or std::nullopt on timeout or once the queue is
+     *         closed and empty.
+     */
+    template <typename Rep, typename Period>
+    std::optional<T> waitPop(std::chrono::duration<Rep, Period> timeout) {
+        return waitPopImpl(std::chrono::steady_clock::now()+std::chrono::ceil<std::chrono::steady_clock::duration>(timeout));
+    }
+
+    /**
+     * \brief Removes an element, suspending the calling coroutine until one is available.
+     *
+     * Use as: std::optional<T> value=co_await queue.popAsync();
+     *
+     * \return Awaitable yielding the element, or std::nullopt once the queue
+     *         is closed and empty.
+     */
+    PopAwaiter popAsync() {
+        return PopAwaiter(*this);
+    }
+
+    /**
+     * \brief Closes the queue and wakes every waiting consumer.
+     *
+     * Inserts are still accepted. Waiting consumers take the remaining
+     * elements first and get std::nullopt once the queue is empty.
+     */
+    void close() {
+        std::vector<PopAwaiter*> resumed;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed=true;
+            while (m_firstAwaiter) {
+                PopAwaiter* awaiter=unlinkFirst();
+                awaiter->m_value=m_queue.tryPop();
+                resumed.push_back(awaiter);
+            }
+            m_ready.notify_all();
+        }
+        for (PopAwaiter* awaiter : resumed) {
+            awaiter->m_handle.resume();
+        }
+    }
+
+    /**
+     * \brief Checks if close() was called.
+     * \return True if the queue is closed.
+     */
+    bool isClosed() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_closed;
+    }
+
+    /**
+     * \brief Gets the number of queued elements, approximate while threads use the queue.
+     * \return Number of elements in the queue.
+     */
+    size_t size() const {
+        return m_queue.size();
+    }
+
+    /**
+     * \brief Checks if the queue is empty, with the same caveat as size().
+     * \return True if the queue is empty, false otherwise.
+     */
+    bool isEmpty() const {
+        return m_queue.isEmpty();
+    }
+
+    /**
+     * \brief Gets the number of threads and coroutines waiting for an element.
+     * \return Number of waiting consumers.
+     */
+    size_t waitingCount() const {
+        return m_waiting.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * \brief Gives access to the wrapped engine.
+     *
+     * Elements inserted directly into the engine do not wake consumers.
+     *
+     * \return Reference to the engine.
+     */
+    Queue& engine() {
+        return m_queue;
+    }
+};
+
+}
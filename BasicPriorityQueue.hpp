@@ -0,0 +1,1118 @@
+#pragma once
+#include "PriorityQueue.hpp"
+#include "StoragePolicies.hpp"
+#include "ErrorPolicies.hpp"
+#include "HashIndex.hpp"
+#include "KeyCompare.hpp"
+#include <climits>
+#include <future>
+#include <optional>
+#include <type_traits>
+
+namespace kp {
+
+/**
+ * \brief Capacity policy of a queue without a size limit.
+ */
+struct Unbounded {
+    static constexpr bool bounded=false;
+};
+
+/**
+ * \brief Capacity policy of a queue with a maximum size.
+ *
+ * When the queue is full, elements with lower priorities are discarded to
+ * make space for elements with higher priority.
+ */
+class Bounded {
+private:
+    size_t m_maxSize;
+
+public:
+    static constexpr bool bounded=true;
+
+    /**
+     * \brief Parameterized constructor.
+     *
+     * \param maxSize The maximum size of the queue, 10 by default.
+     */
+    constexpr Bounded(size_t maxSize=10) : m_maxSize(maxSize) {}
+
+    /**
+     * \brief Gets the maximum size of the queue.
+     * \return The maximum size of the queue.
+     */
+    constexpr size_t getMaxSize() const {
+        return m_maxSize;
+    }
+
+protected:
+    /**
+     * \brief Changes the stored maximum size.
+     * \param maxSize The new maximum size of the queue.
+     */
+    void changeMaxSize(size_t maxSize) {
+        m_maxSize=maxSize;
+    }
+};
+
+namespace detail {
+
+    /**
+     * \brief State of the lazy ordering mode of a bounded queue.
+     */
+    struct LazyState {
+        static constexpr size_t NoFloor=SIZE_MAX;
+
+        bool enabled=false;
+        bool unordered=false;
+        size_t floor=NoFloor;
+    };
+
+    /**
+     * \brief Lazy state of an unbounded queue, which has no lazy mode.
+     */
+    struct NoLazyState {};
+
+}
+
+/**
+ * \brief Priority queue assembled from compile-time policies.
+ *
+ * Nothing here is virtual, so insert, pop and every comparison can be
+ * inlined into the caller. This is the one implementation of the array-based
+ * queues: BoundedPriorityQueue, BoundedQueue, DAryHeapPriorityQueue and
+ * DAryHeapQueue are instantiations of it, and AddressablePriorityQueue adds
+ * its handles on top. PriorityQueueAdapter wraps any of them in the virtual
+ * PriorityQueue interface wherever the engine has to be chosen at run time.
+ *
+ * A bounded queue also has the lazy ordering mode, see setLazyOrdering(),
+ * and merge() / mergeAll(). Snapshots of every instantiation with int
+ * priorities are written and read by Snapshot.hpp. PackedPriorityQueue
+ * takes the same compare policies but keeps the values apart from compact
+ * keys; it is never chosen automatically, because it has no Node objects
+ * to hand out.
+ *
+ * \tparam T The type of the elements in the queue.
+ * \tparam StoragePolicy Layout of the elements: MinMaxHeapStorage,
+ *         SortedStorage or DAryHeapStorage. Bounded queues need a layout that
+ *         can find the lowest element, which excludes DAryHeapStorage.
+ * \tparam ComparePolicy Ordering of the elements, NodeCompare by default. It
+ *         also fixes the type of the priorities: KeyCompare<double> queues
+ *         take double priorities, policies without a KeyType take int.
+ *         Policies declaring stable=false, such as UnstableCompare, drop
+ *         the node identifiers.
+ * \tparam CapacityPolicy Unbounded or Bounded.
+ * \tparam ErrorPolicy Reaction to pop() on an empty queue and to contains()
+ *         results, e.g. PrintErrors, SilentErrors or ThrowErrors.
+ * \tparam Allocator Allocator of the nodes. With a std::pmr allocator the
+ *         payloads of allocator-aware types use the same memory resource.
+ * \tparam IndexPolicy Bookkeeping of the node positions, NoIndex by default.
+ *         HashIndex<T> makes contains(), find() and count() O(1) on average
+ *         and needs int priorities and stable nodes.
+ */
+template <typename T, typename StoragePolicy, typename ComparePolicy = NodeCompare, typename CapacityPolicy = Unbounded, typename ErrorPolicy = PrintErrors, typename Allocator = std::allocator<Node<T, detail::KeyTypeOfT<ComparePolicy>, detail::isStableV<ComparePolicy>>>, typename IndexPolicy = NoIndex>
+class BasicPriorityQueue : public CapacityPolicy {
+public:
+    using ValueType=T;
+    using Key=detail::KeyTypeOfT<ComparePolicy>;
+    using NodeType=Node<T, Key, detail::isStableV<ComparePolicy>>;
+
+    static_assert(!IndexPolicy::enabled || std::is_same_v<NodeType, Node<T>>, "A lookup index needs int priorities and stable nodes");
+
+protected:
+    using LazyType=std::conditional_t<CapacityPolicy::bounded, detail::LazyState, detail::NoLazyState>;
+
+    std::vector<NodeType, Allocator> m_queue;
+    size_t m_currentId=1;
+    ComparePolicy m_compare;
+    [[no_unique_address]] detail::StatsSlot m_stats;
+    [[no_unique_address]] IndexPolicy m_index;
+    [[no_unique_address]] LazyType m_lazy;
+
+    friend struct detail::SnapshotAccess;
+
+private:
+    /**
+     * \brief Appends an element to the unordered buffer of the lazy mode.
+     *
+     * Elements that cannot beat the lowest element kept by the last trim are
+     * rejected, everything else is appended without being compared. Once
+     * the buffer holds twice the maximum size, std::nth_element cuts it back
+     * to the maximum size, so an insert costs amortized O(1).
+     *
+     * \param priority - priority of the element.
+     * \param args - arguments forwarded to the constructor of the value.
+     * \return Inserted, or Rejected if the element is below the floor.
+     */
+    template <typename... Args>
+    InsertResult deferEmplace(Key priority, Args&&... args) {
+        size_t maxSize=this->getMaxSize();
+        if (!m_lazy.unordered) {
+            m_lazy.floor=detail::LazyState::NoFloor;
+            if (!m_queue.empty() && m_queue.size()>=maxSize) {
+                m_lazy.floor=static_cast<size_t>(StoragePolicy::lowest(m_queue, m_compare)-m_queue.begin());
+            }
+            m_lazy.unordered=true;
+        }
+        if (!wouldAccept(priority)) {
+            m_stats.recordRejected();
+            return InsertResult::Rejected;
+        }
+        m_queue.emplace_back(priority, m_currentId++, std::in_place, std::forward<Args>(args)...);
+        m_index.add(m_queue.back(), m_queue.size()-1);
+        m_stats.recordInserted(std::min(m_queue.size(), maxSize));
+        if (m_queue.size()>=(maxSize>SIZE_MAX/2 ? SIZE_MAX : 2*maxSize)) {
+            trimBuffer();
+            m_index.reindex(m_queue);
+            m_lazy.floor=static_cast<size_t>(std::max_element(m_queue.begin(), m_queue.end(), m_compare)-m_queue.begin());
+        }
+        return InsertResult::Inserted;
+    }
+
+    /**
+     * \brief Cuts the unordered buffer back to the maximum size.
+     *
+     * The kept elements are in no particular order afterwards, and the index
+     * has to be told their new positions.
+     */
+    void trimBuffer() {
+        size_t maxSize=this->getMaxSize();
+        if (m_queue.size()<=maxSize) {
+            return;
+        }
+        std::nth_element(m_queue.begin(), m_queue.begin()+maxSize, m_queue.end(), m_compare);
+        for (auto it=m_queue.begin()+maxSize; it!=m_queue.end(); ++it) {
+            m_index.remove(*it);
+        }
+        m_stats.recordBatch(0, 0, m_queue.size()-maxSize, maxSize);
+        m_queue.erase(m_queue.begin()+maxSize, m_queue.end());
+    }
+
+    /**
+     * \brief Checks if the lazy buffer holds elements the next trim discards.
+     * \return True if a trim is pending.
+     */
+    bool pendingTrim() const {
+        if constexpr (CapacityPolicy::bounded) {
+            return m_lazy.unordered && m_queue.size()>this->getMaxSize();
+        } else {
+            return false;
+        }
+    }
+
+    /**
+     * \brief Checks if a node survives the pending trim.
+     *
+     * Counts the nodes that leave before it in O(n), without allocating.
+     *
+     * \param node - node of the queue.
+     * \return True if the node is kept.
+     */
+    bool isKept(const NodeType& node) const {
+        if constexpr (CapacityPolicy::bounded) {
+            if (pendingTrim()) {
+                size_t ahead=0;
+                for (const auto& other : m_queue) {
+                    if (m_compare(other, node) && ++ahead>=this->getMaxSize()) {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    /**
+     * \brief Moves the highest elements of several queues into one.
+     *
+     * Every source moves its highest elements to the back in leave order,
+     * on separate threads if asked to. The runs are merged from their backs
+     * with a heap of run heads until limit elements are taken, and the
+     * taken nodes get new identifiers in leave order. On equal priorities
+     * earlier sources leave first. All sources are empty afterwards; the
+     * target may be one of them.
+     *
+     * The stats of the target count the elements of the other sources as
+     * one batch insert and its own dropped elements as evicted; the other
+     * sources count their elements as popped.
+     *
+     * \param target - queue receiving the elements.
+     * \param sources - queues to take the elements from.
+     * \param limit - maximum number of elements to keep.
+     * \param threads - number of threads for the extraction.
+     */
+    static void mergeInto(BasicPriorityQueue& target, std::span<BasicPriorityQueue* const> sources, size_t limit, size_t threads) {
+        std::vector<size_t> sizes(sources.size());
+        for (size_t i=0; i<sources.size(); ++i) {
+            sources[i]->settle();
+            sizes[i]=sources[i]->m_queue.size();
+        }
+        std::vector<size_t> counts(sources.size());
+        std::vector<size_t> taken(sources.size());
+        auto extract=[&](size_t first) {
+            for (size_t i=first; i<sources.size(); i+=threads) {
+                counts[i]=std::min(limit, sources[i]->size());
+                StoragePolicy::extractHighest(sources[i]->m_queue, counts[i], sources[i]->m_compare);
+            }
+        };
+        threads=std::max<size_t>(1, std::min(threads, sources.size()));
+        std::vector<std::future<void>> workers;
+        for (size_t w=1; w<threads; ++w) {
+            workers.push_back(std::async(std::launch::async, extract, w));
+        }
+        extract(0);
+        for (auto& worker : workers) {
+            worker.get();
+        }
+
+        // Run heads as (source, position), the element that leaves first on top of the heap.
+        size_t total=0;
+        std::vector<std::pair<size_t, size_t>> heads;
+        for (size_t i=0; i<sources.size(); ++i) {
+            total+=counts[i];
+            if (counts[i]>0) {
+                heads.emplace_back(i, sources[i]->m_queue.size()-1);
+            }
+        }
+        total=std::min(total, limit);
+        auto later=[&](const std::pair<size_t, size_t>& a, const std::pair<size_t, size_t>& b) {
+            const NodeType& nodeA=sources[a.first]->m_queue[a.second];
+            const NodeType& nodeB=sources[b.first]->m_queue[b.second];
+            return target.m_compare.before(nodeB.getPriority(), b.first, nodeA.getPriority(), a.first);
+        };
+        std::make_heap(heads.begin(), heads.end(), later);
+
+        std::vector<NodeType, Allocator> merged(target.m_queue.get_allocator());
+        merged.reserve(std::max(total, detail::upfrontCapacity(target.getMaxSize())));
+        size_t id=target.m_currentId;
+        while (merged.size()<total) {
+            std::pop_heap(heads.begin(), heads.end(), later);
+            auto& [source, position]=heads.back();
+            auto& queue=sources[source]->m_queue;
+            merged.emplace_back(queue[position].getPriority(), id++, std::in_place, queue[position].takeValue());
+            ++taken[source];
+            if (position>queue.size()-counts[source]) {
+                --position;
+                std::push_heap(heads.begin(), heads.end(), later);
+            } else {
+                heads.pop_back();
+            }
+        }
+        std::reverse(merged.begin(), merged.end());
+        if constexpr (!std::is_same_v<StoragePolicy, SortedStorage>) {
+            StoragePolicy::build(merged, target.m_compare);
+        }
+
+        for (BasicPriorityQueue* source : sources) {
+            source->m_queue.clear();
+            source->m_index.rebuild(source->m_queue);
+        }
+        target.m_queue=std::move(merged);
+        target.m_currentId=id;
+        target.m_index.rebuild(target.m_queue);
+        if constexpr (detail::statsEnabled) {
+            size_t offered=0;
+            size_t kept=0;
+            size_t evicted=0;
+            for (size_t i=0; i<sources.size(); ++i) {
+                if (sources[i]==&target) {
+                    evicted+=sizes[i]-taken[i];
+                } else {
+                    offered+=sizes[i];
+                    kept+=taken[i];
+                    sources[i]->m_stats.recordPops(sizes[i]);
+                }
+            }
+            target.m_stats.recordBatch(offered, kept, evicted, target.m_queue.size());
+        }
+    }
+
+public:
+    /**
+     * \brief Default constructor.
+     *
+     * Creates an empty queue with the default capacity. A bounded queue has a
+     * maximum size of 10 and reserves room for it up front.
+     */
+    BasicPriorityQueue() {
+        if constexpr (CapacityPolicy::bounded) {
+            m_queue.reserve(detail::upfrontCapacity(this->getMaxSize()));
+        }
+    }
+
+    /**
+     * \brief Parameterized constructor.
+     *
+     * Creates an empty queue with the given capacity and ordering. A bounded
+     * queue can be created directly from its maximum size, and reserves room
+     * for its elements up front unless that size is very large.
+     *
+     * \param capacity - capacity policy, e.g. the maximum size.
+     * \param compare - ordering of the elements.
+     * \param alloc - allocator of the nodes.
+     */
+    BasicPriorityQueue(CapacityPolicy capacity, ComparePolicy compare = ComparePolicy(), const Allocator& alloc = Allocator())
+        : CapacityPolicy(capacity), m_queue(alloc), m_compare(compare) {
+        if constexpr (CapacityPolicy::bounded) {
+            m_queue.reserve(detail::upfrontCapacity(this->getMaxSize()));
+        }
+    }
+
+    /**
+     * \brief Parameterized constructor with an allocator.
+     *
+     * \param capacity - capacity policy, e.g. the maximum size.
+     * \param alloc - allocator of the nodes, e.g. a SlabArena pointer for a
+     *        polymorphic allocator.
+     */
+    BasicPriorityQueue(CapacityPolicy capacity, const Allocator& alloc) : BasicPriorityQueue(capacity, ComparePolicy(), alloc) {}
+
+    /**
+     * \brief Allocator constructor.
+     *
+     * \param alloc - allocator of the nodes, e.g. a SlabArena pointer for a
+     *        polymorphic allocator.
+     */
+    explicit BasicPriorityQueue(const Allocator& alloc) : BasicPriorityQueue(CapacityPolicy(), ComparePolicy(), alloc) {}
+
+    /**
+     * \brief Range constructor.
+     *
+     * Creates a queue from a range of (priority, value) pairs. The layout is
+     * built once for the whole range instead of once per element. A bounded
+     * queue keeps the highest-priority elements of the range.
+     *
+     * \param first - beginning of the range.
+     * \param last - end of the range.
+     * \param capacity - capacity policy, e.g. the maximum size.
+     * \param compare - ordering of the elements.
+     * \param alloc - allocator of the nodes.
+     */
+    template <typename InputIt>
+    BasicPriorityQueue(InputIt first, InputIt last, CapacityPolicy capacity = CapacityPolicy(), ComparePolicy compare = ComparePolicy(), const Allocator& alloc = Allocator())
+        : CapacityPolicy(capacity), m_queue(alloc), m_compare(compare) {
+        insertRange(first, last);
+    }
+
+    /**
+     * \brief Inserts a new element into the queue.
+     *
+     * A bounded queue that is full replaces its lowest-priority element if
+     * the new element leaves before it, and discards the new element otherwise.
+     *
+     * \param priority - priority of the element.
+     * \param value - value of the element.
+     */
+    void insert(Key priority, const T& value) {
+        emplace(priority, value);
+    }
+
+    /**
+     * \brief Inserts a new element into the queue by moving it.
+     *
+     * \param priority - priority of the element.
+     * \param value - value of the element.
+     */
+    void insert(Key priority, T&& value) {
+        emplace(priority, std::move(value));
+    }
+
+    /**
+     * \brief Constructs a new element directly in the queue.
+     *
+     * Follows the same rules as insert(). The value is only constructed if the
+     * element is accepted, so rejected elements cost nothing.
+     *
+     * \param priority - priority of the element.
+     * \param args - arguments forwarded to the constructor of the value.
+     */
+    template <typename... Args>
+    void emplace(Key priority, Args&&... args) {
+        tryEmplace(priority, std::forward<Args>(args)...);
+    }
+
+    /**
+     * \brief Inserts a new element and reports what happened.
+     * \param priority - priority of the element.
+     * \param value - value of the element.
+     * \return Inserted if there was room, Evicted if the lowest element was
+     *         replaced, Rejected if the element was discarded.
+     */
+    InsertResult tryInsert(Key priority, const T& value) {
+        return tryEmplace(priority, value);
+    }
+
+    /**
+     * \brief Inserts a new element by moving it and reports what happened.
+     * \param priority - priority of the element.
+     * \param value - value of the element.
+     * \return Inserted, Evicted or Rejected, as for tryInsert(int, const T&).
+     */
+    InsertResult tryInsert(Key priority, T&& value) {
+        return tryEmplace(priority, std::move(value));
+    }
+
+    /**
+     * \brief Constructs a new element directly in the queue and reports what happened.
+     *
+     * The value is only constructed if the element is kept.
+     *
+     * \param priority - priority of the element.
+     * \param args - arguments forwarded to the constructor of the value.
+     * \return Inserted, Evicted or Rejected, as for tryInsert(int, const T&).
+     */
+    template <typename... Args>
+    InsertResult tryEmplace(Key priority, Args&&... args) {
+        [[maybe_unused]] auto timer=m_stats.time(QueueOp::Insert);
+        if constexpr (CapacityPolicy::bounded) {
+            if (m_lazy.enabled) {
+                return deferEmplace(priority, std::forward<Args>(args)...);
+            }
+            if (m_queue.size()>=this->getMaxSize()) {
+                if (!wouldAccept(priority)) {
+                    m_stats.recordRejected();
+                    return InsertResult::Rejected;
+                }
+                auto lowest=StoragePolicy::lowest(m_queue, m_compare);
+                m_index.remove(*lowest);
+                *lowest=detail::makeNode<NodeType>(m_queue.get_allocator(), priority, m_currentId++, std::in_place, std::forward<Args>(args)...);
+                m_index.add(*lowest, static_cast<size_t>(lowest-m_queue.begin()));
+                StoragePolicy::replaced(m_queue, lowest, m_compare, m_index.tracker());
+                m_stats.recordEvicted();
+                return InsertResult::Evicted;
+            }
+        }
+        m_queue.emplace_back(priority, m_currentId++, std::in_place, std::forward<Args>(args)...);
+        m_index.add(m_queue.back(), m_queue.size()-1);
+        StoragePolicy::push(m_queue, m_compare, m_index.tracker());
+        m_stats.recordInserted(m_queue.size());
+        return InsertResult::Inserted;
+    }
+
+    /**
+     * \brief Checks if an element with the given priority would be kept.
+     *
+     * Cheap and not virtual, so callers can skip building values that would
+     * be rejected anyway. While lazy inserts are pending, the element is
+     * compared with the lowest element kept by the last trim.
+     *
+     * \param priority - priority of the element.
+     * \return True if insert() would keep the element.
+     */
+    bool wouldAccept(Key priority) const {
+        if constexpr (CapacityPolicy::bounded) {
+            if (m_lazy.unordered) {
+                if (this->getMaxSize()==0) {
+                    return false;
+                }
+                if (m_lazy.floor==detail::LazyState::NoFloor) {
+                    return true;
+                }
+                const NodeType& floor=m_queue[m_lazy.floor];
+                return m_compare.before(priority, m_currentId, floor.getPriority(), floor.getId());
+            }
+            if (m_queue.size()>=this->getMaxSize()) {
+                if (m_queue.empty()) {
+                    return false;
+                }
+                auto lowest=StoragePolicy::lowest(m_queue, m_compare);
+                return m_compare.before(priority, m_currentId, lowest->getPriority(), lowest->getId());
+            }
+        }
+        return true;
+    }
+
+    /**
+     * \brief Gets the priority a new element has to beat once the queue is full.
+     *
+     * This is the priority of the element that would be evicted next. It is
+     * found in O(1) and the call is not virtual, so it can be inlined. While
+     * lazy inserts are pending, it is the lowest priority kept by the last
+     * trim, a lower bound of the exact threshold.
+     *
+     * Only available for int priorities, other key types use wouldAccept().
+     *
+     * \return Priority of the lowest element, or LLONG_MIN while the queue
+     *         still has room or is unbounded.
+     */
+    long long threshold() const requires std::is_same_v<Key, int> {
+        if constexpr (CapacityPolicy::bounded) {
+            if (m_lazy.unordered) {
+                return m_lazy.floor==detail::LazyState::NoFloor ? LLONG_MIN : m_queue[m_lazy.floor].getPriority();
+            }
+            if (m_queue.size()>=this->getMaxSize() && !m_queue.empty()) {
+                return StoragePolicy::lowest(m_queue, m_compare)->getPriority();
+            }
+        }
+        return LLONG_MIN;
+    }
+
+    /**
+     * \brief Inserts a batch of (priority, value) pairs.
+     *
+     * The result is the same as inserting the elements one by one, but the
+     * layout is restored once for the whole batch. A bounded queue selects
+     * the kept elements with std::nth_element, in O(n + k log k), and an
+     * unbounded heap is heapified in O(n). Values are moved if the range
+     * yields rvalues.
+     *
+     * \param first - beginning of the range.
+     * \param last - end of the range.
+     */
+    template <typename InputIt>
+    void insertRange(InputIt first, InputIt last) {
+        [[maybe_unused]] auto timer=m_stats.time(QueueOp::Batch);
+        [[maybe_unused]] size_t sizeBefore=m_queue.size();
+        [[maybe_unused]] size_t firstId=m_currentId;
+        [[maybe_unused]] size_t offered;
+        if constexpr (CapacityPolicy::bounded) {
+            if (m_lazy.enabled) {
+                for (; first!=last; ++first) {
+                    auto&& element=*first;
+                    deferEmplace(element.first, std::forward<decltype(element)>(element).second);
+                }
+                return;
+            }
+            offered=detail::insertRange<StoragePolicy>(m_queue, this->getMaxSize(), m_currentId, first, last, m_compare);
+        } else {
+            offered=detail::insertRange<StoragePolicy>(m_queue, m_currentId, first, last, m_compare);
+        }
+        m_index.rebuild(m_queue);
+        if constexpr (detail::statsEnabled) {
+            size_t size=m_queue.size();
+            // Unstable nodes carry no identifiers, so only the growth is known.
+            size_t kept=size-sizeBefore;
+            if constexpr (CapacityPolicy::bounded && detail::isStableV<ComparePolicy>) {
+                kept=detail::countNewNodes(m_queue, firstId);
+            }
+            m_stats.recordBatch(offered, kept, sizeBefore+kept-size, size);
+        }
+    }
+
+    /**
+     * \brief Inserts a batch of (priority, value) pairs.
+     * \param items - elements to insert, copied into the queue.
+     */
+    void insert(std::span<const std::pair<Key, T>> items) {
+        insertRange(items.begin(), items.end());
+    }
+
+    /**
+     * \brief Removes and returns the element with the highest priority.
+     *
+     * If the queue is empty, the error policy is notified and, unless it
+     * throws, the default element value is returned.
+     *
+     * \return The element with the highest priority.
+     */
+    T pop() {
+        if (m_queue.empty()) {
+            m_stats.recordEmptyPop();
+            ErrorPolicy::emptyPop();
+            return T();
+        }
+        [[maybe_unused]] auto timer=m_stats.time(QueueOp::Pop);
+        settle();
+        StoragePolicy::popHighest(m_queue, m_compare, m_index.tracker());
+        m_index.remove(m_queue.back());
+        T topValue=m_queue.back().takeValue();
+        m_queue.pop_back();
+        m_stats.recordPops(1);
+        return topValue;
+    }
+
+    /**
+     * \brief Removes and returns the element with the highest priority, if any.
+     *
+     * Never reports to the error policy.
+     *
+     * \return The element with the highest priority, or std::nullopt if the
+     *         queue is empty.
+     */
+    std::optional<T> tryPop() {
+        if (m_queue.empty()) {
+            return std::nullopt;
+        }
+        [[maybe_unused]] auto timer=m_stats.time(QueueOp::Pop);
+        settle();
+        StoragePolicy::popHighest(m_queue, m_compare, m_index.tracker());
+        m_index.remove(m_queue.back());
+        std::optional<T> topValue(m_queue.back().takeValue());
+        m_queue.pop_back();
+        m_stats.recordPops(1);
+        return topValue;
+    }
+
+    /**
+     * \brief Removes up to n highest-priority elements.
+     *
+     * The values are moved to the output in the order pop() would return
+     * them. The queue is reordered once for the whole run and the removed
+     * nodes are erased with a single call.
+     *
+     * \param n - maximum number of elements to remove.
+     * \param out - output iterator receiving the values.
+     * \return Output iterator past the last written value.
+     */
+    template <typename OutputIt>
+    OutputIt popN(size_t n, OutputIt out) {
+        [[maybe_unused]] auto timer=m_stats.time(QueueOp::Batch);
+        settle();
+        size_t count=std::min(n, m_queue.size());
+        StoragePolicy::extractHighest(m_queue, count, m_compare, m_index.tracker());
+        for (size_t i=m_queue.size(); i>m_queue.size()-count; --i) {
+            m_index.remove(m_queue[i-1]);
+            *out++=m_queue[i-1].takeValue();
+        }
+        m_queue.erase(m_queue.end()-count, m_queue.end());
+        m_stats.recordPops(count);
+        return out;
+    }
+
+    /**
+     * \brief Removes all elements and appends them to a vector.
+     *
+     * \param out - vector receiving the values, from the highest priority.
+     * \return Number of values appended.
+     */
+    size_t drainInto(std::vector<T>& out) {
+        settle();
+        size_t count=m_queue.size();
+        out.reserve(out.size()+count);
+        popN(count, std::back_inserter(out));
+        return count;
+    }
+
+    /**
+     * \brief Gets the element with the highest priority without removing it.
+     *
+     * O(1), or an O(n) scan while lazy inserts are pending.
+     *
+     * \return Node with the highest priority, the queue must not be empty.
+     */
+    const NodeType& top() const {
+        if constexpr (CapacityPolicy::bounded) {
+            if (m_lazy.unordered) {
+                return *std::min_element(m_queue.begin(), m_queue.end(), m_compare);
+            }
+        }
+        return *StoragePolicy::highest(m_queue, m_compare);
+    }
+
+    /**
+     * \brief Sets the maximum size of a bounded queue.
+     *
+     * Removes the lowest-priority elements if the new size is smaller than
+     * the current number of elements. The reserved memory follows the new
+     * size, so shrinking the queue releases memory and growing it reserves
+     * room up front.
+     *
+     * \param newSize The new maximum size of the queue.
+     */
+    void setMaxSize(size_t newSize) {
+        static_assert(CapacityPolicy::bounded, "Only bounded queues have a maximum size");
+        settle();
+        this->changeMaxSize(newSize);
+        if (m_queue.size()>newSize) {
+            StoragePolicy::truncate(m_queue, newSize, m_compare);
+            m_index.rebuild(m_queue);
+        }
+        size_t wanted=detail::upfrontCapacity(newSize);
+        if (m_queue.capacity()>wanted) {
+            detail::resetCapacity(m_queue, wanted);
+        } else {
+            m_queue.reserve(wanted);
+        }
+    }
+
+    /**
+     * \brief Switches the lazy ordering mode of a bounded queue on or off.
+     *
+     * Meant for write phases with many more inserts than pops. In lazy mode
+     * inserts append to an unordered buffer of up to twice the maximum size
+     * and only compare against the lowest element kept by the last trim, an
+     * approximate threshold, so they run in amortized O(1). The buffer is
+     * ordered once, at the first pop, popN(), merge() or settle(). The
+     * elements that leave the queue are the same as without the mode.
+     *
+     * Inserts report Inserted even if the element is cut by a later trim,
+     * and the stats count it as evicted then. Reads never order the buffer:
+     * size(), top(), printQueue(), topK(), contains(), find() and count()
+     * account for the pending trim, while nodes() and the iterators expose
+     * the unordered buffer, elements the next trim discards included. Call
+     * settle() first for the exact contents in storage order.
+     *
+     * Switching the mode off orders the buffer right away.
+     *
+     * \param enabled - true to defer the ordering of inserts.
+     */
+    void setLazyOrdering(bool enabled) requires CapacityPolicy::bounded {
+        m_lazy.enabled=enabled;
+        if (!enabled) {
+            settle();
+        }
+    }
+
+    /**
+     * \brief Checks if inserts defer their ordering.
+     * \return True in lazy ordering mode.
+     */
+    bool isLazyOrdering() const requires CapacityPolicy::bounded {
+        return m_lazy.enabled;
+    }
+
+    /**
+     * \brief Orders the elements buffered by the lazy mode now.
+     *
+     * Trims the buffer to the maximum size in O(n) and builds the layout of
+     * the storage once. Does nothing if no lazy inserts are pending, and
+     * always for an unbounded queue.
+     */
+    void settle() {
+        if constexpr (CapacityPolicy::bounded) {
+            if (!m_lazy.unordered) {
+                return;
+            }
+            trimBuffer();
+            StoragePolicy::build(m_queue, m_compare);
+            m_index.reindex(m_queue);
+            m_lazy.unordered=false;
+            m_lazy.floor=detail::LazyState::NoFloor;
+        }
+    }
+
+    /**
+     * \brief Moves the elements of another queue into this one.
+     *
+     * Keeps the getMaxSize() highest elements of both queues without
+     * re-sorting them: each queue brings its highest elements to the back in
+     * leave order, which SortedStorage already keeps and a heap does in
+     * O(k log n), and the two runs are merged until the queue is full. Nodes
+     * are moved, not copied. On equal priorities the elements of this queue
+     * leave first. The other queue is empty afterwards.
+     *
+     * The stats of this queue count the merge as a batch insert of the
+     * elements of the other queue, and its own dropped elements as evicted.
+     * The other queue counts its elements as popped.
+     *
+     * \param other - queue to take the elements from.
+     */
+    void merge(BasicPriorityQueue&& other) requires CapacityPolicy::bounded {
+        if (&other==this) {
+            return;
+        }
+        BasicPriorityQueue* sources[]={this, &other};
+        mergeInto(*this, sources, this->getMaxSize(), 1);
+    }
+
+    /**
+     * \brief Merges many queues into a queue of their k highest elements.
+     *
+     * Each queue contributes at most k elements, brought to its back in leave
+     * order, and a k-way merge stops after k elements, so the cost is
+     * O(m k log n) for the extraction, spread over the threads, plus
+     * O(k log m) for the merge. No element is re-inserted or copied. On equal
+     * priorities the elements of earlier queues leave first. The queues are
+     * empty afterwards, and the result uses the allocator of the first one.
+     * The result counts all elements of the queues as one batch insert, the
+     * queues count their elements as popped.
+     *
+     * \param queues - queues to merge, for example one per partition.
+     * \param k - maximum size of the result.
+     * \param threads - number of threads extracting from the queues.
+     * \return Queue with maximum size k holding the k highest elements.
+     */
+    static BasicPriorityQueue mergeAll(std::span<BasicPriorityQueue> queues, size_t k, size_t threads = 1) requires CapacityPolicy::bounded {
+        BasicPriorityQueue result=queues.empty() ? BasicPriorityQueue(k) : BasicPriorityQueue(k, queues.front().getAllocator());
+        std::vector<BasicPriorityQueue*> sources;
+        sources.reserve(queues.size());
+        for (auto& queue : queues) {
+            sources.push_back(&queue);
+        }
+        mergeInto(result, sources, k, threads);
+        return result;
+    }
+
+    /**
+    * \brief Checks if the queue contains an element with the given priority and value.
+    *
+    * The result is also reported to the error policy. With a HashIndex the
+    * lookup is O(1) on average, otherwise the queue is scanned. While the
+    * lazy mode has a trim pending, a match also has to survive the trim,
+    * which costs one more O(n) pass.
+    *
+    * \param priority - priority of the element to find.
+    * \param value - value of the element to find.
+    * \return True if the element is found, otherwise false.
+    */
+    bool contains(Key priority, const T& value) const {
+        if constexpr (IndexPolicy::enabled && !ErrorPolicy::reportsNodes) {
+            if (!pendingTrim()) {
+                if (m_index.count(priority, value)==0) {
+                    ErrorPolicy::notFound();
+                    return false;
+                }
+                ErrorPolicy::found();
+                return true;
+            }
+        }
+        if (const NodeType* node=find(priority, value)) {
+            ErrorPolicy::found(*node);
+            return true;
+        }
+        ErrorPolicy::notFound();
+        return false;
+    }
+
+    /**
+     * \brief Finds the element with the given priority and value that leaves first.
+     *
+     * With a HashIndex the node is found in O(1) on average, otherwise the
+     * queue is scanned. While the lazy mode has a trim pending, one more
+     * O(n) pass checks that the node survives the trim. Nothing is reported
+     * to the error policy.
+     *
+     * \param priority - priority of the element to find.
+     * \param value - value of the element to find.
+     * \return Pointer to the matching node, valid until the queue is modified,
+     * or nullptr if there is none.
+     */
+    const NodeType* find(Key priority, const T& value) const {
+        const NodeType* match=nullptr;
+        if constexpr (IndexPolicy::enabled) {
+            match=m_index.find(m_queue, priority, value);
+        } else {
+            for (const auto& node : m_queue) {
+                if (node.getPriority()==priority && node.getValue()==value && (match==nullptr || m_compare(node, *match))) {
+                    match=&node;
+                }
+            }
+        }
+        return match!=nullptr && isKept(*match) ? match : nullptr;
+    }
+
+    /**
+     * \brief Counts the elements with the given priority and value.
+     *
+     * O(1) on average with a HashIndex, otherwise the queue is scanned.
+     * While the lazy mode has a trim pending, every match costs one more O(n)
+     * pass to check that it survives the trim. Unlike contains(), nothing is
+     * reported to the error policy.
+     *
+     * \param priority - priority of the elements to count.
+     * \param value - value of the elements to count.
+     * \return Number of matching elements in the queue.
+     */
+    size_t count(Key priority, const T& value) const {
+        if constexpr (IndexPolicy::enabled) {
+            if (!pendingTrim()) {
+                return m_index.count(priority, value);
+            }
+        }
+        size_t matches=0;
+        for (const auto& node : m_queue) {
+            if (node.getPriority()==priority && node.getValue()==value && isKept(node)) {
+                ++matches;
+            }
+        }
+        return matches;
+    }
+
+    /**
+     * \brief Estimates the memory used by the lookup index.
+     * \return Approximate size of the index in bytes, 0 without an index.
+     */
+    size_t indexMemoryUsage() const {
+        return m_index.memoryUsage();
+    }
+
+    /**
+     * \brief Reserves room for a number of elements.
+     * \param count - number of elements to reserve room for.
+     */
+    void reserve(size_t count) {
+        m_queue.reserve(count);
+    }
+
+    /**
+     * \brief Releases unused memory of the queue.
+     */
+    void shrinkToFit() {
+        m_queue.shrink_to_fit();
+    }
+
+    /**
+     * \brief Gets the number of elements the queue can hold without reallocating.
+     * \return Capacity of the queue.
+     */
+    size_t capacity() const {
+        return m_queue.capacity();
+    }
+
+    /**
+     * \brief Gets the allocator of the nodes.
+     * \return Copy of the allocator.
+     */
+    Allocator getAllocator() const {
+        return m_queue.get_allocator();
+    }
+
+    /**
+     * \brief Gets the counters and latency histograms of the queue.
+     * \return Stats of the queue, always zero unless KP_ENABLE_STATS is
+     *         defined.
+     */
+    const QueueStats& stats() const {
+        return m_stats.get();
+    }
+
+    /**
+     * \brief Clears the counters and latency histograms.
+     */
+    void resetStats() {
+        m_stats.reset();
+    }
+
+    /**
+     * \brief Checks if the queue is empty.
+     * \return True if the queue is empty, false otherwise.
+     */
+    bool isEmpty() const {
+        return m_queue.empty();
+    }
+
+    /**
+     * \brief Gets the size of the queue.
+     * \return Number of elements in the queue, without the buffered elements
+     *         the next trim of the lazy mode discards.
+     */
+    size_t size() const {
+        if constexpr (CapacityPolicy::bounded) {
+            return std::min(m_queue.size(), this->getMaxSize());
+        } else {
+            return m_queue.size();
+        }
+    }
+
+    /**
+     * \brief Prints the current state of the queue.
+     *
+     * Displays the contents of the queue to the standard output, from the
+     * highest to the lowest priority.
+     */
+    void printQueue() const {
+        size_t count=size();
+        if (count==0) {
+            std::cout<<"Queue is empty"<<std::endl;
+            return;
+        }
+        std::vector<const NodeType*> ordered(count);
+        for (const NodeType* node : topK(ordered)) {
+            std::cout<<*node<<std::endl;
+        }
+    }
+
+    using const_iterator=typename std::vector<NodeType, Allocator>::const_iterator;
+
+    /**
+     * \brief Gets an iterator to the first node in storage order.
+     *
+     * The nodes are visited in the layout of the storage policy, not in leave
+     * order. Iterators are invalidated by any change of the queue.
+     *
+     * \return Iterator to the first node.
+     */
+    const_iterator begin() const {
+        return m_queue.begin();
+    }
+
+    /**
+     * \brief Gets an iterator past the last node in storage order.
+     * \return Iterator past the last node.
+     */
+    const_iterator end() const {
+        return m_queue.end();
+    }
+
+    /**
+     * \brief Gets a read-only view of all nodes in storage order, without copying them.
+     * \return Span over the nodes, invalidated by any change of the queue.
+     */
+    std::span<const NodeType> nodes() const {
+        return std::span<const NodeType>(m_queue.data(), m_queue.size());
+    }
+
+    /**
+     * \brief Gets the highest nodes in leave order without removing them.
+     *
+     * Fills the buffer with pointers to the out.size() highest nodes, or to
+     * all of them if the queue is smaller, scanning the nodes once with the
+     * compare policy in O(size() log k). Nothing is allocated, and buffered
+     * elements the next trim of the lazy mode discards are never returned.
+     * A buffer of size() pointers receives the whole queue in the order
+     * pop() would return it. The pointers are invalidated by any change of
+     * the queue.
+     *
+     * \param out - buffer for the pointers, its size is the number wanted.
+     * \return The filled front of out, highest priority first.
+     */
+    std::span<const NodeType*> topK(std::span<const NodeType*> out) const {
+        return detail::highestNodes(nodes(), out.first(std::min(out.size(), size())), m_compare);
+    }
+};
+
+/**
+ * \brief Non-virtual bounded queue without a lookup index.
+ *
+ * Same engine and type as BoundedPriorityQueue<T, Storage, ErrorPolicy>, kept
+ * under this name for code written against it.
+ *
+ * \tparam T The type of the elements in the queue.
+ * \tparam Storage Layout of the elements, MinMaxHeapStorage or SortedStorage.
+ * \tparam ErrorPolicy Reaction to pop() on an empty queue.
+ * \tparam Allocator Allocator of the nodes.
+ */
+template <typename T, typename Storage = MinMaxHeapStorage, typename ErrorPolicy = PrintErrors, typename Allocator = std::allocator<Node<T>>>
+using BoundedQueue=BasicPriorityQueue<T, Storage, NodeCompare, Bounded, ErrorPolicy, Allocator>;
+
+/**
+ * \brief Non-virtual unbounded d-ary heap queue.
+ *
+ * Same engine and type as DAryHeapPriorityQueue, kept under this name for
+ * code written against it.
+ *
+ * \tparam T The type of the elements in the queue.
+ * \tparam Arity Number of children of every heap node.
+ * \tparam ErrorPolicy Reaction to pop() on an empty queue.
+ * \tparam Allocator Allocator of the nodes.
+ */
+template <typename T, size_t Arity, typename ErrorPolicy = PrintErrors, typename Allocator = std::allocator<Node<T>>>
+using DAryHeapQueue=BasicPriorityQueue<T, DAryHeapStorage<Arity>, NodeCompare, Unbounded, ErrorPolicy, Allocator>;
+
+/**
+ * \brief Non-virtual unbounded binary heap queue.
+ *
+ * \tparam T The type of the elements in the queue.
+ * \tparam ErrorPolicy Reaction to pop() on an empty queue.
+ */
+template <typename T, typename ErrorPolicy = PrintErrors>
+using BinaryHeapQueue=DAryHeapQueue<T, 2, ErrorPolicy>;
+
+namespace pmr {
+
+    /**
+     * \brief BoundedQueue with a polymorphic allocator.
+     */
+    template <typename T, typename Storage = MinMaxHeapStorage, typename ErrorPolicy = PrintErrors>
+    using BoundedQueue=kp::BoundedQueue<T, Storage, ErrorPolicy, std::pmr::polymorphic_allocator<Node<T>>>;
+
+    /**
+     * \brief DAryHeapQueue with a polymorphic allocator.
+     */
+    template <typename T, size_t Arity, typename ErrorPolicy = PrintErrors>
+    using DAryHeapQueue=kp::DAryHeapQueue<T, Arity, ErrorPolicy, std::pmr::polymorphic_allocator<Node<T>>>;
+
+}
+
+}
@@ -1,118 +1,43 @@
 #pragma once
-#include "PriorityQueue.hpp"
-#include <algorithm>
+#include "BasicPriorityQueue.hpp"
 
 namespace kp {
 
 /**
  * \brief A priority queue with a limited size.
  *
- * This class extends the PriorityQueue to change the maximum size. If the
- * queue reaches its maximum size, elements with lower priorities are discarded
- * to make space for elements with higher priority.
+ * If the queue reaches its maximum size, elements with lower priorities are
+ * discarded to make space for elements with higher priority.
+ *
+ * The layout of the elements is chosen by the Storage policy. The default
+ * MinMaxHeapStorage runs insert, eviction and pop in O(log n); SortedStorage
+ * keeps the highest priority at the back, so pop is O(1) and moves nothing.
+ *
+ * This is BasicPriorityQueue with the Bounded capacity policy, so nothing is
+ * virtual; the lookup index, lazy ordering, merging and snapshots are
+ * features of that engine. BoundedQueue is the same type without the Index
+ * parameter. Wrap the queue in a PriorityQueueAdapter to use it through the
+ * PriorityQueue interface.
  *
  * \tparam T The type of the elements in the queue.
+ * \tparam Storage Layout of the elements, MinMaxHeapStorage or SortedStorage.
+ * \tparam ErrorPolicy Reaction to an empty pop() and to contains() results,
+ *         e.g. PrintErrors, SilentErrors or ThrowErrors.
+ * \tparam Index Lookup index used by contains(), find() and count(), NoIndex or
+ *         HashIndex<T>.
+ * \tparam Allocator Allocator of the nodes, see BasicPriorityQueue.
  */
-template <typename T>
-class BoundedPriorityQueue : public PriorityQueue<T> {
-private:
-    size_t m_maxSize;
-
-public:
-    /**
-     * \brief Default constructor.
-     *
-     * Creates a BoundedPriorityQueue with a default maximum size of 10.
-     */
-    constexpr BoundedPriorityQueue() : m_maxSize(10) {}
-
-    /**
-     * \brief Parameterized constructor.
-     *
-     * Creates a BoundedPriorityQueue with a specified maximum size.
-     *
-     * \param maxSize The maximum size of the queue.
-     */
-    constexpr BoundedPriorityQueue(size_t maxSize) : m_maxSize(maxSize) {}
-
-    /**
-     * \brief Inserts a new element into the queue.
-     *
-     * If the queue is not full, the element is added. If the queue is full
-     * and the new element's priority is higher than the lowest priority in the
-     * queue, the lowest-priority element is replaced.
-     *
-     * \param priority - priority of the element.
-     * \param value - value of the element.
-     */
-    void insert(int priority, const T& value) override {
-        if (this->m_queue.size() < m_maxSize) {
-            this->m_queue.emplace_back(priority, value, this->m_currentId++);
-            std::sort(this->m_queue.begin(), this->m_queue.end(), PriorityQueue<T>::compareNodes);
-        } else if (priority > this->m_queue.back().getPriority()) {
-            this->m_queue.back() = Node<T>(priority, value, this->m_currentId++);
-            std::sort(this->m_queue.begin(), this->m_queue.end(), PriorityQueue<T>::compareNodes);
-        }
-    }
+template <typename T, typename Storage = MinMaxHeapStorage, typename ErrorPolicy = PrintErrors, typename Index = NoIndex, typename Allocator = std::allocator<Node<T>>>
+using BoundedPriorityQueue = BasicPriorityQueue<T, Storage, NodeCompare, Bounded, ErrorPolicy, Allocator, Index>;
 
-    /**
-     * \brief Removes and returns the element with the highest priority.
-     *
-     * If the queue is empty, the default element value is returned and
-     * a message is printed to the standard output.
-     *
-     * \return The element with the highest priority.
-     */
-    T pop() override {
-        if (this->isEmpty()) {
-            std::cout << "Queue is empty" << std::endl;
-            return T();
-        }
-        T topValue = this->m_queue.front().getValue();
-        this->m_queue.erase(this->m_queue.begin());
-        return topValue;
-    }
+namespace pmr {
 
     /**
-     * \brief Sets the maximum size of the queue.
-     *
-     * Adjusts the maximum size of the queue and removes unnecessary elements if
-     * the new size is smaller than the current number of elements.
-     *
-     * \param newSize The new maximum size of the queue.
+     * \brief BoundedPriorityQueue with a polymorphic allocator.
      */
-    void setMaxSize(size_t newSize) {
-        m_maxSize = newSize;
-        while (this->m_queue.size() > m_maxSize) {
-            this->m_queue.pop_back();
-        }
-    }
+    template <typename T, typename Storage = MinMaxHeapStorage, typename ErrorPolicy = PrintErrors, typename Index = NoIndex>
+    using BoundedPriorityQueue = kp::BoundedPriorityQueue<T, Storage, ErrorPolicy, Index, std::pmr::polymorphic_allocator<Node<T>>>;
 
-    /**
-     * \brief Gets the maximum size of the queue.
-     * \return The maximum size of the queue.
-     */
-    size_t getMaxSize() const { 
-        return m_maxSize; 
-    }
-
-    /**
-    * \brief Checks if the queue contains an element with the given priority and value.
-    *
-    * \param priority - priority of the element to find.
-    * \param value - value of the element to find.
-    * \return True if the element is found, otherwise false.
-    */
-    bool contains(int priority, const T& value) const {
-        for (const auto& node : this->m_queue){
-            if (node.getPriority()==priority && node.getValue()==value) {
-                std::cout<<"Element found: "<<node<<std::endl;
-                return true;
-            }
-        }
-        std::cout<<"Element not found"<<std::endl;
-        return false;
-    }
-};
+}
 
 }
@@ -0,0 +1,303 @@
+#pragma once
+#include "PriorityQueue.hpp"
+#include "ErrorPolicies.hpp"
+#include <bit>
+#include <cstdint>
+#include <stdexcept>
+
+namespace kp {
+
+/**
+ * \brief Priority queue for a small range of integer priorities.
+ *
+ * Keeps one FIFO bucket per priority level and a two-level bitmap of the
+ * non-empty buckets. Insert appends to a bucket and sets a bit, pop finds the
+ * highest set bit with two count-leading-zeros instructions and takes the
+ * front of that bucket, so both are O(1) and no element is ever compared with
+ * another. Equal priorities leave in insertion order, the same guarantee the
+ * comparison-based queues give through the node identifier.
+ *
+ * The buckets are linked lists threaded through one pool of entries, so an
+ * empty level costs 8 bytes and freed entries are reused by later inserts.
+ * The bitmap scan is linear in the number of levels divided by 4096, which
+ * makes the engine a fit for ranges of a few thousand levels, such as QoS
+ * classes, and a poor fit for sparse priorities like timestamps.
+ *
+ * The entries are linked with 32-bit indices, so a queue holds at most
+ * 2^32 - 1 elements; inserts beyond that throw std::length_error.
+ *
+ * \tparam T The type of the elements in the queue.
+ * \tparam ErrorPolicy Reaction to pop() on an empty queue.
+ */
+template <typename T, typename ErrorPolicy = PrintErrors>
+class BucketPriorityQueue {
+private:
+    static constexpr uint32_t None=UINT32_MAX;
+
+    struct Entry {
+        T value;
+        uint32_t next;
+    };
+
+    struct Bucket {
+        uint32_t head=None;
+        uint32_t tail=None;
+    };
+
+    int m_minPriority;
+    std::vector<Bucket> m_buckets;
+    std::vector<uint64_t> m_words;
+    std::vector<uint64_t> m_summary;
+    std::vector<Entry> m_entries;
+    uint32_t m_freeEntries=None;
+    size_t m_size=0;
+
+    /**
+     * \brief Finds the bucket of the highest non-empty priority level.
+     * \return Index of the bucket, the queue must not be empty.
+     */
+    size_t highestBucket() const {
+        size_t s=m_summary.size();
+        while (m_summary[--s]==0) {
+        }
+        size_t word=s*64+63-static_cast<size_t>(std::countl_zero(m_summary[s]));
+        return word*64+63-static_cast<size_t>(std::countl_zero(m_words[word]));
+    }
+
+    /**
+     * \brief Marks a bucket as non-empty.
+     * \param bucket - index of the bucket.
+     */
+    void setBit(size_t bucket) {
+        m_words[bucket/64]|=uint64_t(1)<<(bucket%64);
+        m_summary[bucket/4096]|=uint64_t(1)<<(bucket/64%64);
+    }
+
+    /**
+     * \brief Marks a bucket as empty.
+     * \param bucket - index of the bucket.
+     */
+    void clearBit(size_t bucket) {
+        uint64_t& word=m_words[bucket/64];
+        word&=~(uint64_t(1)<<(bucket%64));
+        if (word==0) {
+            m_summary[bucket/4096]&=~(uint64_t(1)<<(bucket/64%64));
+        }
+    }
+
+    /**
+     * \brief Maps a priority to its bucket.
+     * \param priority - priority of an element.
+     * \return Index of the bucket.
+     * \throws std::out_of_range if the priority is outside the range.
+     */
+    size_t bucketOf(int priority) const {
+        if (priority<m_minPriority || priority>getMaxPriority()) {
+            throw std::out_of_range("Priority outside the range of the bucket queue");
+        }
+        return static_cast<size_t>(static_cast<long long>(priority)-m_minPriority);
+    }
+
+    /**
+     * \brief Unlinks the front entry of the highest bucket.
+     * \return Value of the removed element.
+     */
+    T takeHighest() {
+        size_t index=highestBucket();
+        Bucket& bucket=m_buckets[index];
+        uint32_t slot=bucket.head;
+        Entry& entry=m_entries[slot];
+        bucket.head=entry.next;
+        if (bucket.head==None) {
+            bucket.tail=None;
+            clearBit(index);
+        }
+        T value=std::move(entry.value);
+        entry.next=m_freeEntries;
+        m_freeEntries=slot;
+        --m_size;
+        return value;
+    }
+
+public:
+    /**
+     * \brief Parameterized constructor.
+     *
+     * \param minPriority - lowest priority the queue accepts.
+     * \param maxPriority - highest priority the queue accepts.
+     * \throws std::invalid_argument if maxPriority is below minPriority.
+     */
+    explicit BucketPriorityQueue(int minPriority = 0, int maxPriority = 1023) : m_minPriority(minPriority) {
+        if (maxPriority<minPriority) {
+            throw std::invalid_argument("Empty priority range");
+        }
+        size_t levels=static_cast<size_t>(static_cast<long long>(maxPriority)-minPriority)+1;
+        m_buckets.resize(levels);
+        m_words.resize((levels+63)/64);
+        m_summary.resize((m_words.size()+63)/64);
+    }
+
+    /**
+     * \brief Inserts a new element into the queue in O(1).
+     * \param priority - priority of the element, within the range.
+     * \param value - value of the element.
+     * \throws std::out_of_range if the priority is outside the range.
+     */
+    void insert(int priority, const T& value) {
+        emplace(priority, value);
+    }
+
+    /**
+     * \brief Inserts a new element into the queue by moving it.
+     * \param priority - priority of the element, within the range.
+     * \param value - value of the element.
+     * \throws std::out_of_range if the priority is outside the range.
+     */
+    void insert(int priority, T&& value) {
+        emplace(priority, std::move(value));
+    }
+
+    /**
+     * \brief Constructs a new element directly in the queue.
+     * \param priority - priority of the element, within the range.
+     * \param args - arguments forwarded to the constructor of the value.
+     * \throws std::out_of_range if the priority is outside the range.
+     * \throws std::length_error if the queue already holds 2^32 - 1 elements.
+     */
+    template <typename... Args>
+    void emplace(int priority, Args&&... args) {
+        size_t index=bucketOf(priority);
+        T value(std::forward<Args>(args)...);
+        uint32_t slot;
+        if (m_freeEntries!=None) {
+            slot=m_freeEntries;
+            m_entries[slot].value=std::move(value);
+            m_freeEntries=m_entries[slot].next;
+            m_entries[slot].next=None;
+        } else {
+            if (m_entries.size()>=None) {
+                throw std::length_error("BucketPriorityQueue holds at most 2^32 - 1 elements");
+            }
+            slot=static_cast<uint32_t>(m_entries.size());
+            m_entries.push_back(Entry{std::move(value), None});
+        }
+        Bucket& bucket=m_buckets[index];
+        if (bucket.tail==None) {
+            bucket.head=slot;
+            setBit(index);
+        } else {
+            m_entries[bucket.tail].next=slot;
+        }
+        bucket.tail=slot;
+        ++m_size;
+    }
+
+    /**
+     * \brief Removes and returns the element with the highest priority in O(1).
+     *
+     * If the queue is empty, the error policy is notified and, unless it
+     * throws, the default element value is returned.
+     *
+     * \return The element with the highest priority.
+     */
+    T pop() {
+        if (m_size==0) {
+            ErrorPolicy::emptyPop();
+            return T();
+        }
+        return takeHighest();
+    }
+
+    /**
+     * \brief Removes and returns the element with the highest priority, if any.
+     * \return The element with the highest priority, or std::nullopt.
+     */
+    std::optional<T> tryPop() {
+        if (m_size==0) {
+            return std::nullopt;
+        }
+        return takeHighest();
+    }
+
+    /**
+     * \brief Removes up to n highest-priority elements.
+     * \param n - maximum number of elements to remove.
+     * \param out - output iterator receiving the values, highest first.
+     * \return Output iterator past the last written value.
+     */
+    template <typename OutputIt>
+    OutputIt popN(size_t n, OutputIt out) {
+        for (size_t count=std::min(n, m_size); count>0; --count) {
+            *out++=takeHighest();
+        }
+        return out;
+    }
+
+    /**
+     * \brief Gets the priority of the element that leaves next.
+     * \return Highest priority in the queue, the queue must not be empty.
+     */
+    int topPriority() const {
+        return static_cast<int>(m_minPriority+static_cast<long long>(highestBucket()));
+    }
+
+    /**
+     * \brief Gets the value of the element that leaves next.
+     * \return Value with the highest priority, the queue must not be empty.
+     */
+    const T& topValue() const {
+        return m_entries[m_buckets[highestBucket()].head].value;
+    }
+
+    /**
+     * \brief Checks if the queue is empty.
+     * \return True if the queue is empty, false otherwise.
+     */
+    bool isEmpty() const {
+        return m_size==0;
+    }
+
+    /**
+     * \brief Gets the size of the queue.
+     * \return Number of elements in the queue.
+     */
+    size_t size() const {
+        return m_size;
+    }
+
+    /**
+     * \brief Gets the lowest accepted priority.
+     * \return Lower end of the priority range.
+     */
+    int getMinPriority() const {
+        return m_minPriority;
+    }
+
+    /**
+     * \brief Gets the highest accepted priority.
+     * \return Upper end of the priority range.
+     */
+    int getMaxPriority() const {
+        return static_cast<int>(m_minPriority+static_cast<long long>(m_buckets.size())-1);
+    }
+
+    /**
+     * \brief Prints the current state of the queue.
+     *
+     * Displays the contents of the queue to the standard output, from the
+     * highest to the lowest priority.
+     */
+    void printQueue() const {
+        if (m_size==0) {
+            std::cout<<"Queue is empty"<<std::endl;
+            return;
+        }
+        for (size_t index=m_buckets.size(); index-->0;) {
+            for (uint32_t slot=m_buckets[index].head; slot!=None; slot=m_entries[slot].next) {
+                std::cout<<"Priority: "<<m_minPriority+static_cast<long long>(index)<<", Value: "<<m_entries[slot].value<<std::endl;
+            }
+        }
+    }
+};
+
+}
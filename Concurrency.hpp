@@ -0,0 +1,84 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+namespace kp {
+
+/**
+ * \brief Size of a cache line, used to pad data shared between threads.
+ */
+inline constexpr size_t CacheLineSize=64;
+
+/**
+ * \brief Minimal test-and-test-and-set spin lock.
+ *
+ * Meant for critical sections of a few dozen instructions, such as one heap
+ * operation. Satisfies the Lockable requirements, so it works with
+ * std::lock_guard and std::unique_lock.
+ */
+class SpinLock {
+private:
+    std::atomic<bool> m_locked{false};
+
+public:
+    /**
+     * \brief Tries to acquire the lock without waiting.
+     * \return True if the lock was acquired.
+     */
+    bool try_lock() {
+        return !m_locked.load(std::memory_order_relaxed) && !m_locked.exchange(true, std::memory_order_acquire);
+    }
+
+    /**
+     * \brief Acquires the lock, spinning and then yielding while it is taken.
+     */
+    void lock() {
+        for (unsigned spins=0; !try_lock(); ++spins) {
+            if (spins>=64) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    /**
+     * \brief Releases the lock.
+     */
+    void unlock() {
+        m_locked.store(false, std::memory_order_release);
+    }
+};
+
+namespace detail {
+
+    /**
+     * \brief Cheap per-thread pseudo-random numbers for load balancing.
+     * \return Next value of a thread-local xorshift generator.
+     */
+    inline uint64_t threadRandom() {
+        thread_local uint64_t state=std::hash<std::thread::id>{}(std::this_thread::get_id())*0x9e3779b97f4a7c15ULL | 1;
+        state^=state<<13;
+        state^=state>>7;
+        state^=state<<17;
+        return state;
+    }
+
+    /**
+     * \brief Small identifier of the calling thread.
+     *
+     * Threads are numbered 0, 1, 2, ... in the order they first call this
+     * function, which maps them evenly onto per-thread shards.
+     *
+     * \return Index of the calling thread.
+     */
+    inline size_t threadIndex() {
+        static std::atomic<size_t> nextIndex{0};
+        thread_local size_t index=nextIndex.fetch_add(1, std::memory_order_relaxed);
+        return index;
+    }
+
+}
+
+}
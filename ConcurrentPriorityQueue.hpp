@@ -0,0 +1,192 @@
+#pragma once
+#include "PriorityQueue.hpp"
+#include "StoragePolicies.hpp"
+#include "Concurrency.hpp"
+#include <climits>
+#include <memory>
+#include <mutex>
+
+namespace kp {
+
+/**
+ * \brief A relaxed priority queue for many producer and consumer threads.
+ *
+ * Implements the MultiQueue design: the elements are spread over several
+ * d-ary heaps, each guarded by its own spin lock on its own cache line.
+ * insert() adds to a random heap and moves on to another one if the lock is
+ * taken. tryPop() looks at the cached tops of two random heaps and pops from
+ * the better one, so threads rarely wait for each other and throughput grows
+ * with the number of threads.
+ *
+ * The price is relaxed ordering. With m heaps, tryPop() returns an element
+ * whose expected rank among all queued elements is O(m), and the rank error
+ * stays below m*log(m) with high probability. Elements of one heap still
+ * leave in order, and equal priorities are tie-broken by an identifier from
+ * one shared atomic counter. tryPop() only reports an empty queue after it
+ * has checked every heap.
+ *
+ * \tparam T The type of the elements in the queue.
+ */
+template <typename T>
+class ConcurrentPriorityQueue {
+private:
+    static constexpr long long EmptyTop=LLONG_MIN;
+
+    struct alignas(CacheLineSize) Shard {
+        SpinLock lock;
+        std::atomic<long long> topPriority{EmptyTop};
+        std::vector<Node<T>> heap;
+
+        void refreshTop() {
+            topPriority.store(heap.empty() ? EmptyTop : heap.front().getPriority(), std::memory_order_release);
+        }
+    };
+
+    using Storage=DAryHeapStorage<4>;
+
+    std::unique_ptr<Shard[]> m_shards;
+    size_t m_shardCount;
+    alignas(CacheLineSize) std::atomic<size_t> m_currentId{1};
+    alignas(CacheLineSize) std::atomic<size_t> m_size{0};
+
+    /**
+     * \brief Pops the top of a locked shard.
+     * \param shard - shard whose lock is held and which is not empty.
+     * \return Value of the removed element.
+     */
+    T popLocked(Shard& shard) {
+        Storage::popHighest(shard.heap, NodeCompare());
+        T topValue=shard.heap.back().takeValue();
+        shard.heap.pop_back();
+        shard.refreshTop();
+        m_size.fetch_sub(1, std::memory_order_relaxed);
+        return topValue;
+    }
+
+public:
+    /**
+     * \brief Parameterized constructor.
+     *
+     * \param threads - expected number of threads using the queue.
+     * \param shardsPerThread - heaps per thread, 2 is the usual choice. More
+     *        heaps mean less contention but a weaker ordering.
+     */
+    explicit ConcurrentPriorityQueue(size_t threads = std::thread::hardware_concurrency(), size_t shardsPerThread = 2)
+        : m_shardCount(std::max<size_t>(1, std::max<size_t>(1, threads)*shardsPerThread)) {
+        m_shards.reset(new Shard[m_shardCount]);
+    }
+
+    ConcurrentPriorityQueue(const ConcurrentPriorityQueue&)=delete;
+    ConcurrentPriorityQueue& operator=(const ConcurrentPriorityQueue&)=delete;
+
+    /**
+     * \brief Inserts a new element into the queue. Thread-safe.
+     * \param priority - priority of the element.
+     * \param value - value of the element.
+     */
+    void insert(int priority, const T& value) {
+        emplace(priority, value);
+    }
+
+    /**
+     * \brief Inserts a new element into the queue by moving it. Thread-safe.
+     * \param priority - priority of the element.
+     * \param value - value of the element.
+     */
+    void insert(int priority, T&& value) {
+        emplace(priority, std::move(value));
+    }
+
+    /**
+     * \brief Constructs a new element directly in the queue. Thread-safe.
+     * \param priority - priority of the element.
+     * \param args - arguments forwarded to the constructor of the value.
+     */
+    template <typename... Args>
+    void emplace(int priority, Args&&... args) {
+        Node<T> node(priority, m_currentId.fetch_add(1, std::memory_order_relaxed), std::in_place, std::forward<Args>(args)...);
+        for (;;) {
+            Shard& shard=m_shards[detail::threadRandom()%m_shardCount];
+            if (!shard.lock.try_lock()) {
+                continue;
+            }
+            shard.heap.push_back(std::move(node));
+            Storage::push(shard.heap, NodeCompare());
+            shard.refreshTop();
+            m_size.fetch_add(1, std::memory_order_relaxed);
+            shard.lock.unlock();
+            return;
+        }
+    }
+
+    /**
+     * \brief Removes and returns an element with one of the highest priorities.
+     *
+     * Thread-safe. The ordering is relaxed as described for the class.
+     *
+     * \return A high-priority element, or std::nullopt if every heap was
+     *         empty when it was checked.
+     */
+    std::optional<T> tryPop() {
+        for (int attempt=0; attempt<8; ++attempt) {
+            Shard& a=m_shards[detail::threadRandom()%m_shardCount];
+            Shard& b=m_shards[detail::threadRandom()%m_shardCount];
+            long long topA=a.topPriority.load(std::memory_order_acquire);
+            long long topB=b.topPriority.load(std::memory_order_acquire);
+            Shard& best=topA>=topB ? a : b;
+            if (std::max(topA, topB)==EmptyTop) {
+                continue;
+            }
+            if (!best.lock.try_lock()) {
+                continue;
+            }
+            if (!best.heap.empty()) {
+                std::optional<T> topValue(popLocked(best));
+                best.lock.unlock();
+                return topValue;
+            }
+            best.lock.unlock();
+        }
+        for (size_t i=0; i<m_shardCount; ++i) {
+            Shard& shard=m_shards[i];
+            if (shard.topPriority.load(std::memory_order_acquire)==EmptyTop) {
+                continue;
+            }
+            std::lock_guard<SpinLock> guard(shard.lock);
+            if (!shard.heap.empty()) {
+                return popLocked(shard);
+            }
+        }
+        return std::nullopt;
+    }
+
+    /**
+     * \brief Gets the number of queued elements.
+     *
+     * The value is exact when no other thread is using the queue and
+     * approximate otherwise.
+     *
+     * \return Number of elements in the queue.
+     */
+    size_t size() const {
+        return m_size.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * \brief Checks if the queue is empty, with the same caveat as size().
+     * \return True if the queue is empty, false otherwise.
+     */
+    bool isEmpty() const {
+        return size()==0;
+    }
+
+    /**
+     * \brief Gets the number of internal heaps.
+     * \return Number of heaps the elements are spread over.
+     */
+    size_t shardCount() const {
+        return m_shardCount;
+    }
+};
+
+}
@@ -0,0 +1,162 @@
+#pragma once
+#include "MoveTracking.hpp"
+#include <cstddef>
+#include <utility>
+
+namespace kp {
+
+/*
+ * Algorithms that maintain a d-ary heap over a random-access range.
+ *
+ * The comparator follows the convention of NodeCompare:
+ * comp(a, b) is true when a must leave the queue before b, so the element
+ * that leaves first is at the front of the range. Like std::push_heap and
+ * std::pop_heap, push expects the new element at the end of the range and pop
+ * moves the removed element to the end of the range. Elements are moved
+ * through a hole instead of being swapped, which halves the number of moves.
+ *
+ * Every function optionally takes an onMove callback that is called as
+ * onMove(element, index) whenever an element lands on a new position, which
+ * lets addressable queues keep track of where their elements are.
+ */
+namespace detail {
+
+    /**
+     * \brief Moves the element at index towards the root.
+     *
+     * \param first - beginning of the heap.
+     * \param index - position of the element.
+     * \param comp - comparator, true if the first argument leaves earlier.
+     * \param onMove - called for every element that changes its position.
+     * \return Final position of the element.
+     */
+    template <size_t Arity, typename RandomIt, typename Compare, typename OnMove>
+    size_t dAryHeapSiftUp(RandomIt first, size_t index, Compare comp, OnMove& onMove) {
+        size_t start=index;
+        auto value=std::move(first[index]);
+        while (index>0) {
+            size_t parent=(index-1)/Arity;
+            if (!comp(value, first[parent])) {
+                break;
+            }
+            first[index]=std::move(first[parent]);
+            onMove(first[index], index);
+            index=parent;
+        }
+        first[index]=std::move(value);
+        if (index!=start) {
+            onMove(first[index], index);
+        }
+        return index;
+    }
+
+    /**
+     * \brief Moves the element at index towards the leaves.
+     *
+     * \param first - beginning of the heap.
+     * \param size - number of elements in the heap.
+     * \param index - position of the element.
+     * \param comp - comparator, true if the first argument leaves earlier.
+     * \param onMove - called for every element that changes its position.
+     */
+    template <size_t Arity, typename RandomIt, typename Compare, typename OnMove>
+    void dAryHeapSiftDown(RandomIt first, size_t size, size_t index, Compare comp, OnMove& onMove) {
+        auto value=std::move(first[index]);
+        while (Arity*index+1<size) {
+            size_t child=Arity*index+1;
+            size_t best=child;
+            size_t end=child+Arity<size ? child+Arity : size;
+            for (++child; child<end; ++child) {
+                if (comp(first[child], first[best])) {
+                    best=child;
+                }
+            }
+            if (!comp(first[best], value)) {
+                break;
+            }
+            first[index]=std::move(first[best]);
+            onMove(first[index], index);
+            index=best;
+        }
+        first[index]=std::move(value);
+        onMove(first[index], index);
+    }
+
+}
+
+/**
+ * \brief Adds the element at last-1 to the heap [first, last-1).
+ *
+ * \tparam Arity Number of children of every node.
+ * \param first - beginning of the range.
+ * \param last - end of the range, the new element is at last-1.
+ * \param comp - comparator, true if the first argument leaves earlier.
+ * \param onMove - called for every element that changes its position.
+ */
+template <size_t Arity, typename RandomIt, typename Compare, typename OnMove = detail::IgnoreMove>
+void pushDAryHeap(RandomIt first, RandomIt last, Compare comp, OnMove onMove = OnMove()) {
+    if (first!=last) {
+        detail::dAryHeapSiftUp<Arity>(first, static_cast<size_t>(last-first)-1, comp, onMove);
+    }
+}
+
+/**
+ * \brief Moves the highest-priority element to last-1.
+ *
+ * Afterwards [first, last-1) is a valid heap.
+ *
+ * \tparam Arity Number of children of every node.
+ * \param first - beginning of the heap.
+ * \param last - end of the heap.
+ * \param comp - comparator, true if the first argument leaves earlier.
+ * \param onMove - called for every element that changes its position, the
+ *        removed element included.
+ */
+template <size_t Arity, typename RandomIt, typename Compare, typename OnMove = detail::IgnoreMove>
+void popDAryHeap(RandomIt first, RandomIt last, Compare comp, OnMove onMove = OnMove()) {
+    if (last-first>1) {
+        std::swap(*first, *(last-1));
+        onMove(*(last-1), static_cast<size_t>(last-first)-1);
+        detail::dAryHeapSiftDown<Arity>(first, static_cast<size_t>(last-first)-1, 0, comp, onMove);
+    }
+}
+
+/**
+ * \brief Restores the heap after the element at pos has been replaced.
+ *
+ * \tparam Arity Number of children of every node.
+ * \param first - beginning of the heap.
+ * \param last - end of the heap.
+ * \param pos - position of the replaced element.
+ * \param comp - comparator, true if the first argument leaves earlier.
+ * \param onMove - called for every element that changes its position.
+ */
+template <size_t Arity, typename RandomIt, typename Compare, typename OnMove = detail::IgnoreMove>
+void updateDAryHeap(RandomIt first, RandomIt last, RandomIt pos, Compare comp, OnMove onMove = OnMove()) {
+    auto index=static_cast<size_t>(pos-first);
+    if (detail::dAryHeapSiftUp<Arity>(first, index, comp, onMove)==index) {
+        detail::dAryHeapSiftDown<Arity>(first, static_cast<size_t>(last-first), index, comp, onMove);
+    }
+}
+
+/**
+ * \brief Rearranges the range into a d-ary heap in linear time.
+ *
+ * \tparam Arity Number of children of every node.
+ * \param first - beginning of the range.
+ * \param last - end of the range.
+ * \param comp - comparator, true if the first argument leaves earlier.
+ */
+template <size_t Arity, typename RandomIt, typename Compare>
+void makeDAryHeap(RandomIt first, RandomIt last, Compare comp) {
+    auto size=static_cast<size_t>(last-first);
+    if (size<2) {
+        return;
+    }
+    detail::IgnoreMove onMove;
+    for (size_t i=(size-2)/Arity+1; i-->0; ) {
+        detail::dAryHeapSiftDown<Arity>(first, size, i, comp, onMove);
+    }
+}
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "BasicPriorityQueue.hpp"
+
+namespace kp {
+
+/**
+ * \brief An unbounded priority queue backed by a d-ary heap.
+ *
+ * The elements are kept in a heap with Arity children per node, ordered by
+ * NodeCompare, so equal priorities still leave in insertion order. Insert
+ * and pop run in O(log n), and a queue built from a range is heapified in O(n).
+ * Arities of 4 or 8 usually beat the binary heap for large queues because
+ * the tree is shallower and children share cache lines.
+ *
+ * This is BasicPriorityQueue with DAryHeapStorage and no size limit, the same
+ * type as DAryHeapQueue.
+ *
+ * \tparam T The type of the elements in the queue.
+ * \tparam Arity Number of children of every heap node.
+ * \tparam ErrorPolicy Reaction to pop() on an empty queue.
+ * \tparam Allocator Allocator of the nodes, see BasicPriorityQueue.
+ */
+template <typename T, size_t Arity, typename ErrorPolicy = PrintErrors, typename Allocator = std::allocator<Node<T>>>
+using DAryHeapPriorityQueue=BasicPriorityQueue<T, DAryHeapStorage<Arity>, NodeCompare, Unbounded, ErrorPolicy, Allocator>;
+
+/**
+ * \brief An unbounded priority queue backed by a binary heap.
+ *
+ * \tparam T The type of the elements in the queue.
+ * \tparam ErrorPolicy Reaction to pop() on an empty queue.
+ * \tparam Allocator Allocator of the nodes, see BasicPriorityQueue.
+ */
+template <typename T, typename ErrorPolicy = PrintErrors, typename Allocator = std::allocator<Node<T>>>
+using BinaryHeapPriorityQueue=DAryHeapPriorityQueue<T, 2, ErrorPolicy, Allocator>;
+
+namespace pmr {
+
+    /**
+     * \brief DAryHeapPriorityQueue with a polymorphic allocator.
+     */
+    template <typename T, size_t Arity, typename ErrorPolicy = PrintErrors>
+    using DAryHeapPriorityQueue=kp::DAryHeapPriorityQueue<T, Arity, ErrorPolicy, std::pmr::polymorphic_allocator<Node<T>>>;
+
+    /**
+     * \brief BinaryHeapPriorityQueue with a polymorphic allocator.
+     */
+    template <typename T, typename ErrorPolicy = PrintErrors>
+    using BinaryHeapPriorityQueue=kp::DAryHeapPriorityQueue<T, 2, ErrorPolicy, std::pmr::polymorphic_allocator<Node<T>>>;
+
+}
+
+}
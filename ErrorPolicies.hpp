@@ -0,0 +1,129 @@
+#pragma once
+#include <iostream>
+#include <stdexcept>
+
+namespace kp {
+
+/**
+ * \brief Diagnostic events reported by the queues.
+ */
+enum class QueueEvent {
+    EmptyPop,
+    ElementFound,
+    ElementNotFound
+};
+
+/**
+ * \brief Error policy that reports events on the standard output.
+ *
+ * This is the default and keeps the messages the queues have always printed.
+ * Every message flushes the stream, so latency-sensitive code should pick
+ * another policy.
+ *
+ * A policy states in reportsNodes whether found() uses the node it receives.
+ * If it does not, an indexed lookup calls the overload without a node instead
+ * of searching for one.
+ */
+struct PrintErrors {
+    static constexpr bool reportsNodes=true;
+
+    /**
+     * \brief Called when pop() is used on an empty queue.
+     */
+    static void emptyPop() {
+        std::cout<<"Queue is empty"<<std::endl;
+    }
+
+    /**
+     * \brief Called when contains() finds the element.
+     * \param node - node that was found.
+     */
+    template <typename Node>
+    static void found(const Node& node) {
+        std::cout<<"Element found: "<<node<<std::endl;
+    }
+
+    /**
+     * \brief Called when contains() finds the element without locating its node.
+     */
+    static void found() {
+        std::cout<<"Element found"<<std::endl;
+    }
+
+    /**
+     * \brief Called when contains() does not find the element.
+     */
+    static void notFound() {
+        std::cout<<"Element not found"<<std::endl;
+    }
+};
+
+/**
+ * \brief Error policy that ignores all events.
+ *
+ * pop() on an empty queue returns a default-constructed value, and no code
+ * path touches iostreams.
+ */
+struct SilentErrors {
+    static constexpr bool reportsNodes=false;
+
+    static void emptyPop() {}
+
+    template <typename Node>
+    static void found(const Node&) {}
+
+    static void found() {}
+
+    static void notFound() {}
+};
+
+/**
+ * \brief Error policy that throws std::out_of_range from pop() on an empty queue.
+ *
+ * Lookups stay silent.
+ */
+struct ThrowErrors {
+    static constexpr bool reportsNodes=false;
+
+    static void emptyPop() {
+        throw std::out_of_range("Queue is empty");
+    }
+
+    template <typename Node>
+    static void found(const Node&) {}
+
+    static void found() {}
+
+    static void notFound() {}
+};
+
+/**
+ * \brief Error policy that forwards every event to a function.
+ *
+ * The function is a template argument, so the call can be inlined.
+ *
+ * \tparam Handler Function called with the event.
+ */
+template <void (*Handler)(QueueEvent)>
+struct CallbackErrors {
+    static constexpr bool reportsNodes=false;
+
+    static void emptyPop() {
+        Handler(QueueEvent::EmptyPop);
+    }
+
+    template <typename Node>
+    static void found(const Node&) {
+        Handler(QueueEvent::ElementFound);
+    }
+
+    static void found() {
+        Handler(QueueEvent::ElementFound);
+    }
+
+    static void notFound() {
+        Handler(QueueEvent::ElementNotFound);
+    }
+};
+
+}
@@ -0,0 +1,441 @@
+#pragma once
+#include "Snapshot.hpp"
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace kp {
+
+/**
+ * \brief Memory budget and I/O sizes of an ExternalPriorityQueue.
+ */
+struct ExternalOptions {
+    /**
+     * \brief Number of elements the in-memory heap holds before it spills.
+     */
+    size_t memoryElements=size_t(1)<<20;
+
+    /**
+     * \brief Number of records read from a run at once.
+     */
+    size_t blockElements=size_t(1)<<14;
+
+    /**
+     * \brief Number of runs of one level that are merged into a longer run.
+     */
+    size_t fanIn=16;
+};
+
+/**
+ * \brief Priority queue for more elements than fit in memory.
+ *
+ * A sequence heap in the spirit of Sanders' external priority queues. Inserts
+ * go to an in-memory d-ary heap of options.memoryElements nodes. When it is
+ * full, it is sorted and written to disk as one run with a single sequential
+ * write, highest priority first. Every run keeps a buffer of
+ * options.blockElements records, and pop() takes the highest of the heap top
+ * and the run heads, reading the next block of a run only when its buffer
+ * runs dry. Runs are merged lazily: once options.fanIn runs of one level
+ * exist, they are merged into one run of the next level, so every element
+ * is written and read O(log_fanIn(N/M)) times in blocks of B records, i.e.
+ * O((1/B) log_{M/B}(N/B)) I/Os per operation with fanIn near M/B.
+ *
+ * Equal priorities leave in insertion order, as in the other queues. Runs
+ * use the snapshot format of Snapshot.hpp with a run layout, so a spill
+ * file can be inspected with MappedSnapshot or loaded with loadSnapshot().
+ * Values that are not trivially copyable need a SnapshotCodec. Spill files
+ * are created in the given directory and removed once they are consumed or
+ * the queue is destroyed.
+ *
+ * \tparam T The type of the elements in the queue.
+ * \tparam ErrorPolicy Reaction to pop() on an empty queue.
+ */
+template <typename T, typename ErrorPolicy = PrintErrors>
+class ExternalPriorityQueue {
+private:
+    using Heap=DAryHeapStorage<4>;
+
+    /**
+     * \brief Sorted run on disk with a buffer of its next records.
+     */
+    struct Run {
+        std::filesystem::path path;
+        std::ifstream in;
+        SnapshotHeader header;
+        std::vector<Node<T>> buffer;
+        size_t position=0;
+        size_t unread=0;
+        size_t level=0;
+
+        ~Run() {
+            in.close();
+            std::error_code error;
+            std::filesystem::remove(path, error);
+        }
+
+        const Node<T>& head() const {
+            return buffer[position];
+        }
+
+        size_t remaining() const {
+            return buffer.size()-position+unread;
+        }
+
+        /**
+         * \brief Reads the next block of the run into the buffer.
+         * \param block - maximum number of records to read.
+         */
+        void refill(size_t block) {
+            buffer.clear();
+            position=0;
+            size_t count=std::min(block, unread);
+            detail::readSnapshotNodes<T>(in, header, buffer, count);
+            unread-=count;
+        }
+
+        /**
+         * \brief Moves past the head of the run.
+         * \param block - number of records to read if the buffer runs dry.
+         * \return False if the run is exhausted.
+         */
+        bool advance(size_t block) {
+            if (++position<buffer.size()) {
+                return true;
+            }
+            if (unread==0) {
+                return false;
+            }
+            refill(block);
+            return true;
+        }
+    };
+
+    std::filesystem::path m_directory;
+    std::string m_prefix;
+    ExternalOptions m_options;
+    std::vector<Node<T>> m_heap;
+    std::vector<std::unique_ptr<Run>> m_runs;
+    std::vector<Run*> m_heads;
+    size_t m_nextRun=0;
+    size_t m_currentId=1;
+    size_t m_size=0;
+
+    static bool compareNodes(const Node<T>& a, const Node<T>& b) {
+        return NodeCompare{}(a, b);
+    }
+
+    /**
+     * \brief Orders runs so the one whose head leaves first is on top of m_heads.
+     */
+    static bool laterHead(const Run* a, const Run* b) {
+        return compareNodes(b->head(), a->head());
+    }
+
+    /**
+     * \brief Writes a sorted run and opens it for reading.
+     *
+     * \param level - merge level of the run, 0 for a spilled heap.
+     * \param count - number of records.
+     * \param produce - called with a callable that writes a span of nodes,
+     *        must write count nodes in leave order.
+     * \return The run, positioned at its first block.
+     * \throws std::runtime_error if the file cannot be written or read.
+     */
+    template <typename Produce>
+    std::unique_ptr<Run> writeRun(size_t level, size_t count, Produce&& produce) {
+        auto run=std::make_unique<Run>();
+        run->path=m_directory/(m_prefix+std::to_string(m_nextRun++)+".run");
+        run->level=level;
+        {
+            std::ofstream out(run->path, std::ios::binary|std::ios::trunc);
+            if (!out) {
+                throw std::runtime_error("Cannot open "+run->path.string()+" for writing");
+            }
+            detail::writeSnapshotHeader<T>(out, detail::DescendingRunLayout, count, m_currentId, SIZE_MAX);
+            produce([&out](std::span<const Node<T>> nodes) {
+                detail::writeSnapshotNodes<T>(out, nodes);
+            });
+            out.close();
+            if (!out) {
+                throw std::runtime_error("Failed to write "+run->path.string());
+            }
+        }
+        run->in.open(run->path, std::ios::binary);
+        if (!run->in) {
+            throw std::runtime_error("Cannot open "+run->path.string()+" for reading");
+        }
+        run->header=detail::readSnapshotHeader<T>(run->in);
+        run->unread=static_cast<size_t>(run->header.count);
+        run->refill(m_options.blockElements);
+        return run;
+    }
+
+    /**
+     * \brief Sorts the in-memory heap and writes it as a run of level 0.
+     */
+    void spill() {
+        std::sort(m_heap.begin(), m_heap.end(), compareNodes);
+        m_runs.push_back(writeRun(0, m_heap.size(), [this](auto write) {
+            write(std::span<const Node<T>>(m_heap.data(), m_heap.size()));
+        }));
+        m_heap.clear();
+        compact();
+        rebuildHeads();
+    }
+
+    /**
+     * \brief Merges runs while a level holds fanIn of them.
+     */
+    void compact() {
+        size_t fanIn=std::max<size_t>(m_options.fanIn, 2);
+        for (size_t level=0;; ++level) {
+            std::vector<Run*> group;
+            bool higher=false;
+            for (const auto& run : m_runs) {
+                if (run->level==level) {
+                    group.push_back(run.get());
+                }
+                higher=higher || run->level>level;
+            }
+            if (group.size()>=fanIn) {
+                mergeRuns(group, level+1);
+            } else if (!higher) {
+                return;
+            }
+        }
+    }
+
+    /**
+     * \brief Replaces runs with one run holding their remaining records.
+     *
+     * \param group - runs to merge, removed afterwards.
+     * \param level - level of the merged run.
+     */
+    void mergeRuns(const std::vector<Run*>& group, size_t level) {
+        size_t total=0;
+        std::vector<Run*> heads;
+        for (Run* run : group) {
+            total+=run->remaining();
+            if (run->remaining()>0) {
+                heads.push_back(run);
+            }
+        }
+        std::make_heap(heads.begin(), heads.end(), laterHead);
+        size_t block=m_options.blockElements;
+        auto merged=writeRun(level, total, [&](auto write) {
+            std::vector<Node<T>> out;
+            out.reserve(block);
+            while (!heads.empty()) {
+                std::pop_heap(heads.begin(), heads.end(), laterHead);
+                Run* run=heads.back();
+                out.push_back(std::move(run->buffer[run->position]));
+                if (run->advance(block)) {
+                    std::push_heap(heads.begin(), heads.end(), laterHead);
+                } else {
+                    heads.pop_back();
+                }
+                if (out.size()==block) {
+                    write(std::span<const Node<T>>(out.data(), out.size()));
+                    out.clear();
+                }
+            }
+            write(std::span<const Node<T>>(out.data(), out.size()));
+        });
+        std::erase_if(m_runs, [&group](const std::unique_ptr<Run>& run) {
+            return std::find(group.begin(), group.end(), run.get())!=group.end();
+        });
+        m_runs.push_back(std::move(merged));
+    }
+
+    /**
+     * \brief Rebuilds the heap of run heads after the runs changed.
+     */
+    void rebuildHeads() {
+        m_heads.clear();
+        for (const auto& run : m_runs) {
+            if (run->remaining()>0) {
+                m_heads.push_back(run.get());
+            }
+        }
+        std::make_heap(m_heads.begin(), m_heads.end(), laterHead);
+    }
+
+    /**
+     * \brief Removes the element that leaves first.
+     * \return Its value, the queue must not be empty.
+     */
+    T takeHighest() {
+        --m_size;
+        if (m_heads.empty() || (!m_heap.empty() && compareNodes(m_heap.front(), m_heads.front()->head()))) {
+            Heap::popHighest(m_heap, compareNodes);
+            T value=m_heap.back().takeValue();
+            m_heap.pop_back();
+            return value;
+        }
+        std::pop_heap(m_heads.begin(), m_heads.end(), laterHead);
+        Run* run=m_heads.back();
+        T value=run->buffer[run->position].takeValue();
+        if (run->advance(m_options.blockElements)) {
+            std::push_heap(m_heads.begin(), m_heads.end(), laterHead);
+        } else {
+            m_heads.pop_back();
+            std::erase_if(m_runs, [run](const std::unique_ptr<Run>& owned) {
+                return owned.get()==run;
+            });
+        }
+        return value;
+    }
+
+public:
+    /**
+     * \brief Parameterized constructor.
+     *
+     * \param directory - existing directory for the spill files, ideally on
+     *        a disk with room for the whole queue.
+     * \param options - memory budget, block size and merge fan-in.
+     * \throws std::invalid_argument if the directory does not exist.
+     */
+    explicit ExternalPriorityQueue(std::filesystem::path directory, ExternalOptions options = ExternalOptions())
+        : m_directory(std::move(directory)), m_options(options) {
+        if (!std::filesystem::is_directory(m_directory)) {
+            throw std::invalid_argument("Spill directory does not exist: "+m_directory.string());
+        }
+        m_options.memoryElements=std::max<size_t>(m_options.memoryElements, 1);
+        m_options.blockElements=std::max<size_t>(m_options.blockElements, 1);
+        m_prefix="kpq-"+std::to_string(std::random_device{}())+"-"+std::to_string(reinterpret_cast<uintptr_t>(this))+"-";
+        m_heap.reserve(detail::upfrontCapacity(m_options.memoryElements));
+    }
+
+    /**
+     * \brief Move operations, the spill files move with the queue.
+     */
+    ExternalPriorityQueue(ExternalPriorityQueue&&)=default;
+    ExternalPriorityQueue& operator=(ExternalPriorityQueue&&)=default;
+
+    ExternalPriorityQueue(const ExternalPriorityQueue&)=delete;
+    ExternalPriorityQueue& operator=(const ExternalPriorityQueue&)=delete;
+
+    /**
+     * \brief Inserts a new element into the queue.
+     *
+     * O(log M) in memory, plus a spill of the heap every M inserts.
+     *
+     * \param priority - priority of the element.
+     * \param value - value of the element.
+     * \throws std::runtime_error if a spill file cannot be written.
+     */
+    void insert(int priority, const T& value) {
+        emplace(priority, value);
+    }
+
+    /**
+     * \brief Inserts a new element into the queue by moving it.
+     * \param priority - priority of the element.
+     * \param value - value of the element.
+     * \throws std::runtime_error if a spill file cannot be written.
+     */
+    void insert(int priority, T&& value) {
+        emplace(priority, std::move(value));
+    }
+
+    /**
+     * \brief Constructs a new element directly in the queue.
+     * \param priority - priority of the element.
+     * \param args - arguments forwarded to the constructor of the value.
+     * \throws std::runtime_error if a spill file cannot be written.
+     */
+    template <typename... Args>
+    void emplace(int priority, Args&&... args) {
+        if (m_heap.size()>=m_options.memoryElements) {
+            spill();
+        }
+        m_heap.emplace_back(priority, m_currentId++, std::in_place, std::forward<Args>(args)...);
+        Heap::push(m_heap, compareNodes);
+        ++m_size;
+    }
+
+    /**
+     * \brief Removes and returns the element with the highest priority.
+     *
+     * If the queue is empty, the error policy is notified and, unless it
+     * throws, the default element value is returned.
+     *
+     * \return The element with the highest priority.
+     * \throws std::runtime_error if a spill file cannot be read.
+     */
+    T pop() {
+        if (m_size==0) {
+            ErrorPolicy::emptyPop();
+            return T();
+        }
+        return takeHighest();
+    }
+
+    /**
+     * \brief Removes and returns the element with the highest priority, if any.
+     * \return The element with the highest priority, or std::nullopt.
+     */
+    std::optional<T> tryPop() {
+        if (m_size==0) {
+            return std::nullopt;
+        }
+        return takeHighest();
+    }
+
+    /**
+     * \brief Removes up to n highest-priority elements.
+     * \param n - maximum number of elements to remove.
+     * \param out - output iterator receiving the values, highest first.
+     * \return Output iterator past the last written value.
+     */
+    template <typename OutputIt>
+    OutputIt popN(size_t n, OutputIt out) {
+        for (size_t count=std::min(n, m_size); count>0; --count) {
+            *out++=takeHighest();
+        }
+        return out;
+    }
+
+    /**
+     * \brief Checks if the queue is empty.
+     * \return True if the queue is empty, false otherwise.
+     */
+    bool isEmpty() const {
+        return m_size==0;
+    }
+
+    /**
+     * \brief Gets the size of the queue.
+     * \return Number of elements in memory and on disk.
+     */
+    size_t size() const {
+        return m_size;
+    }
+
+    /**
+     * \brief Gets the number of elements held in memory.
+     * \return Elements of the heap and of the run buffers.
+     */
+    size_t memorySize() const {
+        size_t count=m_heap.size();
+        for (const auto& run : m_runs) {
+            count+=run->buffer.size()-run->position;
+        }
+        return count;
+    }
+
+    /**
+     * \brief Gets the number of sorted runs on disk.
+     * \return Number of spill files.
+     */
+    size_t runCount() const {
+        return m_runs.size();
+    }
+};
+
+}
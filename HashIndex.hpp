@@ -0,0 +1,242 @@
+#pragma once
+#include "PriorityQueue.hpp"
+#include "MoveTracking.hpp"
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace kp {
+
+/**
+ * \brief Index policy of a queue without a lookup index.
+ *
+ * Lookups scan the queue linearly and nothing has to be kept in sync.
+ */
+struct NoIndex {
+    static constexpr bool enabled=false;
+
+    template <typename Node>
+    void add(const Node&, size_t) {}
+
+    template <typename Node>
+    void remove(const Node&) {}
+
+    template <typename Container>
+    void rebuild(const Container&) {}
+
+    template <typename Container>
+    void reindex(const Container&) {}
+
+    detail::IgnoreMove tracker() {
+        return {};
+    }
+
+    size_t memoryUsage() const {
+        return 0;
+    }
+};
+
+/**
+ * \brief Index policy that maps every queued (priority, value) to its nodes.
+ *
+ * Every key keeps the identifiers of its nodes in ascending order, and every
+ * identifier keeps the current position of its node. The queue passes
+ * tracker() to the storage policy, so the positions follow every element the
+ * storage moves, and calls reindex() after reordering the whole container.
+ * contains(), count() and find() are then O(1) on average plus the number of
+ * duplicates of the key; each insert, pop or eviction pays one hash update per
+ * element the storage moves. The index keeps its own copy of every distinct
+ * value, so T has to be copyable and hashable.
+ *
+ * \tparam T The type of the elements in the queue.
+ * \tparam Hash Hash function of the values.
+ */
+template <typename T, typename Hash = std::hash<T>>
+class HashIndex {
+private:
+    struct Key {
+        int priority;
+        T value;
+    };
+
+    struct KeyRef {
+        int priority;
+        const T* value;
+    };
+
+    struct KeyHash {
+        using is_transparent=void;
+
+        size_t combine(int priority, const T& value) const {
+            size_t seed=Hash{}(value);
+            return seed ^ (std::hash<int>{}(priority)+0x9e3779b97f4a7c15ULL+(seed<<6)+(seed>>2));
+        }
+
+        size_t operator()(const Key& key) const {
+            return combine(key.priority, key.value);
+        }
+
+        size_t operator()(const KeyRef& key) const {
+            return combine(key.priority, *key.value);
+        }
+    };
+
+    struct KeyEqual {
+        using is_transparent=void;
+
+        bool operator()(const Key& a, const Key& b) const {
+            return a.priority==b.priority && a.value==b.value;
+        }
+
+        bool operator()(const KeyRef& a, const Key& b) const {
+            return a.priority==b.priority && *a.value==b.value;
+        }
+
+        bool operator()(const Key& a, const KeyRef& b) const {
+            return a.priority==b.priority && a.value==*b.value;
+        }
+    };
+
+    std::unordered_map<Key, std::vector<size_t>, KeyHash, KeyEqual> m_ids;
+    std::unordered_map<size_t, size_t> m_positions;
+
+    /**
+     * \brief Callback that records where the storage moved an element.
+     */
+    struct Tracker {
+        HashIndex* index;
+
+        void operator()(const Node<T>& node, size_t position) const {
+            index->m_positions[node.getId()]=position;
+        }
+    };
+
+public:
+    static constexpr bool enabled=true;
+
+    /**
+     * \brief Records a node that entered the queue.
+     * \param node - node that was added.
+     * \param position - current position of the node in the container.
+     */
+    void add(const Node<T>& node, size_t position) {
+        auto it=m_ids.find(KeyRef{node.getPriority(), &node.getValue()});
+        if (it==m_ids.end()) {
+            it=m_ids.emplace(Key{node.getPriority(), node.getValue()}, std::vector<size_t>()).first;
+        }
+        auto& ids=it->second;
+        ids.insert(std::upper_bound(ids.begin(), ids.end(), node.getId()), node.getId());
+        m_positions[node.getId()]=position;
+    }
+
+    /**
+     * \brief Records a node that left the queue.
+     * \param node - node that was removed, its value must still be intact.
+     */
+    void remove(const Node<T>& node) {
+        auto it=m_ids.find(KeyRef{node.getPriority(), &node.getValue()});
+        if (it==m_ids.end()) {
+            return;
+        }
+        auto& ids=it->second;
+        auto id=std::lower_bound(ids.begin(), ids.end(), node.getId());
+        if (id!=ids.end() && *id==node.getId()) {
+            ids.erase(id);
+            m_positions.erase(node.getId());
+        }
+        if (ids.empty()) {
+            m_ids.erase(it);
+        }
+    }
+
+    /**
+     * \brief Replaces the contents of the index with the given nodes.
+     * \param queue - all nodes of the queue.
+     */
+    template <typename Container>
+    void rebuild(const Container& queue) {
+        m_ids.clear();
+        m_positions.clear();
+        for (size_t i=0; i<queue.size(); ++i) {
+            add(queue[i], i);
+        }
+    }
+
+    /**
+     * \brief Updates the positions after the whole container was reordered.
+     *
+     * The keys stay as they are, so this costs one hash update per node.
+     *
+     * \param queue - all nodes of the queue, the same set as before.
+     */
+    template <typename Container>
+    void reindex(const Container& queue) {
+        for (size_t i=0; i<queue.size(); ++i) {
+            m_positions[queue[i].getId()]=i;
+        }
+    }
+
+    /**
+     * \brief Gets the onMove callback for the storage policy.
+     * \return Callback that updates the position of every moved node.
+     */
+    Tracker tracker() {
+        return Tracker{this};
+    }
+
+    /**
+     * \brief Counts the queued elements with the given priority and value.
+     *
+     * O(1) on average.
+     *
+     * \param priority - priority of the element.
+     * \param value - value of the element.
+     * \return Number of matching elements.
+     */
+    size_t count(int priority, const T& value) const {
+        auto it=m_ids.find(KeyRef{priority, &value});
+        return it==m_ids.end() ? 0 : it->second.size();
+    }
+
+    /**
+     * \brief Finds the queued node with the given priority and value that leaves first.
+     *
+     * All matches have the same priority, so the one with the smallest
+     * identifier leaves first. O(1) on average, no scan.
+     *
+     * \param queue - all nodes of the queue, kept in sync with the index.
+     * \param priority - priority of the element.
+     * \param value - value of the element.
+     * \return Pointer to the matching node, or nullptr if there is none.
+     */
+    template <typename Container>
+    const Node<T>* find(const Container& queue, int priority, const T& value) const {
+        auto it=m_ids.find(KeyRef{priority, &value});
+        if (it==m_ids.end()) {
+            return nullptr;
+        }
+        return &queue[m_positions.at(it->second.front())];
+    }
+
+    /**
+     * \brief Estimates the memory used by the index.
+     *
+     * Counts the bucket arrays, one hash node per distinct key and per queued
+     * node, and the identifier lists of the keys. Memory that T itself
+     * allocates, such as the buffer of a long string, is not included.
+     *
+     * \return Approximate size of the index in bytes.
+     */
+    size_t memoryUsage() const {
+        size_t perKey=sizeof(typename decltype(m_ids)::value_type)+2*sizeof(void*);
+        size_t perNode=sizeof(typename decltype(m_positions)::value_type)+2*sizeof(void*);
+        size_t lists=0;
+        for (const auto& [key, ids] : m_ids) {
+            lists+=ids.capacity()*sizeof(size_t);
+        }
+        return (m_ids.bucket_count()+m_positions.bucket_count())*sizeof(void*)+m_ids.size()*perKey+m_positions.size()*perNode+lists;
+    }
+};
+
+}
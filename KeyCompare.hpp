@@ -0,0 +1,132 @@
+#pragma once
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+
+namespace kp {
+
+namespace detail {
+
+    /**
+     * \brief Checks if a key type is a floating-point type with a total-order encoding.
+     */
+    template <typename Key>
+    inline constexpr bool hasTotalOrderKey=(std::is_same_v<Key, float> && sizeof(float)==4) || (std::is_same_v<Key, double> && sizeof(double)==8);
+
+    /**
+     * \brief Maps a floating-point key to an unsigned integer in IEEE 754 totalOrder.
+     *
+     * The sign bit is flipped for positive keys and all bits for negative
+     * ones, which orders them -NaN, -inf, ..., -0.0, +0.0, ..., +inf, +NaN.
+     * Every key then has a place, so NaN scores cannot break the layout of
+     * a heap.
+     *
+     * \param key - key to encode.
+     * \return Unsigned encoding of the key.
+     */
+    template <typename Key>
+    constexpr auto totalOrderKey(Key key) {
+        using Bits=std::conditional_t<sizeof(Key)==4, uint32_t, uint64_t>;
+        using SignedBits=std::make_signed_t<Bits>;
+        constexpr Bits SignBit=Bits(1)<<(sizeof(Key)*8-1);
+        Bits bits=std::bit_cast<Bits>(key);
+        Bits mask=static_cast<Bits>(std::bit_cast<SignedBits>(bits)>>(sizeof(Key)*8-1))|SignBit;
+        return static_cast<Bits>(bits^mask);
+    }
+
+    template <typename Compare, typename Key>
+    inline constexpr bool isGreater=std::is_same_v<Compare, std::greater<>> || std::is_same_v<Compare, std::greater<Key>>;
+
+    template <typename Compare, typename Key>
+    inline constexpr bool isLess=std::is_same_v<Compare, std::less<>> || std::is_same_v<Compare, std::less<Key>>;
+
+}
+
+/**
+ * \brief Ordering of nodes by a key of any type.
+ *
+ * The compare policy for BasicPriorityQueue when priorities are not int, for
+ * example 64-bit timestamps or float scores. Compare(a, b) is true if a key a
+ * leaves the queue before b, so std::greater<> serves the highest key first
+ * and std::less<> the lowest. Equal keys leave in insertion order.
+ *
+ * Float and double keys ordered by std::greater or std::less are compared
+ * in IEEE 754 totalOrder, through an unsigned encoding of both keys, so NaN
+ * and -0.0 get a fixed place instead of breaking the heap. The encoding
+ * costs a few instructions per comparison; keys known to be free of NaN can
+ * skip it with a comparator of their own. The nodes are stored the same way
+ * for every key type. Other keys and comparators, integers included, are
+ * compared as they are and must form a strict weak ordering.
+ *
+ * If Stable is false, the queue stores no identifiers and equal keys leave
+ * in no particular order, which saves 8 bytes per node and the tie-break.
+ *
+ * \tparam Key The type of the priorities.
+ * \tparam Compare Ordering of the keys, std::greater<> by default.
+ * \tparam Stable Whether equal keys leave in insertion order.
+ */
+template <typename Key, typename Compare = std::greater<>, bool Stable = true>
+struct KeyCompare {
+    using KeyType=Key;
+    static constexpr bool stable=Stable;
+
+    [[no_unique_address]] Compare compare;
+
+    /**
+     * \brief Compares the keys of two elements.
+     *
+     * \param priorityA - priority of the first element.
+     * \param idA - identifier of the first element.
+     * \param priorityB - priority of the second element.
+     * \param idB - identifier of the second element.
+     * \return True if the first element leaves the queue before the second.
+     */
+    constexpr bool before(const Key& priorityA, size_t idA, const Key& priorityB, size_t idB) const {
+        if constexpr (detail::hasTotalOrderKey<Key> && (detail::isGreater<Compare, Key> || detail::isLess<Compare, Key>)) {
+            auto a=detail::totalOrderKey(priorityA);
+            auto b=detail::totalOrderKey(priorityB);
+            if constexpr (Stable) {
+                if (a==b) {
+                    return idA<idB;
+                }
+            }
+            return detail::isGreater<Compare, Key> ? a>b : a<b;
+        } else {
+            if (compare(priorityA, priorityB)) {
+                return true;
+            }
+            if constexpr (Stable) {
+                return !compare(priorityB, priorityA) && idA<idB;
+            } else {
+                return false;
+            }
+        }
+    }
+
+    /**
+     * \brief Compares two nodes.
+     * \param a - first node.
+     * \param b - second node.
+     * \return True if the first node leaves the queue before the second.
+     */
+    template <typename N>
+    bool operator()(const N& a, const N& b) const {
+        return before(a.getPriority(), a.getId(), b.getPriority(), b.getId());
+    }
+};
+
+/**
+ * \brief Ordering without the insertion-order tie-break.
+ *
+ * Queues using it drop the node identifiers, e.g.
+ * BasicPriorityQueue<int, DAryHeapStorage<4>, UnstableCompare<>>.
+ *
+ * \tparam Key The type of the priorities, int by default.
+ * \tparam Compare Ordering of the keys, std::greater<> by default.
+ */
+template <typename Key = int, typename Compare = std::greater<>>
+using UnstableCompare=KeyCompare<Key, Compare, false>;
+
+}
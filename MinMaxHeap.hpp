@@ -0,0 +1,268 @@
+#pragma once
+#include "MoveTracking.hpp"
+#include <cstddef>
+#include <iterator>
+#include <utility>
+
+namespace kp {
+
+/*
+ * Algorithms that maintain a min-max heap over a random-access range.
+ *
+ * The comparator follows the convention of NodeCompare:
+ * comp(a, b) is true when a must leave the queue before b. Elements on even
+ * levels (starting with the root) come before all of their descendants and
+ * elements on odd levels come after all of their descendants. The element
+ * that leaves first is therefore always at the front of the range and the
+ * element that leaves last is one of its two children.
+ *
+ * The functions mirror std::push_heap / std::pop_heap: push expects the new
+ * element at the end of the range, and the pop functions move the removed
+ * element to the end of the range so that the caller can pop_back() it.
+ *
+ * Every function optionally takes an onMove callback that is called as
+ * onMove(element, index) whenever an element lands on a new position.
+ */
+namespace detail {
+
+    /**
+     * \brief Checks if the given index lies on an even level of the heap.
+     * \param index - position in the heap.
+     * \return True for even levels (the root included), false for odd levels.
+     */
+    inline bool isFirstLevel(size_t index) {
+        size_t level=0;
+        for (size_t n=index+1; n>1; n>>=1) {
+            ++level;
+        }
+        return (level & 1)==0;
+    }
+
+    /**
+     * \brief Swaps two elements of the heap and reports both new positions.
+     *
+     * \param first - beginning of the heap.
+     * \param a - position of the first element.
+     * \param b - position of the second element.
+     * \param onMove - called for both swapped elements.
+     */
+    template <typename RandomIt, typename OnMove>
+    void minMaxSwap(RandomIt first, size_t a, size_t b, OnMove& onMove) {
+        std::iter_swap(first+a, first+b);
+        onMove(first[a], a);
+        onMove(first[b], b);
+    }
+
+    /**
+     * \brief Moves the element at index up along its grandparents.
+     *
+     * \param first - beginning of the heap.
+     * \param index - position of the element.
+     * \param before - ordering used on the level of index.
+     * \param onMove - called for every element that changes its position.
+     * \return Final position of the element.
+     */
+    template <typename RandomIt, typename Before, typename OnMove>
+    size_t minMaxBubbleUp(RandomIt first, size_t index, Before before, OnMove& onMove) {
+        while (index>2) {
+            size_t grandparent=((index-1)/2-1)/2;
+            if (!before(first[index], first[grandparent])) {
+                break;
+            }
+            minMaxSwap(first, index, grandparent, onMove);
+            index=grandparent;
+        }
+        return index;
+    }
+
+    /**
+     * \brief Moves the element at index down until its subtree is a valid heap.
+     *
+     * \param first - beginning of the heap.
+     * \param size - number of elements in the heap.
+     * \param index - position of the element.
+     * \param before - ordering used on the level of index.
+     * \param onMove - called for every element that changes its position.
+     */
+    template <typename RandomIt, typename Before, typename OnMove>
+    void minMaxTrickleDown(RandomIt first, size_t size, size_t index, Before before, OnMove& onMove) {
+        while (2*index+1<size) {
+            size_t best=2*index+1;
+            size_t candidates[]={2*index+2, 4*index+3, 4*index+4, 4*index+5, 4*index+6};
+            for (size_t candidate : candidates) {
+                if (candidate<size && before(first[candidate], first[best])) {
+                    best=candidate;
+                }
+            }
+            if (!before(first[best], first[index])) {
+                break;
+            }
+            minMaxSwap(first, index, best, onMove);
+            if (best<=2*index+2) {
+                break;
+            }
+            size_t parent=(best-1)/2;
+            if (before(first[parent], first[best])) {
+                minMaxSwap(first, best, parent, onMove);
+            }
+            index=best;
+        }
+    }
+
+    /**
+     * \brief Restores the heap after the element at index has been changed.
+     *
+     * \param first - beginning of the heap.
+     * \param size - number of elements in the heap.
+     * \param index - position of the changed element.
+     * \param comp - comparator, true if the first argument leaves earlier.
+     * \param onMove - called for every element that changes its position.
+     */
+    template <typename RandomIt, typename Compare, typename OnMove>
+    void minMaxSift(RandomIt first, size_t size, size_t index, Compare comp, OnMove& onMove) {
+        auto earlier=[&comp](const auto& a, const auto& b) { return comp(a, b); };
+        auto later=[&comp](const auto& a, const auto& b) { return comp(b, a); };
+        bool firstLevel=isFirstLevel(index);
+
+        if (index>0) {
+            size_t parent=(index-1)/2;
+            bool violates=firstLevel ? comp(first[parent], first[index]) : comp(first[index], first[parent]);
+            if (violates) {
+                minMaxSwap(first, index, parent, onMove);
+                if (firstLevel) {
+                    minMaxBubbleUp(first, parent, later, onMove);
+                    minMaxTrickleDown(first, size, index, earlier, onMove);
+                } else {
+                    minMaxBubbleUp(first, parent, earlier, onMove);
+                    minMaxTrickleDown(first, size, index, later, onMove);
+                }
+                return;
+            }
+        }
+
+        size_t moved=firstLevel ? minMaxBubbleUp(first, index, earlier, onMove) : minMaxBubbleUp(first, index, later, onMove);
+        if (moved!=index) {
+            return;
+        }
+        if (firstLevel) {
+            minMaxTrickleDown(first, size, index, earlier, onMove);
+        } else {
+            minMaxTrickleDown(first, size, index, later, onMove);
+        }
+    }
+
+}
+
+/**
+ * \brief Returns the position of the element that leaves the heap last.
+ *
+ * \param first - beginning of the heap.
+ * \param last - end of the heap.
+ * \param comp - comparator, true if the first argument leaves earlier.
+ * \return Iterator to the lowest-priority element, or last if the heap is empty.
+ */
+template <typename RandomIt, typename Compare>
+RandomIt minMaxHeapLowest(RandomIt first, RandomIt last, Compare comp) {
+    auto size=static_cast<size_t>(last-first);
+    if (size<=1) {
+        return size==0 ? last : first;
+    }
+    if (size==2 || comp(first[2], first[1])) {
+        return first+1;
+    }
+    return first+2;
+}
+
+/**
+ * \brief Restores the heap after the element at pos has been replaced.
+ *
+ * \param first - beginning of the heap.
+ * \param last - end of the heap.
+ * \param pos - position of the replaced element.
+ * \param comp - comparator, true if the first argument leaves earlier.
+ * \param onMove - called for every element that changes its position.
+ */
+template <typename RandomIt, typename Compare, typename OnMove = detail::IgnoreMove>
+void updateMinMaxHeap(RandomIt first, RandomIt last, RandomIt pos, Compare comp, OnMove onMove = OnMove()) {
+    detail::minMaxSift(first, static_cast<size_t>(last-first), static_cast<size_t>(pos-first), comp, onMove);
+}
+
+/**
+ * \brief Adds the element at last-1 to the heap [first, last-1).
+ *
+ * \param first - beginning of the range.
+ * \param last - end of the range, the new element is at last-1.
+ * \param comp - comparator, true if the first argument leaves earlier.
+ * \param onMove - called for every element that changes its position.
+ */
+template <typename RandomIt, typename Compare, typename OnMove = detail::IgnoreMove>
+void pushMinMaxHeap(RandomIt first, RandomIt last, Compare comp, OnMove onMove = OnMove()) {
+    if (first!=last) {
+        detail::minMaxSift(first, static_cast<size_t>(last-first), static_cast<size_t>(last-first)-1, comp, onMove);
+    }
+}
+
+/**
+ * \brief Moves the highest-priority element to last-1.
+ *
+ * Afterwards [first, last-1) is a valid heap.
+ *
+ * \param first - beginning of the heap.
+ * \param last - end of the heap.
+ * \param comp - comparator, true if the first argument leaves earlier.
+ * \param onMove - called for every element that changes its position, the
+ *        removed element included.
+ */
+template <typename RandomIt, typename Compare, typename OnMove = detail::IgnoreMove>
+void popMinMaxHeapHighest(RandomIt first, RandomIt last, Compare comp, OnMove onMove = OnMove()) {
+    if (last-first>1) {
+        auto size=static_cast<size_t>(last-first)-1;
+        detail::minMaxSwap(first, 0, size, onMove);
+        detail::minMaxSift(first, size, 0, comp, onMove);
+    }
+}
+
+/**
+ * \brief Moves the lowest-priority element to last-1.
+ *
+ * Afterwards [first, last-1) is a valid heap.
+ *
+ * \param first - beginning of the heap.
+ * \param last - end of the heap.
+ * \param comp - comparator, true if the first argument leaves earlier.
+ * \param onMove - called for every element that changes its position, the
+ *        removed element included.
+ */
+template <typename RandomIt, typename Compare, typename OnMove = detail::IgnoreMove>
+void popMinMaxHeapLowest(RandomIt first, RandomIt last, Compare comp, OnMove onMove = OnMove()) {
+    RandomIt lowest=minMaxHeapLowest(first, last, comp);
+    if (last-first>1 && lowest!=last-1) {
+        auto size=static_cast<size_t>(last-first)-1;
+        detail::minMaxSwap(first, static_cast<size_t>(lowest-first), size, onMove);
+        detail::minMaxSift(first, size, static_cast<size_t>(lowest-first), comp, onMove);
+    }
+}
+
+/**
+ * \brief Rearranges the range into a min-max heap in linear time.
+ *
+ * \param first - beginning of the range.
+ * \param last - end of the range.
+ * \param comp - comparator, true if the first argument leaves earlier.
+ */
+template <typename RandomIt, typename Compare>
+void makeMinMaxHeap(RandomIt first, RandomIt last, Compare comp) {
+    auto size=static_cast<size_t>(last-first);
+    auto earlier=[&comp](const auto& a, const auto& b) { return comp(a, b); };
+    auto later=[&comp](const auto& a, const auto& b) { return comp(b, a); };
+    detail::IgnoreMove onMove;
+    for (size_t i=size/2; i-->0; ) {
+        if (detail::isFirstLevel(i)) {
+            detail::minMaxTrickleDown(first, size, i, earlier, onMove);
+        } else {
+            detail::minMaxTrickleDown(first, size, i, later, onMove);
+        }
+    }
+}
+
+}
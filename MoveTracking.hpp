@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+
+namespace kp {
+
+namespace detail {
+
+    /**
+     * \brief Default onMove callback of the heap algorithms, does nothing.
+     *
+     * The heap functions call onMove(element, index) whenever an element
+     * lands on a new position, which lets addressable queues and lookup
+     * indexes keep track of where their elements are. Without a callback the
+     * calls compile to nothing.
+     */
+    struct IgnoreMove {
+        template <typename Element>
+        void operator()(const Element&, size_t) const {}
+    };
+
+}
+
+}
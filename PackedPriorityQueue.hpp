@@ -0,0 +1,378 @@
+#pragma once
+#include "PriorityQueue.hpp"
+#include "StoragePolicies.hpp"
+#include "ErrorPolicies.hpp"
+#include "BasicPriorityQueue.hpp"
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+
+namespace kp {
+
+/**
+ * \brief Packed ordering key of an element in a PackedPriorityQueue.
+ *
+ * Holds the priority, the identifier and the slot of the value in the value
+ * pool. With int priorities that is 16 bytes, so four keys share one cache
+ * line whatever the size of T; 64-bit priorities take 24 bytes, and unstable
+ * keys drop the identifier.
+ *
+ * \tparam Key The type of the priority, int by default.
+ * \tparam Stable If false, the identifier is not stored and getId() returns 0.
+ */
+template <typename Key = int, bool Stable = true>
+class PackedKey {
+private:
+    Key m_priority;
+    uint32_t m_slot;
+    [[no_unique_address]] detail::NodeId<Stable> m_id;
+
+public:
+    PackedKey()=default;
+
+    /**
+     * \brief Parametric constructor.
+     *
+     * \param priority - priority of the element.
+     * \param id - unique identifier of the element.
+     * \param slot - position of the value in the value pool.
+     */
+    PackedKey(Key priority, size_t id, uint32_t slot) : m_priority(priority), m_slot(slot), m_id(id) {}
+
+    Key getPriority() const {
+        return m_priority;
+    }
+
+    size_t getId() const {
+        return m_id.get();
+    }
+
+    uint32_t getSlot() const {
+        return m_slot;
+    }
+};
+
+/**
+ * \brief Priority queue with a structure-of-arrays layout.
+ *
+ * Node keeps priority, value and identifier side by side, so every comparison
+ * drags the value through the cache as well. This queue orders compact
+ * PackedKey entries instead and keeps the values in a separate pool, which
+ * heap sifts, sorting and threshold checks never touch. A value is moved only
+ * twice: into the pool on insert and out of it on pop. Freed pool slots are
+ * reused by later inserts.
+ *
+ * The policies have the same meaning as for BasicPriorityQueue, and the
+ * compare policy fixes the type of the priorities the same way, so
+ * KeyCompare<double> ranks float scores and KeyCompare<int64_t> timestamps
+ * without converting them. The pool is indexed with 32 bits, so a queue holds
+ * at most 2^32 - 1 elements; inserts beyond that throw std::length_error.
+ *
+ * BasicPriorityQueue does not switch to this layout by itself, although its
+ * priorities are always arithmetic: it hands out Node objects through
+ * nodes(), topK(), find(), its iterators, snapshots and PriorityQueueAdapter,
+ * and a packed queue has no such nodes. Pick this class where the values are
+ * large and only insert, pop and the top are needed.
+ *
+ * \tparam T The type of the elements in the queue.
+ * \tparam StoragePolicy Layout of the keys.
+ * \tparam CapacityPolicy Unbounded or Bounded.
+ * \tparam ErrorPolicy Reaction to pop() on an empty queue.
+ * \tparam ComparePolicy Ordering of the keys, NodeCompare by default, see
+ *         BasicPriorityQueue.
+ */
+template <typename T, typename StoragePolicy = DAryHeapStorage<4>, typename CapacityPolicy = Unbounded, typename ErrorPolicy = PrintErrors, typename ComparePolicy = NodeCompare>
+class PackedPriorityQueue : public CapacityPolicy {
+public:
+    using Key=detail::KeyTypeOfT<ComparePolicy>;
+    using KeyType=PackedKey<Key, detail::isStableV<ComparePolicy>>;
+
+private:
+    std::vector<KeyType> m_keys;
+    std::vector<T> m_values;
+    std::vector<uint32_t> m_freeSlots;
+    size_t m_currentId=1;
+    ComparePolicy m_compare;
+
+    /**
+     * \brief Replaces the value held by a pool slot.
+     *
+     * The old value is destroyed and the new one is constructed in its place
+     * if its constructor cannot throw. Otherwise the value is built first, so
+     * that a throwing constructor leaves the slot untouched.
+     *
+     * \param slot - slot to overwrite.
+     * \param args - arguments forwarded to the constructor of the value.
+     */
+    template <typename... Args>
+    void replaceValue(uint32_t slot, Args&&... args) {
+        T* target=&m_values[slot];
+        if constexpr (std::is_nothrow_constructible_v<T, Args&&...>) {
+            std::destroy_at(target);
+            std::construct_at(target, std::forward<Args>(args)...);
+        } else if constexpr (std::is_nothrow_move_constructible_v<T>) {
+            T value(std::forward<Args>(args)...);
+            std::destroy_at(target);
+            std::construct_at(target, std::move(value));
+        } else {
+            *target=T(std::forward<Args>(args)...);
+        }
+    }
+
+    /**
+     * \brief Stores a value in the pool.
+     * \param args - arguments forwarded to the constructor of the value.
+     * \return Slot that now holds the value.
+     * \throws std::length_error if the pool already holds 2^32 - 1 values.
+     */
+    template <typename... Args>
+    uint32_t storeValue(Args&&... args) {
+        if (m_freeSlots.empty()) {
+            if (m_values.size()>=UINT32_MAX) {
+                throw std::length_error("PackedPriorityQueue holds at most 2^32 - 1 values");
+            }
+            m_values.emplace_back(std::forward<Args>(args)...);
+            return static_cast<uint32_t>(m_values.size()-1);
+        }
+        uint32_t slot=m_freeSlots.back();
+        replaceValue(slot, std::forward<Args>(args)...);
+        m_freeSlots.pop_back();
+        return slot;
+    }
+
+    /**
+     * \brief Removes the key at the back and moves its value out of the pool.
+     * \return Value of the removed element.
+     */
+    T takeBack() {
+        uint32_t slot=m_keys.back().getSlot();
+        m_keys.pop_back();
+        T value=std::move(m_values[slot]);
+        if (slot+1==m_values.size()) {
+            m_values.pop_back();
+        } else {
+            m_freeSlots.push_back(slot);
+        }
+        return value;
+    }
+
+public:
+    /**
+     * \brief Default constructor.
+     *
+     * Creates an empty queue with the default capacity.
+     */
+    PackedPriorityQueue()=default;
+
+    /**
+     * \brief Parameterized constructor.
+     *
+     * \param capacity - capacity policy, e.g. the maximum size.
+     * \param compare - ordering of the keys.
+     */
+    PackedPriorityQueue(CapacityPolicy capacity, ComparePolicy compare = ComparePolicy()) : CapacityPolicy(capacity), m_compare(compare) {}
+
+    /**
+     * \brief Inserts a new element into the queue.
+     * \param priority - priority of the element.
+     * \param value - value of the element.
+     */
+    void insert(Key priority, const T& value) {
+        tryEmplace(priority, value);
+    }
+
+    /**
+     * \brief Inserts a new element into the queue by moving it.
+     * \param priority - priority of the element.
+     * \param value - value of the element.
+     */
+    void insert(Key priority, T&& value) {
+        tryEmplace(priority, std::move(value));
+    }
+
+    /**
+     * \brief Constructs a new element in the value pool, see tryEmplace().
+     * \param priority - priority of the element.
+     * \param args - arguments forwarded to the constructor of the value.
+     */
+    template <typename... Args>
+    void emplace(Key priority, Args&&... args) {
+        tryEmplace(priority, std::forward<Args>(args)...);
+    }
+
+    /**
+     * \brief Constructs a new element and reports what happened.
+     *
+     * A full bounded queue decides on the keys alone and only then builds
+     * the value in the slot of the evicted element, directly if its
+     * constructor cannot throw.
+     *
+     * \param priority - priority of the element.
+     * \param args - arguments forwarded to the constructor of the value.
+     * \return Inserted, Evicted or Rejected.
+     * \throws std::length_error if the value pool is full.
+     */
+    template <typename... Args>
+    InsertResult tryEmplace(Key priority, Args&&... args) {
+        if constexpr (CapacityPolicy::bounded) {
+            if (m_keys.size()>=this->getMaxSize()) {
+                if (!wouldAccept(priority)) {
+                    return InsertResult::Rejected;
+                }
+                auto lowest=StoragePolicy::lowest(m_keys, m_compare);
+                uint32_t slot=lowest->getSlot();
+                replaceValue(slot, std::forward<Args>(args)...);
+                *lowest=KeyType(priority, m_currentId++, slot);
+                StoragePolicy::replaced(m_keys, lowest, m_compare);
+                return InsertResult::Evicted;
+            }
+        }
+        uint32_t slot=storeValue(std::forward<Args>(args)...);
+        m_keys.emplace_back(priority, m_currentId++, slot);
+        StoragePolicy::push(m_keys, m_compare);
+        return InsertResult::Inserted;
+    }
+
+    /**
+     * \brief Checks if an element with the given priority would be kept.
+     * \param priority - priority of the element.
+     * \return True if insert() would keep the element.
+     */
+    bool wouldAccept(Key priority) const {
+        if constexpr (CapacityPolicy::bounded) {
+            if (m_keys.size()>=this->getMaxSize()) {
+                if (m_keys.empty()) {
+                    return false;
+                }
+                auto lowest=StoragePolicy::lowest(m_keys, m_compare);
+                return m_compare.before(priority, m_currentId, lowest->getPriority(), lowest->getId());
+            }
+        }
+        return true;
+    }
+
+    /**
+     * \brief Gets the priority a new element has to beat once the queue is full.
+     *
+     * Only available for int priorities, other key types use wouldAccept().
+     *
+     * \return Priority of the lowest element, or LLONG_MIN while the queue
+     *         still has room or is unbounded.
+     */
+    long long threshold() const requires std::is_same_v<Key, int> {
+        if constexpr (CapacityPolicy::bounded) {
+            if (m_keys.size()>=this->getMaxSize() && !m_keys.empty()) {
+                return StoragePolicy::lowest(m_keys, m_compare)->getPriority();
+            }
+        }
+        return LLONG_MIN;
+    }
+
+    /**
+     * \brief Removes and returns the element with the highest priority.
+     *
+     * If the queue is empty, the error policy is notified and, unless it
+     * throws, the default element value is returned.
+     *
+     * \return The element with the highest priority.
+     */
+    T pop() {
+        if (m_keys.empty()) {
+            ErrorPolicy::emptyPop();
+            return T();
+        }
+        StoragePolicy::popHighest(m_keys, m_compare);
+        return takeBack();
+    }
+
+    /**
+     * \brief Removes and returns the element with the highest priority, if any.
+     * \return The element with the highest priority, or std::nullopt.
+     */
+    std::optional<T> tryPop() {
+        if (m_keys.empty()) {
+            return std::nullopt;
+        }
+        StoragePolicy::popHighest(m_keys, m_compare);
+        return takeBack();
+    }
+
+    /**
+     * \brief Gets the priority of the element that leaves next.
+     * \return Highest priority in the queue, the queue must not be empty.
+     */
+    Key topPriority() const {
+        return StoragePolicy::highest(m_keys, m_compare)->getPriority();
+    }
+
+    /**
+     * \brief Gets the value of the element that leaves next.
+     * \return Value with the highest priority, the queue must not be empty.
+     */
+    const T& topValue() const {
+        return m_values[StoragePolicy::highest(m_keys, m_compare)->getSlot()];
+    }
+
+    /**
+     * \brief Sets the maximum size of a bounded queue.
+     *
+     * Removes the lowest-priority elements if the new size is smaller than
+     * the current number of elements. Their pool slots are kept for reuse.
+     *
+     * \param newSize The new maximum size of the queue.
+     */
+    void setMaxSize(size_t newSize) {
+        static_assert(CapacityPolicy::bounded, "Only bounded queues have a maximum size");
+        this->changeMaxSize(newSize);
+        if (m_keys.size()>newSize) {
+            std::nth_element(m_keys.begin(), m_keys.begin()+newSize, m_keys.end(), m_compare);
+            for (auto it=m_keys.begin()+newSize; it!=m_keys.end(); ++it) {
+                replaceValue(it->getSlot());
+                m_freeSlots.push_back(it->getSlot());
+            }
+            m_keys.erase(m_keys.begin()+newSize, m_keys.end());
+            StoragePolicy::build(m_keys, m_compare);
+        }
+    }
+
+    /**
+     * \brief Checks if the queue is empty.
+     * \return True if the queue is empty, false otherwise.
+     */
+    bool isEmpty() const {
+        return m_keys.empty();
+    }
+
+    /**
+     * \brief Gets the size of the queue.
+     * \return Number of elements in the queue.
+     */
+    size_t size() const {
+        return m_keys.size();
+    }
+
+    /**
+     * \brief Prints the current state of the queue.
+     *
+     * Displays the contents of the queue to the standard output, from the
+     * highest to the lowest priority.
+     */
+    void printQueue() const {
+        if (m_keys.empty()) {
+            std::cout<<"Queue is empty"<<std::endl;
+            return;
+        }
+        std::vector<KeyType> ordered(m_keys);
+        std::sort(ordered.begin(), ordered.end(), m_compare);
+        for (const auto& key : ordered) {
+            std::cout<<"Priority: "<<key.getPriority()<<", Value: "<<m_values[key.getSlot()];
+            if constexpr (detail::isStableV<ComparePolicy>) {
+                std::cout<<", ID: "<<key.getId();
+            }
+            std::cout<<std::endl;
+        }
+    }
+};
+
+}
@@ -1,11 +1,55 @@
 #pragma once
+#include "Stats.hpp"
 #include <vector>
 #include <string>
 #include <iostream>
 #include <algorithm>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <utility>
 
 namespace kp {
 
+namespace detail {
+
+    /**
+     * \brief Identifier of a node, stored only when the queue is stable.
+     */
+    template <bool Stable>
+    struct NodeId {
+        size_t value=0;
+
+        constexpr NodeId()=default;
+        constexpr NodeId(size_t id) : value(id) {}
+
+        constexpr size_t get() const {
+            return value;
+        }
+
+        bool operator==(const NodeId&) const=default;
+    };
+
+    /**
+     * \brief Empty identifier of an unstable node, every node reports 0.
+     */
+    template <>
+    struct NodeId<false> {
+        constexpr NodeId()=default;
+        constexpr NodeId(size_t) {}
+
+        constexpr size_t get() const {
+            return 0;
+        }
+
+        bool operator==(const NodeId&) const=default;
+    };
+
+}
+
 /**
  * \brief Represents a single node in the priority queue.
  *
@@ -13,13 +57,17 @@ namespace kp {
  * with its priority and a unique identifier.
  *
  * \tparam T The type of the value stored in the node.
+ * \tparam Key The type of the priority, int by default.
+ * \tparam Stable If false, the identifier is not stored and getId() always
+ *         returns 0, so equal priorities leave in no particular order. An
+ *         int node then shrinks from 16 to 8 bytes.
  */
-template <typename T>
+template <typename T, typename Key = int, bool Stable = true>
 class Node {
 private:
-    int m_priority;      
+    Key m_priority;      
     T m_value;           
-    size_t m_id;         
+    [[no_unique_address]] detail::NodeId<Stable> m_id;
 
 public:
     /**
@@ -38,13 +86,79 @@ public:
      * \param value - value to be stored in the node.
      * \param id - unique identifier of the node.
      */
-    Node(int priority, const T& value, size_t id) : m_priority(priority), m_value(value), m_id(id) {}
+    Node(Key priority, const T& value, size_t id) : m_priority(priority), m_value(value), m_id(id) {}
+
+    /**
+     * \brief Parametric constructor taking the value by rvalue.
+     *
+     * Creates a Node that takes over the given value without copying it.
+     *
+     * \param priority - priority of the node.
+     * \param value - value to be moved into the node.
+     * \param id - unique identifier of the node.
+     */
+    Node(Key priority, T&& value, size_t id) : m_priority(priority), m_value(std::move(value)), m_id(id) {}
+
+    /**
+     * \brief In-place constructor.
+     *
+     * Creates a Node whose value is constructed directly from the given
+     * arguments, so no temporary value is created.
+     *
+     * \param priority - priority of the node.
+     * \param id - unique identifier of the node.
+     * \param args - arguments forwarded to the constructor of the value.
+     */
+    template <typename... Args>
+    Node(Key priority, size_t id, std::in_place_t, Args&&... args)
+        : m_priority(priority), m_value(std::forward<Args>(args)...), m_id(id) {}
+
+    /**
+     * \brief Allocator-extended constructors.
+     *
+     * Used by containers with a polymorphic or scoped allocator when T is
+     * allocator-aware, so a std::pmr::string payload allocates from the same
+     * memory resource as the container of the nodes.
+     *
+     * \param alloc - allocator of the container, passed on to the value.
+     * \param args - arguments of the matching constructor above.
+     */
+    template <typename Alloc>
+    Node(std::allocator_arg_t, const Alloc& alloc, Key priority, const T& value, size_t id)
+        : m_priority(priority), m_value(std::make_obj_using_allocator<T>(alloc, value)), m_id(id) {}
+
+    template <typename Alloc>
+    Node(std::allocator_arg_t, const Alloc& alloc, Key priority, T&& value, size_t id)
+        : m_priority(priority), m_value(std::make_obj_using_allocator<T>(alloc, std::move(value))), m_id(id) {}
+
+    template <typename Alloc, typename... Args>
+    Node(std::allocator_arg_t, const Alloc& alloc, Key priority, size_t id, std::in_place_t, Args&&... args)
+        : m_priority(priority), m_value(std::make_obj_using_allocator<T>(alloc, std::forward<Args>(args)...)), m_id(id) {}
+
+    template <typename Alloc>
+    Node(std::allocator_arg_t, const Alloc& alloc, const Node& other)
+        : m_priority(other.m_priority), m_value(std::make_obj_using_allocator<T>(alloc, other.m_value)), m_id(other.m_id) {}
+
+    template <typename Alloc>
+    Node(std::allocator_arg_t, const Alloc& alloc, Node&& other)
+        : m_priority(other.m_priority), m_value(std::make_obj_using_allocator<T>(alloc, std::move(other.m_value))), m_id(other.m_id) {}
+
+    /**
+     * \brief Copy and move operations.
+     *
+     * Moving a node moves its value, which is what the heap and eviction
+     * paths rely on to avoid copying payloads.
+     */
+    Node(const Node&)=default;
+    Node(Node&&)=default;
+    Node& operator=(const Node&)=default;
+    Node& operator=(Node&&)=default;
 
     /**
      * \brief Gets the priority of the node.
      * \return Priority of the node.
      */
-    int getPriority() const { 
+    Key getPriority() const { 
         return m_priority; 
     }
 
@@ -56,19 +170,30 @@ public:
         return m_value; 
     }
 
+    /**
+     * \brief Moves the value out of the node.
+     *
+     * The node is left with a moved-from value and should be discarded.
+     *
+     * \return Value that was stored in the node.
+     */
+    T takeValue() {
+        return std::move(m_value);
+    }
+
     /**
      * \brief Gets the unique identifier of the node.
      * \return Unique identifier of the node.
      */
     size_t getId() const { 
-        return m_id; 
+        return m_id.get(); 
     }
 
     /**
      * \brief Sets the priority of the node.
      * \param newPriority - new priority value.
      */
-    void setPriority(int newPriority) { 
+    void setPriority(const Key& newPriority) { 
         m_priority=newPriority; 
     }
 
@@ -80,6 +205,14 @@ public:
         m_value=newValue; 
     }
 
+    /**
+     * \brief Sets the value of the node by moving from the argument.
+     * \param newValue - new value to move into the node.
+     */
+    void setValue(T&& newValue) {
+        m_value=std::move(newValue);
+    }
+
     /**
      * \brief Compares two nodes for equality.
      *
@@ -101,7 +234,7 @@ public:
      * \return True if this node has lower priority, false otherwise.
      */
     bool operator<(const Node& other) const {
-        return m_priority<other.m_priority || (m_priority==other.m_priority && m_id>other.m_id);
+        return m_priority<other.m_priority || (m_priority==other.m_priority && getId()>other.getId());
     }
 
     /**
@@ -114,25 +247,225 @@ public:
      * \return Reference to the output stream.
      */
     friend std::ostream& operator<<(std::ostream& os, const Node& node){
-        os<<"Priority: "<<node.m_priority<<", Value: "<<node.m_value<<", ID: "<<node.m_id;
+        os<<"Priority: "<<node.m_priority<<", Value: "<<node.m_value;
+        if constexpr (Stable) {
+            os<<", ID: "<<node.getId();
+        }
         return os;
     }
 };
 
+}
+
 /**
- * \brief Abstract base class for priority queue implementations.
+ * \brief A node uses an allocator exactly when its value does.
+ */
+template <typename T, typename Key, bool Stable, typename Alloc>
+struct std::uses_allocator<kp::Node<T, Key, Stable>, Alloc> : std::uses_allocator<T, Alloc> {};
+
+namespace kp {
+
+namespace detail {
+
+    template <typename Allocator>
+    inline constexpr bool isStdAllocator=false;
+
+    template <typename U>
+    inline constexpr bool isStdAllocator<std::allocator<U>> =true;
+
+    /**
+     * \brief Largest number of elements a bounded queue reserves up front.
+     */
+    inline constexpr size_t UpfrontReserveLimit=size_t(1)<<16;
+
+    /**
+     * \brief Capacity a bounded queue reserves when its maximum size is set.
+     *
+     * Small top-K queues get all their memory at once. Huge limits, often
+     * used to mean "practically unbounded", grow on demand instead.
+     *
+     * \param maxSize - maximum size of the queue.
+     * \return Number of elements to reserve.
+     */
+    constexpr size_t upfrontCapacity(size_t maxSize) {
+        return maxSize<UpfrontReserveLimit ? maxSize : UpfrontReserveLimit;
+    }
+
+    /**
+     * \brief Reallocates a vector to the given capacity, never below its size.
+     *
+     * Unlike shrink_to_fit(), the result keeps room for a bounded queue to
+     * fill up again without growing.
+     *
+     * \param queue - vector to reallocate.
+     * \param capacity - requested capacity.
+     */
+    template <typename Container>
+    void resetCapacity(Container& queue, size_t capacity) {
+        Container resized(queue.get_allocator());
+        resized.reserve(std::max(capacity, queue.size()));
+        std::move(queue.begin(), queue.end(), std::back_inserter(resized));
+        queue.swap(resized);
+    }
+
+    /**
+     * \brief Builds a node the way a container with the given allocator would.
+     *
+     * Needed where a node is assigned over an existing one, e.g. on eviction,
+     * so the payload of the temporary comes from the memory resource of the
+     * queue as well.
+     *
+     * \param alloc - allocator of the container.
+     * \param args - arguments forwarded to the node constructor.
+     * \return The new node.
+     */
+    template <typename NodeType, typename Allocator, typename... Args>
+    NodeType makeNode(const Allocator& alloc, Args&&... args) {
+        if constexpr (!isStdAllocator<Allocator> && std::uses_allocator_v<NodeType, Allocator>) {
+            return std::make_obj_using_allocator<NodeType>(alloc, std::forward<Args>(args)...);
+        } else {
+            return NodeType(std::forward<Args>(args)...);
+        }
+    }
+
+    /**
+     * \brief Finds the nodes that leave first without touching them.
+     *
+     * One pass over the nodes with a heap of the best pointers so far, kept
+     * in the caller's buffer, so nothing is allocated and most nodes of a
+     * large queue cost one comparison with the worst kept pointer.
+     *
+     * \param nodes - nodes in any order.
+     * \param out - buffer for the pointers, its size is the number wanted.
+     * \param comp - true if its first node leaves first.
+     * \return The filled front of out, pointers to the nodes in leave order.
+     */
+    template <typename NodeType, typename Compare>
+    std::span<const NodeType*> highestNodes(std::span<const NodeType> nodes, std::span<const NodeType*> out, const Compare& comp) {
+        size_t count=std::min(out.size(), nodes.size());
+        auto leavesFirst=[&comp](const NodeType* a, const NodeType* b) {
+            return comp(*a, *b);
+        };
+        auto first=out.begin();
+        size_t filled=0;
+        for (const auto& node : nodes) {
+            if (filled<count) {
+                first[filled++]=&node;
+                std::push_heap(first, first+filled, leavesFirst);
+            } else if (count>0 && comp(node, *out.front())) {
+                std::pop_heap(first, first+count, leavesFirst);
+                first[count-1]=&node;
+                std::push_heap(first, first+count, leavesFirst);
+            }
+        }
+        std::sort_heap(first, first+count, leavesFirst);
+        return out.first(count);
+    }
+
+}
+
+/**
+ * \brief Outcome of inserting into a bounded queue.
+ */
+enum class InsertResult {
+    Inserted,
+    Evicted,
+    Rejected
+};
+
+/**
+ * \brief Default ordering of nodes.
  *
- * The PriorityQueue class defines the interface for managing elements
- * in a priority queue structure. Derived classes must implement the methods.
+ * Higher priorities leave the queue first and equal priorities leave in the
+ * order they were inserted, i.e. by ascending identifier. Queues only compare
+ * priorities and identifiers, so the ordering can also be evaluated for an
+ * element that has not been constructed yet.
+ */
+struct NodeCompare {
+    using KeyType=int;
+
+    /**
+     * \brief Compares the keys of two elements.
+     *
+     * \param priorityA - priority of the first element.
+     * \param idA - identifier of the first element.
+     * \param priorityB - priority of the second element.
+     * \param idB - identifier of the second element.
+     * \return True if the first element leaves the queue before the second.
+     */
+    constexpr bool before(int priorityA, size_t idA, int priorityB, size_t idB) const {
+        if (priorityA==priorityB) {
+            return idA<idB;
+        }
+        return priorityA>priorityB;
+    }
+
+    /**
+     * \brief Compares two nodes.
+     *
+     * Works for Node and for any other element type that provides
+     * getPriority() and getId(), such as the keys of PackedPriorityQueue.
+     *
+     * \param a - first node.
+     * \param b - second node.
+     * \return True if the first node leaves the queue before the second.
+     */
+    template <typename N>
+    bool operator()(const N& a, const N& b) const {
+        return before(a.getPriority(), a.getId(), b.getPriority(), b.getId());
+    }
+};
+
+namespace detail {
+
+    template <typename ComparePolicy, typename=void>
+    struct KeyTypeOf {
+        using type=int;
+    };
+
+    template <typename ComparePolicy>
+    struct KeyTypeOf<ComparePolicy, std::void_t<typename ComparePolicy::KeyType>> {
+        using type=typename ComparePolicy::KeyType;
+    };
+
+    /**
+     * \brief Priority type of a compare policy, int unless it declares KeyType.
+     */
+    template <typename ComparePolicy>
+    using KeyTypeOfT=typename KeyTypeOf<ComparePolicy>::type;
+
+    template <typename ComparePolicy, typename=void>
+    struct IsStable : std::true_type {};
+
+    template <typename ComparePolicy>
+    struct IsStable<ComparePolicy, std::void_t<decltype(ComparePolicy::stable)>> : std::bool_constant<ComparePolicy::stable> {};
+
+    /**
+     * \brief Checks if a compare policy breaks ties by insertion order.
+     *
+     * Policies are stable unless they declare stable=false, in which case
+     * their queues drop the node identifiers.
+     */
+    template <typename ComparePolicy>
+    inline constexpr bool isStableV=IsStable<ComparePolicy>::value;
+
+    struct SnapshotAccess;
+
+}
+
+/**
+ * \brief Interface of a priority queue chosen at run time.
+ *
+ * The queues themselves are not virtual; BasicPriorityQueue and the queues
+ * built on it inline every operation. Code that has to pick the engine at
+ * run time, e.g. from a configuration, holds a PriorityQueue reference to a
+ * PriorityQueueAdapter, which forwards every call to the queue it wraps and
+ * costs one virtual call per operation.
  *
  * \tparam T The type of the elements in the queue.
  */
 template <typename T>
 class PriorityQueue {
-protected:
-    std::vector<Node<T>> m_queue; 
-    size_t m_currentId=1;       
-
 public:
     /**
      * \brief Virtual destructor.
@@ -143,69 +476,177 @@ public:
 
     /**
      * \brief Inserts a new element into the queue.
-     *
-     * Derived classes must define the behavior for adding elements.
-     *
      * \param priority - priority of the element.
      * \param value - value of the element.
      */
     virtual void insert(int priority, const T& value)=0;
 
+    /**
+     * \brief Inserts a new element into the queue by moving it.
+     * \param priority - priority of the element.
+     * \param value - value of the element, moved into the queue.
+     */
+    virtual void insert(int priority, T&& value)=0;
+
     /**
      * \brief Removes and returns the highest-priority element.
      *
-     * Derived classes must define the behavior for removing elements.
+     * An empty queue is reported to the error policy of the wrapped queue.
      *
      * \return The highest-priority element.
      */
     virtual T pop()=0;
 
     /**
-     * \brief Checks if the queue is empty.
-     * \return True if the queue is empty, false otherwise.
+     * \brief Removes and returns the highest-priority element, if any.
+     *
+     * Unlike pop(), an empty queue is not an error and nothing is reported.
+     *
+     * \return The highest-priority element, or std::nullopt if the queue is
+     *         empty.
      */
-    bool isEmpty() const { 
-        return m_queue.empty(); 
-    }
+    virtual std::optional<T> tryPop()=0;
+
+    /**
+     * \brief Removes all elements and appends them to a vector.
+     * \param out - vector receiving the values, from the highest priority.
+     * \return Number of values appended.
+     */
+    virtual size_t drainInto(std::vector<T>& out)=0;
 
     /**
      * \brief Gets the size of the queue.
      * \return Number of elements in the queue.
      */
-    size_t size() const { 
-        return m_queue.size(); 
-    }
+    virtual size_t size() const=0;
 
     /**
-     * \brief Prints the current state of the queue.
+     * \brief Checks if the queue is empty.
+     * \return True if the queue is empty, false otherwise.
+     */
+    virtual bool isEmpty() const=0;
+
+
+    /**
+     * \brief Gets a read-only view of all nodes in storage order.
+     * \return Span over the nodes, invalidated by any change of the queue.
+     */
+    virtual std::span<const Node<T>> nodes() const=0;
+
+    /**
+     * \brief Gets the highest nodes in leave order without removing them.
+     * \param out - buffer for the pointers, its size is the number wanted.
+     * \return The filled front of out, highest priority first.
+     */
+    virtual std::span<const Node<T>*> topK(std::span<const Node<T>*> out) const=0;
+
+    /**
+     * \brief Gets the counters and latency histograms of the queue.
+     * \return Stats of the queue, always zero unless KP_ENABLE_STATS is
+     *         defined.
+     */
+    virtual const QueueStats& stats() const=0;
+
+    /**
+     * \brief Clears the counters and latency histograms.
+     */
+    virtual void resetStats()=0;
+};
+
+/**
+ * \brief Type-erased wrapper exposing a queue through the PriorityQueue interface.
+ *
+ * Owns the queue and forwards every call to it, so the virtual call is the
+ * only cost. get() reaches the wrapped queue for everything the interface
+ * does not cover, e.g. setMaxSize(), contains() or printQueue(), which
+ * would otherwise require every T to be printable.
+ *
+ * \tparam Queue Queue with int priorities and Node nodes, for example
+ *         BoundedPriorityQueue or DAryHeapPriorityQueue.
+ */
+template <typename Queue>
+class PriorityQueueAdapter final : public PriorityQueue<std::remove_cvref_t<decltype(std::declval<Queue&>().pop())>> {
+public:
+    using ValueType=std::remove_cvref_t<decltype(std::declval<Queue&>().pop())>;
+
+private:
+    using T=ValueType;
+
+    Queue m_queue;
+
+public:
+    /**
+     * \brief Default constructor.
      *
-     * Displays the contents of the queue to the standard output.
+     * Wraps a default-constructed queue.
      */
-    void printQueue() const {
-        if (m_queue.empty()) {
-            std::cout<<"Queue is empty"<<std::endl;
-        } else{
-            for (const auto& node : m_queue) {
-                std::cout<<node<<std::endl;
-            }
-        }
+    PriorityQueueAdapter()=default;
+
+    /**
+     * \brief Wraps an existing queue.
+     * \param queue - queue to take over.
+     */
+    explicit PriorityQueueAdapter(Queue queue) : m_queue(std::move(queue)) {}
+
+    /**
+     * \brief Gets the wrapped queue.
+     * \return Reference to the queue.
+     */
+    Queue& get() {
+        return m_queue;
     }
 
-protected:
     /**
-     * \brief Compares two nodes.
-     *
-     * Determines the order of nodes based on priority and ID.
-     *
-     * \param a - first node.
-     * \param b - second node.
-     * \return True if the first node has a higher priority, false if not.
+     * \brief Gets the wrapped queue.
+     * \return Reference to the queue.
      */
-    static bool compareNodes(const Node<T>& a, const Node<T>& b) {
-        if (a.getPriority()==b.getPriority()) {
-            return a.getId()<b.getId();
-        }
-        return a.getPriority()>b.getPriority();
+    const Queue& get() const {
+        return m_queue;
+    }
+
+    void insert(int priority, const T& value) override {
+        m_queue.insert(priority, value);
+    }
+
+    void insert(int priority, T&& value) override {
+        m_queue.insert(priority, std::move(value));
+    }
+
+    T pop() override {
+        return m_queue.pop();
+    }
+
+    std::optional<T> tryPop() override {
+        return m_queue.tryPop();
+    }
+
+    size_t drainInto(std::vector<T>& out) override {
+        return m_queue.drainInto(out);
+    }
+
+    size_t size() const override {
+        return m_queue.size();
+    }
+
+    bool isEmpty() const override {
+        return m_queue.isEmpty();
+    }
+
+
+    std::span<const Node<T>> nodes() const override {
+        return m_queue.nodes();
+    }
+
+    std::span<const Node<T>*> topK(std::span<const Node<T>*> out) const override {
+        return m_queue.topK(out);
+    }
+
+    const QueueStats& stats() const override {
+        return m_queue.stats();
+    }
+
+    void resetStats() override {
+        m_queue.resetStats();
     }
 };
 
@@ -0,0 +1,216 @@
+#pragma once
+#include "PriorityQueue.hpp"
+#include "StoragePolicies.hpp"
+#include "Concurrency.hpp"
+#include <climits>
+#include <memory>
+#include <mutex>
+
+namespace kp {
+
+/**
+ * \brief Global top-K aggregation over per-thread bounded shards.
+ *
+ * Every thread inserts into its own shard, a bounded min-max heap of at most
+ * K elements with its own lock on its own cache line, so producers do not
+ * contend with each other. A shard that is full knows that K elements at or
+ * above its lowest priority exist, so that priority is a lower bound for the
+ * global K-th element. The highest such bound is published in one shared
+ * atomic, and any element that cannot beat it is rejected with a single
+ * relaxed load before any lock is taken or any value is built. The bound only
+ * grows, and it settles quickly on streams where most elements lose.
+ *
+ * snapshotTopK() merges the shards into the exact global top K. Equal
+ * priorities are tie-broken by an identifier from one shared counter, so the
+ * result matches a single BoundedPriorityQueue fed the same elements in the
+ * order their identifiers were drawn.
+ *
+ * \tparam T The type of the elements in the queue.
+ */
+template <typename T>
+class ShardedBoundedPriorityQueue {
+private:
+    static constexpr long long NoThreshold=LLONG_MIN;
+
+    struct alignas(CacheLineSize) Shard {
+        SpinLock lock;
+        std::vector<Node<T>> heap;
+    };
+
+    using Storage=MinMaxHeapStorage;
+
+    size_t m_maxSize;
+    size_t m_shardCount;
+    std::unique_ptr<Shard[]> m_shards;
+    alignas(CacheLineSize) std::atomic<long long> m_threshold{NoThreshold};
+    alignas(CacheLineSize) std::atomic<size_t> m_currentId{1};
+
+    /**
+     * \brief Raises the shared threshold to the lowest priority of a full shard.
+     * \param shard - full shard whose lock is held.
+     */
+    void publishThreshold(const Shard& shard) {
+        long long lowest=Storage::lowest(shard.heap, NodeCompare())->getPriority();
+        long long current=m_threshold.load(std::memory_order_relaxed);
+        while (lowest>current && !m_threshold.compare_exchange_weak(current, lowest, std::memory_order_relaxed)) {
+        }
+    }
+
+    /**
+     * \brief Orders merged nodes and keeps the K highest.
+     * \param nodes - nodes collected from all shards.
+     */
+    void selectTopK(std::vector<Node<T>>& nodes) const {
+        detail::keepHighest(nodes, m_maxSize, NodeCompare());
+        std::sort(nodes.begin(), nodes.end(), NodeCompare());
+    }
+
+public:
+    /**
+     * \brief Parameterized constructor.
+     *
+     * \param maxSize - number of elements to keep, K.
+     * \param shards - number of shards, one per producer thread is ideal.
+     */
+    explicit ShardedBoundedPriorityQueue(size_t maxSize, size_t shards = std::thread::hardware_concurrency())
+        : m_maxSize(maxSize), m_shardCount(std::max<size_t>(1, shards)), m_shards(new Shard[m_shardCount]) {
+        for (size_t i=0; i<m_shardCount; ++i) {
+            m_shards[i].heap.reserve(detail::upfrontCapacity(m_maxSize));
+        }
+    }
+
+    ShardedBoundedPriorityQueue(const ShardedBoundedPriorityQueue&)=delete;
+    ShardedBoundedPriorityQueue& operator=(const ShardedBoundedPriorityQueue&)=delete;
+
+    /**
+     * \brief Checks with one relaxed load if an element could still be kept.
+     *
+     * A false answer is final. A true answer may still be rejected by the
+     * shard. Callers can use this to skip building expensive values.
+     *
+     * \param priority - priority of the element.
+     * \return False if the element cannot reach the global top K.
+     */
+    bool wouldAccept(int priority) const {
+        return m_maxSize>0 && priority>m_threshold.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * \brief Inserts a new element into the shard of the calling thread.
+     * \param priority - priority of the element.
+     * \param value - value of the element.
+     * \return True if the element was kept, false if it was rejected.
+     */
+    bool insert(int priority, const T& value) {
+        return emplace(priority, value);
+    }
+
+    /**
+     * \brief Inserts a new element by moving it. Thread-safe.
+     * \param priority - priority of the element.
+     * \param value - value of the element.
+     * \return True if the element was kept, false if it was rejected.
+     */
+    bool insert(int priority, T&& value) {
+        return emplace(priority, std::move(value));
+    }
+
+    /**
+     * \brief Constructs a new element directly in a shard. Thread-safe.
+     *
+     * The value is only constructed if the element is kept.
+     *
+     * \param priority - priority of the element.
+     * \param args - arguments forwarded to the constructor of the value.
+     * \return True if the element was kept, false if it was rejected.
+     */
+    template <typename... Args>
+    bool emplace(int priority, Args&&... args) {
+        if (!wouldAccept(priority)) {
+            return false;
+        }
+        Shard& shard=m_shards[detail::threadIndex()%m_shardCount];
+        std::lock_guard<SpinLock> guard(shard.lock);
+        auto& heap=shard.heap;
+        if (heap.size()<m_maxSize) {
+            heap.emplace_back(priority, m_currentId.fetch_add(1, std::memory_order_relaxed), std::in_place, std::forward<Args>(args)...);
+            Storage::push(heap, NodeCompare());
+        } else {
+            auto lowest=Storage::lowest(heap, NodeCompare());
+            if (priority<=lowest->getPriority()) {
+                return false;
+            }
+            *lowest=Node<T>(priority, m_currentId.fetch_add(1, std::memory_order_relaxed), std::in_place, std::forward<Args>(args)...);
+            Storage::replaced(heap, lowest, NodeCompare());
+        }
+        if (heap.size()==m_maxSize) {
+            publishThreshold(shard);
+        }
+        return true;
+    }
+
+    /**
+     * \brief Gets the current rejection threshold.
+     * \return Priority that new elements must exceed, or LLONG_MIN while no
+     *         shard is full.
+     */
+    long long threshold() const {
+        return m_threshold.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * \brief Merges the shards into the global top K without changing them.
+     *
+     * Locks one shard at a time, so it can run while producers insert. The
+     * result then reflects each shard at the moment it was visited.
+     *
+     * \return Copies of the K highest nodes, from the highest priority down.
+     */
+    std::vector<Node<T>> snapshotTopK() const {
+        std::vector<Node<T>> nodes;
+        for (size_t i=0; i<m_shardCount; ++i) {
+            std::lock_guard<SpinLock> guard(m_shards[i].lock);
+            nodes.insert(nodes.end(), m_shards[i].heap.begin(), m_shards[i].heap.end());
+        }
+        selectTopK(nodes);
+        return nodes;
+    }
+
+    /**
+     * \brief Moves the global top K out and empties the queue.
+     *
+     * Meant for the end of an aggregation. Values are moved, not copied.
+     *
+     * \return The K highest nodes, from the highest priority down.
+     */
+    std::vector<Node<T>> takeTopK() {
+        std::vector<Node<T>> nodes;
+        for (size_t i=0; i<m_shardCount; ++i) {
+            std::lock_guard<SpinLock> guard(m_shards[i].lock);
+            auto& heap=m_shards[i].heap;
+            nodes.insert(nodes.end(), std::make_move_iterator(heap.begin()), std::make_move_iterator(heap.end()));
+            heap.clear();
+        }
+        m_threshold.store(NoThreshold, std::memory_order_relaxed);
+        selectTopK(nodes);
+        return nodes;
+    }
+
+    /**
+     * \brief Gets the number of elements kept per shard and in the result.
+     * \return K.
+     */
+    size_t getMaxSize() const {
+        return m_maxSize;
+    }
+
+    /**
+     * \brief Gets the number of shards.
+     * \return Number of per-thread shards.
+     */
+    size_t shardCount() const {
+        return m_shardCount;
+    }
+};
+
+}
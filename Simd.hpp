@@ -0,0 +1,244 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)) && !defined(KP_DISABLE_SIMD)
+#define KP_SIMD_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON) && !defined(KP_DISABLE_SIMD)
+#define KP_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace kp {
+
+/**
+ * \brief Instruction set used by the priority scanning kernels.
+ */
+enum class SimdLevel {
+    Scalar,
+    Neon,
+    Avx2,
+    Avx512
+};
+
+namespace detail {
+
+    /**
+     * \brief Kernel selecting the positions whose priority exceeds a threshold.
+     */
+    using SelectAboveKernel=size_t (*)(const int*, size_t, int, uint32_t*);
+
+    /**
+     * \brief Kernel counting the priorities below a key.
+     */
+    using CountBelowKernel=size_t (*)(const int*, size_t, int);
+
+    /**
+     * \brief Portable version of selectAbove(), without branches on the data.
+     */
+    inline size_t selectAboveScalar(const int* priorities, size_t count, int threshold, uint32_t* out) {
+        size_t selected=0;
+        for (size_t i=0; i<count; ++i) {
+            out[selected]=static_cast<uint32_t>(i);
+            selected+=priorities[i]>threshold;
+        }
+        return selected;
+    }
+
+    /**
+     * \brief Portable version of the count used by lowerBound().
+     */
+    inline size_t countBelowScalar(const int* priorities, size_t count, int key) {
+        size_t below=0;
+        for (size_t i=0; i<count; ++i) {
+            below+=priorities[i]<key;
+        }
+        return below;
+    }
+
+#if defined(KP_SIMD_X86)
+
+    __attribute__((target("avx2,bmi")))
+    inline size_t selectAboveAvx2(const int* priorities, size_t count, int threshold, uint32_t* out) {
+        const __m256i limit=_mm256_set1_epi32(threshold);
+        size_t selected=0;
+        size_t i=0;
+        for (; i+8<=count; i+=8) {
+            __m256i block=_mm256_loadu_si256(reinterpret_cast<const __m256i*>(priorities+i));
+            unsigned mask=static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(block, limit))));
+            for (; mask!=0; mask&=mask-1) {
+                out[selected++]=static_cast<uint32_t>(i+_tzcnt_u32(mask));
+            }
+        }
+        for (; i<count; ++i) {
+            out[selected]=static_cast<uint32_t>(i);
+            selected+=priorities[i]>threshold;
+        }
+        return selected;
+    }
+
+    __attribute__((target("avx2,popcnt")))
+    inline size_t countBelowAvx2(const int* priorities, size_t count, int key) {
+        const __m256i limit=_mm256_set1_epi32(key);
+        size_t below=0;
+        size_t i=0;
+        for (; i+8<=count; i+=8) {
+            __m256i block=_mm256_loadu_si256(reinterpret_cast<const __m256i*>(priorities+i));
+            below+=static_cast<size_t>(_mm_popcnt_u32(static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(limit, block))))));
+        }
+        return below+countBelowScalar(priorities+i, count-i, key);
+    }
+
+    __attribute__((target("avx512f,popcnt")))
+    inline size_t selectAboveAvx512(const int* priorities, size_t count, int threshold, uint32_t* out) {
+        const __m512i limit=_mm512_set1_epi32(threshold);
+        const __m512i step=_mm512_set1_epi32(16);
+        __m512i positions=_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+        size_t selected=0;
+        size_t i=0;
+        for (; i+16<=count; i+=16) {
+            __m512i block=_mm512_loadu_si512(priorities+i);
+            __mmask16 mask=_mm512_cmpgt_epi32_mask(block, limit);
+            _mm512_mask_compressstoreu_epi32(out+selected, mask, positions);
+            selected+=static_cast<size_t>(_mm_popcnt_u32(mask));
+            positions=_mm512_add_epi32(positions, step);
+        }
+        __mmask16 tail=static_cast<__mmask16>((1u<<(count-i))-1);
+        __mmask16 mask=_mm512_mask_cmpgt_epi32_mask(tail, _mm512_maskz_loadu_epi32(tail, priorities+i), limit);
+        _mm512_mask_compressstoreu_epi32(out+selected, mask, positions);
+        return selected+static_cast<size_t>(_mm_popcnt_u32(mask));
+    }
+
+    __attribute__((target("avx512f,popcnt")))
+    inline size_t countBelowAvx512(const int* priorities, size_t count, int key) {
+        const __m512i limit=_mm512_set1_epi32(key);
+        size_t below=0;
+        size_t i=0;
+        for (; i+16<=count; i+=16) {
+            below+=static_cast<size_t>(_mm_popcnt_u32(_mm512_cmplt_epi32_mask(_mm512_loadu_si512(priorities+i), limit)));
+        }
+        __mmask16 tail=static_cast<__mmask16>((1u<<(count-i))-1);
+        return below+static_cast<size_t>(_mm_popcnt_u32(_mm512_mask_cmplt_epi32_mask(tail, _mm512_maskz_loadu_epi32(tail, priorities+i), limit)));
+    }
+
+#elif defined(KP_SIMD_NEON)
+
+    inline size_t selectAboveNeon(const int* priorities, size_t count, int threshold, uint32_t* out) {
+        const int32x4_t limit=vdupq_n_s32(threshold);
+        const uint32x4_t lanes={1, 2, 4, 8};
+        size_t selected=0;
+        size_t i=0;
+        for (; i+4<=count; i+=4) {
+            uint32x4_t greater=vcgtq_s32(vld1q_s32(priorities+i), limit);
+            unsigned mask=vaddvq_u32(vandq_u32(greater, lanes));
+            for (; mask!=0; mask&=mask-1) {
+                out[selected++]=static_cast<uint32_t>(i+__builtin_ctz(mask));
+            }
+        }
+        for (; i<count; ++i) {
+            out[selected]=static_cast<uint32_t>(i);
+            selected+=priorities[i]>threshold;
+        }
+        return selected;
+    }
+
+    inline size_t countBelowNeon(const int* priorities, size_t count, int key) {
+        const int32x4_t limit=vdupq_n_s32(key);
+        uint32x4_t below=vdupq_n_u32(0);
+        size_t i=0;
+        for (; i+4<=count; i+=4) {
+            below=vsubq_u32(below, vcltq_s32(vld1q_s32(priorities+i), limit));
+        }
+        return vaddvq_u32(below)+countBelowScalar(priorities+i, count-i, key);
+    }
+
+#endif
+
+    /**
+     * \brief Scanning kernels chosen for the running CPU.
+     */
+    struct SimdKernels {
+        SimdLevel level;
+        SelectAboveKernel selectAbove;
+        CountBelowKernel countBelow;
+    };
+
+    /**
+     * \brief Picks the widest kernels the CPU supports, once per process.
+     * \return Kernels used by selectAbove() and lowerBound().
+     */
+    inline const SimdKernels& simdKernels() {
+        static const SimdKernels kernels=[] {
+#if defined(KP_SIMD_X86)
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("popcnt")) {
+                return SimdKernels{SimdLevel::Avx512, selectAboveAvx512, countBelowAvx512};
+            }
+            if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi") && __builtin_cpu_supports("popcnt")) {
+                return SimdKernels{SimdLevel::Avx2, selectAboveAvx2, countBelowAvx2};
+            }
+#elif defined(KP_SIMD_NEON)
+            return SimdKernels{SimdLevel::Neon, selectAboveNeon, countBelowNeon};
+#endif
+            return SimdKernels{SimdLevel::Scalar, selectAboveScalar, countBelowScalar};
+        }();
+        return kernels;
+    }
+
+}
+
+/**
+ * \brief Gets the instruction set picked for the running CPU.
+ *
+ * AVX-512 and AVX2 are detected at run time on x86-64 with GCC and Clang,
+ * NEON is always available on AArch64. Defining KP_DISABLE_SIMD forces the
+ * portable kernels.
+ *
+ * \return Level of the kernels behind selectAbove() and lowerBound().
+ */
+inline SimdLevel simdLevel() {
+    return detail::simdKernels().level;
+}
+
+/**
+ * \brief Collects the positions of the priorities above a threshold.
+ *
+ * This is the filter of a bounded batch insert: only the selected elements
+ * can beat the lowest element of a full queue.
+ *
+ * \param priorities - priorities to scan.
+ * \param threshold - priority an element has to exceed.
+ * \param out - receives the selected positions in ascending order, room for
+ *        priorities.size() entries is needed.
+ * \return Number of positions written to out.
+ */
+inline size_t selectAbove(std::span<const int> priorities, int threshold, uint32_t* out) {
+    return detail::simdKernels().selectAbove(priorities.data(), priorities.size(), threshold, out);
+}
+
+/**
+ * \brief Finds the first priority that is not below a key.
+ *
+ * Works like std::lower_bound on ascending priorities. The search halves the
+ * range without branches until a few cache lines are left and counts the
+ * smaller priorities in those with vector compares.
+ *
+ * \param priorities - priorities in ascending order.
+ * \param key - priority to search for.
+ * \return Position of the first priority >= key, or priorities.size().
+ */
+inline size_t lowerBound(std::span<const int> priorities, int key) {
+    constexpr size_t ScanWindow=64;
+    const int* base=priorities.data();
+    size_t count=priorities.size();
+    while (count>ScanWindow) {
+        size_t half=count/2;
+        base=base[half-1]<key ? base+half : base;
+        count-=half;
+    }
+    return static_cast<size_t>(base-priorities.data())+detail::simdKernels().countBelow(base, count, key);
+}
+
+}
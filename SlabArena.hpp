@@ -0,0 +1,155 @@
+#pragma once
+#include <cstddef>
+#include <memory_resource>
+
+namespace kp {
+
+/**
+ * \brief Memory resource handing out fixed-size blocks from one slab.
+ *
+ * Made for bounded queues with allocator-aware payloads such as
+ * std::pmr::string. Their capacity is known up front, so all payload buffers
+ * fit in a slab allocated once. An evicted payload returns its block to a
+ * free list and the next payload takes it again, so a queue in steady state
+ * never calls malloc or free. A queue of maxSize elements needs maxSize + 1
+ * blocks, because the new payload is built before the evicted one is freed.
+ *
+ * Requests larger than a block, such as the node vector itself, and requests
+ * made once the slab is exhausted are passed to the upstream resource. For
+ * queues that only grow, std::pmr::monotonic_buffer_resource is an
+ * alternative.
+ *
+ * Not thread-safe. Values popped from the queue keep using the arena, so it
+ * has to outlive them.
+ */
+class SlabArena : public std::pmr::memory_resource {
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    size_t m_blockSize;
+    size_t m_blockCount;
+    std::pmr::memory_resource* m_upstream;
+    std::byte* m_slab;
+    std::byte* m_untouched;
+    FreeBlock* m_free=nullptr;
+    size_t m_inUse=0;
+
+    /**
+     * \brief Rounds a block size up so every block is suitably aligned.
+     * \param blockSize - requested block size.
+     * \return Usable block size.
+     */
+    static size_t roundBlockSize(size_t blockSize) {
+        constexpr size_t Alignment=alignof(std::max_align_t);
+        size_t size=blockSize<sizeof(FreeBlock) ? sizeof(FreeBlock) : blockSize;
+        return (size+Alignment-1)/Alignment*Alignment;
+    }
+
+    /**
+     * \brief Checks if a pointer lies inside the slab.
+     * \param p - pointer returned by do_allocate().
+     * \return True if the pointer is one of the blocks.
+     */
+    bool ownsBlock(const void* p) const {
+        auto* byte=static_cast<const std::byte*>(p);
+        return byte>=m_slab && byte<m_slab+m_blockSize*m_blockCount;
+    }
+
+protected:
+    /**
+     * \brief Takes a free block, or asks upstream if none fits.
+     */
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        if (bytes<=m_blockSize && alignment<=alignof(std::max_align_t)) {
+            if (m_free!=nullptr) {
+                FreeBlock* block=m_free;
+                m_free=block->next;
+                ++m_inUse;
+                return block;
+            }
+            if (m_untouched!=m_slab+m_blockSize*m_blockCount) {
+                void* block=m_untouched;
+                m_untouched+=m_blockSize;
+                ++m_inUse;
+                return block;
+            }
+        }
+        return m_upstream->allocate(bytes, alignment);
+    }
+
+    /**
+     * \brief Puts a block back on the free list, or returns it upstream.
+     */
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        if (!ownsBlock(p)) {
+            m_upstream->deallocate(p, bytes, alignment);
+            return;
+        }
+        auto* block=static_cast<FreeBlock*>(p);
+        block->next=m_free;
+        m_free=block;
+        --m_inUse;
+    }
+
+    /**
+     * \brief Blocks can only be returned to the arena that handed them out.
+     */
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this==&other;
+    }
+
+public:
+    /**
+     * \brief Parameterized constructor.
+     *
+     * \param blockSize - size of one block, at least the largest payload
+     *        allocation, e.g. the capacity of the strings plus one.
+     * \param blockCount - number of blocks, maxSize + 1 for a bounded queue.
+     * \param upstream - resource for the slab and for oversized requests.
+     */
+    SlabArena(size_t blockSize, size_t blockCount, std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+        : m_blockSize(roundBlockSize(blockSize)), m_blockCount(blockCount), m_upstream(upstream) {
+        m_slab=static_cast<std::byte*>(m_upstream->allocate(m_blockSize*m_blockCount, alignof(std::max_align_t)));
+        m_untouched=m_slab;
+    }
+
+    SlabArena(const SlabArena&)=delete;
+    SlabArena& operator=(const SlabArena&)=delete;
+
+    /**
+     * \brief Destructor.
+     *
+     * Releases the slab. Blocks still in use become invalid.
+     */
+    ~SlabArena() override {
+        m_upstream->deallocate(m_slab, m_blockSize*m_blockCount, alignof(std::max_align_t));
+    }
+
+    /**
+     * \brief Gets the usable size of one block.
+     * \return Block size in bytes, rounded up for alignment.
+     */
+    size_t getBlockSize() const {
+        return m_blockSize;
+    }
+
+    /**
+     * \brief Gets the number of blocks in the slab.
+     * \return Number of blocks.
+     */
+    size_t getBlockCount() const {
+        return m_blockCount;
+    }
+
+    /**
+     * \brief Gets the number of blocks currently handed out.
+     * \return Number of blocks in use.
+     */
+    size_t blocksInUse() const {
+        return m_inUse;
+    }
+};
+
+}
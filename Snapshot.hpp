@@ -0,0 +1,693 @@
+#pragma once
+#include "BasicPriorityQueue.hpp"
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(KP_DISABLE_MMAP)
+#define KP_SNAPSHOT_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace kp {
+
+/**
+ * \brief Fixed 64-byte header in front of every snapshot.
+ *
+ * The header is followed by count records in the order the queue keeps its
+ * nodes, so a snapshot loaded into a queue with the same storage needs no
+ * reordering. Raw snapshots store the records as the bytes of Node<T>, which
+ * is what makes the mapped load path possible and ties a raw snapshot to the
+ * byte order and the Node layout of the build that wrote it; both are checked
+ * when loading. Encoded snapshots store every record as a 32-bit priority, a
+ * 64-bit identifier and the value written by SnapshotCodec<T>; the size of T
+ * and the id of the codec are recorded and checked when loading.
+ */
+struct SnapshotHeader {
+    static constexpr char Magic[8]={'K', 'P', 'Q', 'S', 'N', 'A', 'P', '\0'};
+    static constexpr uint32_t CurrentVersion=1;
+    static constexpr uint32_t NativeByteOrder=0x01020304;
+
+    enum Format : uint32_t {
+        Raw=0,
+        Encoded=1
+    };
+
+    char magic[8]={};
+    uint32_t version=CurrentVersion;
+    uint32_t byteOrder=NativeByteOrder;
+    uint32_t format=Raw;
+    uint32_t layout=0;
+    uint32_t nodeSize=0;
+    uint32_t nodeAlign=0;
+    uint32_t valueSize=0;
+    uint32_t codec=0;
+    uint64_t count=0;
+    uint64_t currentId=1;
+    uint64_t maxSize=UINT64_MAX;
+};
+
+static_assert(sizeof(SnapshotHeader)==64 && std::is_trivially_copyable_v<SnapshotHeader>);
+
+/**
+ * \brief Writes and reads the values of an encoded snapshot.
+ *
+ * Specialize it for a value type that is not trivially copyable. The default
+ * copies the bytes of trivially copyable values, and std::string is written
+ * as a 64-bit length followed by its characters.
+ *
+ * A specialization may declare a nonzero static constexpr uint32_t id, which
+ * is stored in encoded snapshots and has to match on load. Ids below 256 are
+ * used by the library. Without an id only the size of T is checked.
+ *
+ * \tparam T The type of the values.
+ */
+template <typename T>
+struct SnapshotCodec {
+    static_assert(std::is_trivially_copyable_v<T> && std::is_default_constructible_v<T>,
+        "Specialize kp::SnapshotCodec to snapshot values that are not trivially copyable");
+
+    static constexpr uint32_t id=1;
+
+    static void write(std::ostream& out, const T& value) {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    static T read(std::istream& in) {
+        T value;
+        in.read(reinterpret_cast<char*>(&value), sizeof(T));
+        return value;
+    }
+};
+
+template <>
+struct SnapshotCodec<std::string> {
+    static constexpr uint32_t id=2;
+
+    static void write(std::ostream& out, const std::string& value) {
+        uint64_t length=value.size();
+        out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        out.write(value.data(), static_cast<std::streamsize>(value.size()));
+    }
+
+    static std::string read(std::istream& in) {
+        uint64_t length=0;
+        in.read(reinterpret_cast<char*>(&length), sizeof(length));
+        // Read in bounded pieces, so a corrupt length ends in a truncated
+        // stream instead of one huge allocation.
+        std::string value;
+        while (in && value.size()<length) {
+            size_t piece=static_cast<size_t>(std::min<uint64_t>(length-value.size(), uint64_t(1)<<16));
+            size_t oldSize=value.size();
+            value.resize(oldSize+piece);
+            in.read(value.data()+oldSize, static_cast<std::streamsize>(piece));
+        }
+        return value;
+    }
+};
+
+namespace detail {
+
+    /**
+     * \brief Identifies the node order of a storage policy in a snapshot.
+     *
+     * Storages without a tag report 0, and their snapshots are always
+     * reordered on load.
+     */
+    template <typename Storage>
+    inline constexpr uint32_t storageLayout=0;
+
+    template <>
+    inline constexpr uint32_t storageLayout<MinMaxHeapStorage> =1;
+
+    template <>
+    inline constexpr uint32_t storageLayout<SortedStorage> =2;
+
+    template <size_t Arity>
+    inline constexpr uint32_t storageLayout<DAryHeapStorage<Arity>> =0x10000+static_cast<uint32_t>(Arity);
+
+    /**
+     * \brief Layout of sorted runs, the node that leaves first comes first.
+     */
+    inline constexpr uint32_t DescendingRunLayout=3;
+
+    /**
+     * \brief Id of the codec of T recorded in encoded snapshots, 0 if it has none.
+     */
+    template <typename T>
+    constexpr uint32_t snapshotCodecId() {
+        if constexpr (requires { { SnapshotCodec<T>::id } -> std::convertible_to<uint32_t>; }) {
+            return SnapshotCodec<T>::id;
+        } else {
+            return 0;
+        }
+    }
+
+    /**
+     * \brief Checks if the nodes of T can be written and read as plain bytes.
+     */
+    template <typename T>
+    inline constexpr bool rawSnapshot=std::is_trivially_copyable_v<Node<T>> && std::is_default_constructible_v<T>;
+
+    template <typename T>
+    SnapshotHeader makeSnapshotHeader(uint32_t format, uint32_t layout, size_t count, size_t currentId, size_t maxSize) {
+        SnapshotHeader header;
+        std::memcpy(header.magic, SnapshotHeader::Magic, sizeof(header.magic));
+        header.format=format;
+        header.layout=layout;
+        header.nodeSize=static_cast<uint32_t>(sizeof(Node<T>));
+        header.nodeAlign=static_cast<uint32_t>(alignof(Node<T>));
+        header.valueSize=static_cast<uint32_t>(sizeof(T));
+        if (format==SnapshotHeader::Encoded) {
+            header.codec=snapshotCodecId<T>();
+        }
+        header.count=count;
+        header.currentId=currentId;
+        header.maxSize=maxSize;
+        return header;
+    }
+
+    /**
+     * \brief Rejects a header that was not written for nodes of T.
+     * \param header - header read from a snapshot.
+     * \throws std::runtime_error if the header does not match.
+     */
+    template <typename T>
+    void checkSnapshotHeader(const SnapshotHeader& header) {
+        if (std::memcmp(header.magic, SnapshotHeader::Magic, sizeof(header.magic))!=0) {
+            throw std::runtime_error("Not a queue snapshot");
+        }
+        if (header.version!=SnapshotHeader::CurrentVersion) {
+            throw std::runtime_error("Unsupported snapshot version");
+        }
+        if (header.byteOrder!=SnapshotHeader::NativeByteOrder) {
+            throw std::runtime_error("Snapshot written with a different byte order");
+        }
+        if (header.format==SnapshotHeader::Raw) {
+            if (!rawSnapshot<T> || header.nodeSize!=sizeof(Node<T>) || header.nodeAlign!=alignof(Node<T>) || header.valueSize!=sizeof(T)) {
+                throw std::runtime_error("Snapshot written for a different value type");
+            }
+        } else if (header.format==SnapshotHeader::Encoded) {
+            if (header.valueSize!=sizeof(T) || header.codec!=snapshotCodecId<T>()) {
+                throw std::runtime_error("Snapshot written for a different value type");
+            }
+        } else {
+            throw std::runtime_error("Unknown snapshot format");
+        }
+    }
+
+    /**
+     * \brief Reads the internals of the queues that support snapshots.
+     */
+    struct SnapshotAccess {
+        template <typename Queue>
+        static auto& nodes(Queue& queue) {
+            return queue.m_queue;
+        }
+
+        template <typename Queue>
+        static auto& currentId(Queue& queue) {
+            return queue.m_currentId;
+        }
+
+        template <typename T, typename Storage, typename Compare, typename Capacity, typename ErrorPolicy, typename Allocator, typename Index>
+        static uint32_t layout(const BasicPriorityQueue<T, Storage, Compare, Capacity, ErrorPolicy, Allocator, Index>& queue) {
+            static_assert(std::is_same_v<Compare, NodeCompare>, "Snapshots hold Node<T> in the default order");
+            if constexpr (Capacity::bounded) {
+                if (queue.m_lazy.unordered) {
+                    return 0;
+                }
+            }
+            return storageLayout<Storage>;
+        }
+
+        template <typename T, typename Storage, typename Compare, typename Capacity, typename ErrorPolicy, typename Allocator, typename Index>
+        static size_t maxSize(const BasicPriorityQueue<T, Storage, Compare, Capacity, ErrorPolicy, Allocator, Index>& queue) {
+            if constexpr (Capacity::bounded) {
+                return queue.getMaxSize();
+            } else {
+                return SIZE_MAX;
+            }
+        }
+
+        /**
+         * \brief Replaces the contents of a queue with loaded nodes.
+         *
+         * A bounded queue takes the maximum size of the snapshot, or keeps its
+         * own if the snapshot came from an unbounded queue, in which case only
+         * the highest elements are kept. Everything that can throw runs on
+         * the loaded nodes and a new index first; the queue is only changed
+         * by the swaps at the end.
+         *
+         * \param queue - queue to load into.
+         * \param header - header of the snapshot.
+         * \param loaded - nodes read from the snapshot, left with the old nodes.
+         */
+        template <typename T, typename Storage, typename Compare, typename Capacity, typename ErrorPolicy, typename Allocator, typename Index, typename Container>
+        static void restore(BasicPriorityQueue<T, Storage, Compare, Capacity, ErrorPolicy, Allocator, Index>& queue, const SnapshotHeader& header, Container& loaded) {
+            static_assert(std::is_same_v<Compare, NodeCompare>, "Snapshots hold Node<T> in the default order");
+            NodeCompare compare;
+            if (header.layout!=storageLayout<Storage> || storageLayout<Storage> ==0) {
+                Storage::build(loaded, compare);
+            }
+            [[maybe_unused]] size_t maxSize=SIZE_MAX;
+            if constexpr (Capacity::bounded) {
+                maxSize=header.maxSize!=UINT64_MAX ? static_cast<size_t>(header.maxSize) : queue.getMaxSize();
+                if (loaded.size()>maxSize) {
+                    Storage::truncate(loaded, maxSize, compare);
+                }
+                loaded.reserve(detail::upfrontCapacity(maxSize));
+            }
+            Index index;
+            index.rebuild(loaded);
+            queue.m_queue.swap(loaded);
+            std::swap(queue.m_index, index);
+            queue.m_currentId=static_cast<size_t>(header.currentId);
+            if constexpr (Capacity::bounded) {
+                queue.changeMaxSize(maxSize);
+                queue.m_lazy.unordered=false;
+                queue.m_lazy.floor=LazyState::NoFloor;
+            }
+        }
+    };
+
+    template <typename Queue>
+    using SnapshotValue=std::remove_cvref_t<decltype(std::declval<Queue&>().pop())>;
+
+    /**
+     * \brief Format the nodes of T are written in.
+     */
+    template <typename T>
+    inline constexpr uint32_t snapshotFormat=rawSnapshot<T> ? SnapshotHeader::Raw : SnapshotHeader::Encoded;
+
+    /**
+     * \brief Writes a header for nodes of T.
+     * \throws std::runtime_error if the stream fails.
+     */
+    template <typename T>
+    void writeSnapshotHeader(std::ostream& out, uint32_t layout, size_t count, size_t currentId, size_t maxSize) {
+        SnapshotHeader header=makeSnapshotHeader<T>(snapshotFormat<T>, layout, count, currentId, maxSize);
+        if (!out.write(reinterpret_cast<const char*>(&header), sizeof(header))) {
+            throw std::runtime_error("Failed to write the snapshot");
+        }
+    }
+
+    /**
+     * \brief Writes records after a header from writeSnapshotHeader().
+     *
+     * A snapshot may be written in several calls, e.g. while merging.
+     *
+     * \param out - binary stream.
+     * \param nodes - nodes to append.
+     * \throws std::runtime_error if the stream fails.
+     */
+    template <typename T>
+    void writeSnapshotNodes(std::ostream& out, std::span<const Node<T>> nodes) {
+        if constexpr (rawSnapshot<T>) {
+            out.write(reinterpret_cast<const char*>(nodes.data()), static_cast<std::streamsize>(nodes.size()*sizeof(Node<T>)));
+        } else {
+            for (const auto& node : nodes) {
+                int32_t priority=node.getPriority();
+                uint64_t id=node.getId();
+                out.write(reinterpret_cast<const char*>(&priority), sizeof(priority));
+                out.write(reinterpret_cast<const char*>(&id), sizeof(id));
+                SnapshotCodec<T>::write(out, node.getValue());
+            }
+        }
+        if (!out) {
+            throw std::runtime_error("Failed to write the snapshot");
+        }
+    }
+
+    /**
+     * \brief Reads and checks the header of a snapshot for nodes of T.
+     * \throws std::runtime_error if the header is truncated or does not match.
+     */
+    template <typename T>
+    SnapshotHeader readSnapshotHeader(std::istream& in) {
+        SnapshotHeader header;
+        if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+            throw std::runtime_error("Truncated snapshot");
+        }
+        checkSnapshotHeader<T>(header);
+        return header;
+    }
+
+    /**
+     * \brief Gets the number of bytes left in a seekable stream.
+     * \return Bytes after the read position, or std::nullopt if the stream
+     *         cannot seek, e.g. a pipe.
+     */
+    inline std::optional<uint64_t> remainingBytes(std::istream& in) {
+        std::streampos here=in.tellg();
+        if (here==std::streampos(-1)) {
+            in.clear();
+            return std::nullopt;
+        }
+        in.seekg(0, std::ios::end);
+        std::streampos end=in.tellg();
+        in.clear();
+        in.seekg(here);
+        if (end==std::streampos(-1) || end<here) {
+            return std::nullopt;
+        }
+        return static_cast<uint64_t>(end-here);
+    }
+
+    /**
+     * \brief Appends records of a snapshot to a container of nodes.
+     *
+     * Raw records are read with one read into the container. The count is
+     * checked against the size of a seekable stream first, and a stream that
+     * cannot seek is read in pieces, so a corrupt count is reported as a
+     * truncated snapshot instead of failing a huge allocation.
+     *
+     * \param in - binary stream positioned at the next record.
+     * \param header - header of the snapshot.
+     * \param nodes - container receiving the nodes.
+     * \param count - number of records to read.
+     * \throws std::runtime_error if the stream ends early.
+     */
+    template <typename T, typename Container>
+    void readSnapshotNodes(std::istream& in, const SnapshotHeader& header, Container& nodes, size_t count) {
+        size_t oldSize=nodes.size();
+        size_t recordSize=header.format==SnapshotHeader::Raw ? sizeof(Node<T>) : sizeof(int32_t)+sizeof(uint64_t);
+        std::optional<uint64_t> remaining=remainingBytes(in);
+        if (remaining && count>*remaining/recordSize) {
+            throw std::runtime_error("Truncated snapshot");
+        }
+        if constexpr (rawSnapshot<T>) {
+            if (header.format==SnapshotHeader::Raw) {
+                size_t piece=remaining ? count : size_t(1)<<16;
+                for (size_t done=0; done<count; done+=piece) {
+                    piece=std::min(piece, count-done);
+                    nodes.resize(oldSize+done+piece);
+                    if (!in.read(reinterpret_cast<char*>(nodes.data()+oldSize+done), static_cast<std::streamsize>(piece*sizeof(Node<T>)))) {
+                        nodes.resize(oldSize);
+                        throw std::runtime_error("Truncated snapshot");
+                    }
+                }
+                return;
+            }
+        } else if (header.format!=SnapshotHeader::Encoded) {
+            throw std::runtime_error("Snapshot written for a different value type");
+        }
+        for (size_t i=0; i<count; ++i) {
+            int32_t priority=0;
+            uint64_t id=0;
+            in.read(reinterpret_cast<char*>(&priority), sizeof(priority));
+            in.read(reinterpret_cast<char*>(&id), sizeof(id));
+            T value=SnapshotCodec<T>::read(in);
+            if (!in) {
+                throw std::runtime_error("Truncated snapshot");
+            }
+            nodes.emplace_back(priority, static_cast<size_t>(id), std::in_place, std::move(value));
+        }
+    }
+
+}
+
+/**
+ * \brief Writes a snapshot of a queue to a binary stream.
+ *
+ * Supported are the BasicPriorityQueue instantiations with the default
+ * NodeCompare, e.g. BoundedPriorityQueue and DAryHeapPriorityQueue. The nodes are
+ * written in the order the queue keeps them, together with the next
+ * identifier and the maximum size, so a loaded queue continues exactly where
+ * the saved one stopped, including the order of equal priorities. Nodes of a
+ * trivially copyable T are written with a single write.
+ *
+ * \param queue - queue to save, left unchanged.
+ * \param out - binary stream receiving the snapshot.
+ * \throws std::runtime_error if the stream fails.
+ */
+template <typename Queue>
+void saveSnapshot(const Queue& queue, std::ostream& out) {
+    using T=detail::SnapshotValue<Queue>;
+    const auto& nodes=detail::SnapshotAccess::nodes(queue);
+    detail::writeSnapshotHeader<T>(out, detail::SnapshotAccess::layout(queue), nodes.size(),
+        detail::SnapshotAccess::currentId(queue), detail::SnapshotAccess::maxSize(queue));
+    detail::writeSnapshotNodes<T>(out, std::span<const Node<T>>(nodes.data(), nodes.size()));
+}
+
+/**
+ * \brief Writes a snapshot of a queue to a file.
+ * \param queue - queue to save, left unchanged.
+ * \param path - file to create or overwrite.
+ * \throws std::runtime_error if the file cannot be written.
+ */
+template <typename Queue>
+void saveSnapshot(const Queue& queue, const std::filesystem::path& path) {
+    std::ofstream out(path, std::ios::binary|std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Cannot open "+path.string()+" for writing");
+    }
+    saveSnapshot(queue, out);
+}
+
+/**
+ * \brief Replaces the contents of a queue with a snapshot from a binary stream.
+ *
+ * A raw snapshot is read with one sequential read straight into the nodes of
+ * the queue. If the snapshot was saved from the same kind of storage, the
+ * nodes are already in place and nothing is compared; otherwise they are
+ * reordered once in O(n) or, for SortedStorage, O(n log n). Either way no
+ * element is inserted one by one. The queue takes the next identifier of the
+ * snapshot and, for a bounded snapshot, its maximum size.
+ *
+ * The snapshot is read into a separate buffer and only swapped in once it
+ * has been read and ordered completely, so if the load throws, the queue is
+ * left exactly as it was.
+ *
+ * \param queue - queue to load into, its elements are discarded.
+ * \param in - binary stream holding the snapshot.
+ * \throws std::runtime_error if the snapshot is malformed, truncated or was
+ *         written for a different value type.
+ */
+template <typename Queue>
+void loadSnapshot(Queue& queue, std::istream& in) {
+    using T=detail::SnapshotValue<Queue>;
+    SnapshotHeader header=detail::readSnapshotHeader<T>(in);
+    auto& nodes=detail::SnapshotAccess::nodes(queue);
+    std::remove_reference_t<decltype(nodes)> loaded(nodes.get_allocator());
+    detail::readSnapshotNodes<T>(in, header, loaded, static_cast<size_t>(header.count));
+    detail::SnapshotAccess::restore(queue, header, loaded);
+}
+
+/**
+ * \brief Replaces the contents of a queue with a snapshot from a file.
+ * \param queue - queue to load into, its elements are discarded.
+ * \param path - snapshot file.
+ * \throws std::runtime_error if the file cannot be read or is malformed.
+ */
+template <typename Queue>
+void loadSnapshot(Queue& queue, const std::filesystem::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Cannot open "+path.string()+" for reading");
+    }
+    loadSnapshot(queue, in);
+}
+
+/**
+ * \brief Read-only view of a raw snapshot file mapped into memory.
+ *
+ * Opening a snapshot maps the file and checks its header, which takes the
+ * same time for any number of elements; the pages are read from disk when
+ * they are first touched. The nodes can be inspected in place through
+ * nodes(), e.g. to serve reads while a service warms up, and loadInto()
+ * copies them into a queue with one sequential pass. The first node is the
+ * highest element of snapshots saved from heap storages, the last one of
+ * snapshots saved from SortedStorage.
+ *
+ * Without POSIX mmap, or with KP_DISABLE_MMAP defined, the file is read into
+ * memory instead.
+ *
+ * \tparam T The type of the elements, must be trivially copyable.
+ */
+template <typename T>
+class MappedSnapshot {
+    static_assert(detail::rawSnapshot<T>, "MappedSnapshot needs trivially copyable values, use loadSnapshot otherwise");
+
+private:
+    SnapshotHeader m_header;
+    const Node<T>* m_nodes=nullptr;
+#if defined(KP_SNAPSHOT_MMAP)
+    void* m_mapping=nullptr;
+    size_t m_length=0;
+#else
+    std::vector<Node<T>> m_buffer;
+#endif
+
+    /**
+     * \brief Releases the mapping, if any.
+     */
+    void release() {
+#if defined(KP_SNAPSHOT_MMAP)
+        if (m_mapping!=nullptr) {
+            munmap(m_mapping, m_length);
+        }
+        m_mapping=nullptr;
+        m_length=0;
+#endif
+        m_nodes=nullptr;
+    }
+
+public:
+    /**
+     * \brief Maps a snapshot file.
+     *
+     * \param path - raw snapshot file, as written by saveSnapshot for a
+     *        trivially copyable T.
+     * \throws std::runtime_error if the file cannot be mapped, is truncated
+     *         or was written for a different value type.
+     */
+    explicit MappedSnapshot(const std::filesystem::path& path) {
+#if defined(KP_SNAPSHOT_MMAP)
+        int fd=::open(path.c_str(), O_RDONLY);
+        if (fd<0) {
+            throw std::runtime_error("Cannot open "+path.string()+" for reading");
+        }
+        struct stat status;
+        if (::fstat(fd, &status)!=0 || static_cast<size_t>(status.st_size)<sizeof(SnapshotHeader)) {
+            ::close(fd);
+            throw std::runtime_error("Truncated snapshot");
+        }
+        m_length=static_cast<size_t>(status.st_size);
+        void* mapping=::mmap(nullptr, m_length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping==MAP_FAILED) {
+            m_length=0;
+            throw std::runtime_error("Cannot map "+path.string());
+        }
+        m_mapping=mapping;
+        std::memcpy(&m_header, m_mapping, sizeof(m_header));
+        try {
+            detail::checkSnapshotHeader<T>(m_header);
+            if (m_header.format!=SnapshotHeader::Raw) {
+                throw std::runtime_error("Only raw snapshots can be mapped");
+            }
+            if ((m_length-sizeof(SnapshotHeader))/sizeof(Node<T>)<m_header.count) {
+                throw std::runtime_error("Truncated snapshot");
+            }
+        } catch (...) {
+            release();
+            throw;
+        }
+        m_nodes=std::launder(reinterpret_cast<const Node<T>*>(static_cast<const char*>(m_mapping)+sizeof(SnapshotHeader)));
+#else
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            throw std::runtime_error("Cannot open "+path.string()+" for reading");
+        }
+        m_header=detail::readSnapshotHeader<T>(in);
+        if (m_header.format!=SnapshotHeader::Raw) {
+            throw std::runtime_error("Only raw snapshots can be mapped");
+        }
+        detail::readSnapshotNodes<T>(in, m_header, m_buffer, static_cast<size_t>(m_header.count));
+        m_nodes=m_buffer.data();
+#endif
+    }
+
+    /**
+     * \brief Unmaps the file.
+     */
+    ~MappedSnapshot() {
+        release();
+    }
+
+    /**
+     * \brief Move operations, the mapping has a single owner.
+     */
+    MappedSnapshot(MappedSnapshot&& other) noexcept : m_header(other.m_header), m_nodes(std::exchange(other.m_nodes, nullptr))
+#if defined(KP_SNAPSHOT_MMAP)
+        , m_mapping(std::exchange(other.m_mapping, nullptr)), m_length(std::exchange(other.m_length, 0))
+#else
+        , m_buffer(std::move(other.m_buffer))
+#endif
+    {}
+
+    MappedSnapshot& operator=(MappedSnapshot&& other) noexcept {
+        if (this!=&other) {
+            release();
+            m_header=other.m_header;
+            m_nodes=std::exchange(other.m_nodes, nullptr);
+#if defined(KP_SNAPSHOT_MMAP)
+            m_mapping=std::exchange(other.m_mapping, nullptr);
+            m_length=std::exchange(other.m_length, 0);
+#else
+            m_buffer=std::move(other.m_buffer);
+#endif
+        }
+        return *this;
+    }
+
+    MappedSnapshot(const MappedSnapshot&)=delete;
+    MappedSnapshot& operator=(const MappedSnapshot&)=delete;
+
+    /**
+     * \brief Gets the nodes in the order the saved queue kept them.
+     * \return View of the nodes, valid while the snapshot is alive.
+     */
+    std::span<const Node<T>> nodes() const {
+        return std::span<const Node<T>>(m_nodes, static_cast<size_t>(m_header.count));
+    }
+
+    /**
+     * \brief Gets the number of elements in the snapshot.
+     * \return Number of nodes.
+     */
+    size_t size() const {
+        return static_cast<size_t>(m_header.count);
+    }
+
+    /**
+     * \brief Gets the identifier the saved queue would have given its next element.
+     * \return Next identifier.
+     */
+    size_t currentId() const {
+        return static_cast<size_t>(m_header.currentId);
+    }
+
+    /**
+     * \brief Gets the maximum size of the saved queue.
+     * \return Maximum size, SIZE_MAX if the queue was unbounded.
+     */
+    size_t maxSize() const {
+        return static_cast<size_t>(m_header.maxSize);
+    }
+
+    /**
+     * \brief Replaces the contents of a queue with the snapshot.
+     *
+     * Copies the nodes with one sequential pass over the mapping and, like
+     * loadSnapshot, only reorders them if the queue uses another storage. The
+     * queue is left unchanged if this throws.
+     *
+     * \param queue - BasicPriorityQueue of T with NodeCompare, e.g. a
+     *        BoundedPriorityQueue or DAryHeapPriorityQueue.
+     */
+    template <typename Queue>
+    void loadInto(Queue& queue) const {
+        static_assert(std::is_same_v<detail::SnapshotValue<Queue>, T>, "The queue must hold the value type of the snapshot");
+#if defined(KP_SNAPSHOT_MMAP)
+        ::madvise(m_mapping, m_length, MADV_SEQUENTIAL);
+#endif
+        auto& target=detail::SnapshotAccess::nodes(queue);
+        std::span<const Node<T>> source=nodes();
+        std::remove_reference_t<decltype(target)> loaded(source.begin(), source.end(), target.get_allocator());
+        detail::SnapshotAccess::restore(queue, m_header, loaded);
+    }
+};
+
+}
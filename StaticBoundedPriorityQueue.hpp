@@ -0,0 +1,318 @@
+#pragma once
+#include "PriorityQueue.hpp"
+#include "StoragePolicies.hpp"
+#include "ErrorPolicies.hpp"
+#include <array>
+#include <climits>
+
+namespace kp {
+
+/**
+ * \brief A bounded priority queue with a fixed capacity stored inline.
+ *
+ * The nodes live in a std::array inside the object, so the queue never
+ * allocates on its own and a queue on the stack touches no heap at all. It is
+ * meant for small top-K selections on latency-critical paths, where N is a
+ * compile-time constant such as 10. Insert, eviction and pop follow the same
+ * rules as BoundedPriorityQueue.
+ *
+ * Unused slots hold default-constructed nodes, so T has to be default
+ * constructible. With N around 16 or less, SortedStorage is often faster than
+ * the default min-max heap.
+ *
+ * \tparam T The type of the elements in the queue.
+ * \tparam N Maximum number of elements.
+ * \tparam Storage Layout of the elements, MinMaxHeapStorage or SortedStorage.
+ * \tparam ErrorPolicy Reaction to pop() on an empty queue.
+ */
+template <typename T, size_t N, typename Storage = MinMaxHeapStorage, typename ErrorPolicy = PrintErrors>
+class StaticBoundedPriorityQueue {
+private:
+    std::array<Node<T>, N> m_nodes;
+    size_t m_size=0;
+    size_t m_currentId=1;
+
+    /**
+     * \brief Gets the occupied slots as a container for the storage policy.
+     * \return View of the queued nodes.
+     */
+    std::span<Node<T>> occupied() {
+        return std::span<Node<T>>(m_nodes.data(), m_size);
+    }
+
+    std::span<const Node<T>> occupied() const {
+        return std::span<const Node<T>>(m_nodes.data(), m_size);
+    }
+
+    /**
+     * \brief Removes the node that Storage::popHighest moved to the back.
+     * \return Value of the removed node.
+     */
+    T takeBack() {
+        return m_nodes[--m_size].takeValue();
+    }
+
+public:
+    /**
+     * \brief Default constructor.
+     *
+     * Creates an empty queue.
+     */
+    StaticBoundedPriorityQueue()=default;
+
+    /**
+     * \brief Inserts a new element into the queue.
+     *
+     * If the queue is full, the lowest-priority element is replaced when the
+     * new element has a higher priority, and the new element is discarded
+     * otherwise.
+     *
+     * \param priority - priority of the element.
+     * \param value - value of the element.
+     */
+    void insert(int priority, const T& value) {
+        tryEmplace(priority, value);
+    }
+
+    /**
+     * \brief Inserts a new element into the queue by moving it.
+     * \param priority - priority of the element.
+     * \param value - value of the element.
+     */
+    void insert(int priority, T&& value) {
+        tryEmplace(priority, std::move(value));
+    }
+
+    /**
+     * \brief Constructs a new element directly in the queue.
+     *
+     * The value is only constructed if the element is accepted.
+     *
+     * \param priority - priority of the element.
+     * \param args - arguments forwarded to the constructor of the value.
+     */
+    template <typename... Args>
+    void emplace(int priority, Args&&... args) {
+        tryEmplace(priority, std::forward<Args>(args)...);
+    }
+
+    /**
+     * \brief Inserts a new element and reports what happened.
+     * \param priority - priority of the element.
+     * \param value - value of the element.
+     * \return Inserted, Evicted or Rejected.
+     */
+    InsertResult tryInsert(int priority, const T& value) {
+        return tryEmplace(priority, value);
+    }
+
+    /**
+     * \brief Inserts a new element by moving it and reports what happened.
+     * \param priority - priority of the element.
+     * \param value - value of the element.
+     * \return Inserted, Evicted or Rejected.
+     */
+    InsertResult tryInsert(int priority, T&& value) {
+        return tryEmplace(priority, std::move(value));
+    }
+
+    /**
+     * \brief Constructs a new element and reports what happened.
+     * \param priority - priority of the element.
+     * \param args - arguments forwarded to the constructor of the value.
+     * \return Inserted, Evicted or Rejected.
+     */
+    template <typename... Args>
+    InsertResult tryEmplace(int priority, Args&&... args) {
+        if (m_size<N) {
+            m_nodes[m_size++]=Node<T>(priority, m_currentId++, std::in_place, std::forward<Args>(args)...);
+            auto queue=occupied();
+            Storage::push(queue, NodeCompare());
+            return InsertResult::Inserted;
+        }
+        if (!wouldAccept(priority)) {
+            return InsertResult::Rejected;
+        }
+        auto queue=occupied();
+        auto lowest=Storage::lowest(queue, NodeCompare());
+        *lowest=Node<T>(priority, m_currentId++, std::in_place, std::forward<Args>(args)...);
+        Storage::replaced(queue, lowest, NodeCompare());
+        return InsertResult::Evicted;
+    }
+
+    /**
+     * \brief Checks if an element with the given priority would be kept.
+     * \param priority - priority of the element.
+     * \return True if insert() would keep the element.
+     */
+    bool wouldAccept(int priority) const {
+        return m_size<N || (m_size>0 && priority>threshold());
+    }
+
+    /**
+     * \brief Gets the priority a new element has to beat once the queue is full.
+     * \return Priority of the lowest element, or LLONG_MIN while the queue
+     *         still has room.
+     */
+    long long threshold() const {
+        if (m_size<N || m_size==0) {
+            return LLONG_MIN;
+        }
+        auto queue=occupied();
+        return Storage::lowest(queue, NodeCompare())->getPriority();
+    }
+
+    /**
+     * \brief Removes and returns the element with the highest priority.
+     *
+     * If the queue is empty, the error policy is notified and, unless it
+     * throws, the default element value is returned.
+     *
+     * \return The element with the highest priority.
+     */
+    T pop() {
+        if (m_size==0) {
+            ErrorPolicy::emptyPop();
+            return T();
+        }
+        auto queue=occupied();
+        Storage::popHighest(queue, NodeCompare());
+        return takeBack();
+    }
+
+    /**
+     * \brief Removes and returns the element with the highest priority, if any.
+     * \return The element with the highest priority, or std::nullopt.
+     */
+    std::optional<T> tryPop() {
+        if (m_size==0) {
+            return std::nullopt;
+        }
+        auto queue=occupied();
+        Storage::popHighest(queue, NodeCompare());
+        return takeBack();
+    }
+
+    /**
+     * \brief Removes up to n highest-priority elements.
+     * \param n - maximum number of elements to remove.
+     * \param out - output iterator receiving the values, highest first.
+     * \return Output iterator past the last written value.
+     */
+    template <typename OutputIt>
+    OutputIt popN(size_t n, OutputIt out) {
+        size_t count=std::min(n, m_size);
+        auto queue=occupied();
+        Storage::extractHighest(queue, count, NodeCompare());
+        for (size_t i=0; i<count; ++i) {
+            *out++=takeBack();
+        }
+        return out;
+    }
+
+    /**
+     * \brief Gets the element with the highest priority without removing it.
+     * \return Node with the highest priority, the queue must not be empty.
+     */
+    const Node<T>& top() const {
+        auto queue=occupied();
+        return *Storage::highest(queue, NodeCompare());
+    }
+
+    /**
+     * \brief Removes all elements.
+     */
+    void clear() {
+        while (m_size>0) {
+            m_nodes[--m_size]=Node<T>();
+        }
+    }
+
+    /**
+     * \brief Checks if the queue is empty.
+     * \return True if the queue is empty, false otherwise.
+     */
+    bool isEmpty() const {
+        return m_size==0;
+    }
+
+    /**
+     * \brief Gets the size of the queue.
+     * \return Number of elements in the queue.
+     */
+    size_t size() const {
+        return m_size;
+    }
+
+    /**
+     * \brief Gets the maximum size of the queue.
+     * \return N.
+     */
+    static constexpr size_t getMaxSize() {
+        return N;
+    }
+
+    /**
+     * \brief Prints the current state of the queue.
+     *
+     * Displays the contents of the queue to the standard output, from the
+     * highest to the lowest priority.
+     */
+    void printQueue() const {
+        if (m_size==0) {
+            std::cout<<"Queue is empty"<<std::endl;
+            return;
+        }
+        std::array<const Node<T>*, N> ordered;
+        for (const Node<T>* node : topK(ordered)) {
+            std::cout<<*node<<std::endl;
+        }
+    }
+
+    using const_iterator=typename std::array<Node<T>, N>::const_iterator;
+
+    /**
+     * \brief Gets an iterator to the first node in storage order.
+     *
+     * The nodes are visited in heap order, not in leave order. Iterators are
+     * invalidated by any change of the queue.
+     *
+     * \return Iterator to the first node.
+     */
+    const_iterator begin() const {
+        return m_nodes.begin();
+    }
+
+    /**
+     * \brief Gets an iterator past the last node in storage order.
+     * \return Iterator past the last node.
+     */
+    const_iterator end() const {
+        return m_nodes.begin()+m_size;
+    }
+
+    /**
+     * \brief Gets a read-only view of all nodes in storage order, without copying them.
+     * \return Span over the nodes, invalidated by any change of the queue.
+     */
+    std::span<const Node<T>> nodes() const {
+        return std::span<const Node<T>>(m_nodes.data(), m_size);
+    }
+
+    /**
+     * \brief Gets the highest nodes in leave order without removing them.
+     *
+     * Like the queue itself, the call never allocates: the pointers go to a
+     * caller-provided buffer, e.g. a std::array<const Node<T>*, N> on the
+     * stack.
+     *
+     * \param out - buffer for the pointers, its size is the number wanted.
+     * \return The filled front of out, highest priority first, invalidated
+     *         by any change of the queue.
+     */
+    std::span<const Node<T>*> topK(std::span<const Node<T>*> out) const {
+        return detail::highestNodes(nodes(), out, NodeCompare());
+    }
+};
+
+}
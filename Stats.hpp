@@ -0,0 +1,501 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#if !defined(KP_STATS_SAMPLE_RATE)
+#define KP_STATS_SAMPLE_RATE 64
+#endif
+
+namespace kp {
+
+/**
+ * \brief Operations with a latency histogram in QueueStats.
+ */
+enum class QueueOp {
+    Insert,
+    Pop,
+    Batch
+};
+
+/**
+ * \brief Histogram of latencies in nanoseconds with a bounded relative error.
+ *
+ * Works like an HDR histogram: values below 16 ns have a bucket each, and
+ * every power of two above is split into 16 buckets, so a bucket is at most
+ * 1/16 of its value wide and percentiles are within 6.25%. Values from 2^36
+ * ns, about 69 seconds, land in the last bucket. Recording is a bit scan and
+ * an increment, and the histogram takes about 4 KB.
+ */
+class LatencyHistogram {
+public:
+    static constexpr size_t SubBuckets=16;
+    static constexpr size_t MaxExponent=36;
+    static constexpr size_t BucketCount=(MaxExponent-3)*SubBuckets;
+
+private:
+    std::array<uint64_t, BucketCount> m_counts{};
+    uint64_t m_count=0;
+    uint64_t m_sum=0;
+    uint64_t m_min=UINT64_MAX;
+    uint64_t m_max=0;
+
+    /**
+     * \brief Maps a value to its bucket.
+     * \param value - latency in nanoseconds.
+     * \return Index of the bucket.
+     */
+    static size_t bucketOf(uint64_t value) {
+        if (value<SubBuckets) {
+            return static_cast<size_t>(value);
+        }
+        size_t exponent=static_cast<size_t>(std::bit_width(value))-1;
+        if (exponent>=MaxExponent) {
+            return BucketCount-1;
+        }
+        return (exponent-4)*SubBuckets+static_cast<size_t>(value>>(exponent-4));
+    }
+
+public:
+    /**
+     * \brief Gets the smallest value of a bucket.
+     * \param bucket - index of the bucket.
+     * \return Lower bound of the bucket in nanoseconds.
+     */
+    static uint64_t bucketLowerBound(size_t bucket) {
+        if (bucket<SubBuckets) {
+            return bucket;
+        }
+        size_t exponent=bucket/SubBuckets+3;
+        return static_cast<uint64_t>(bucket%SubBuckets+SubBuckets)<<(exponent-4);
+    }
+
+    /**
+     * \brief Gets the largest value of a bucket.
+     * \param bucket - index of the bucket.
+     * \return Upper bound of the bucket in nanoseconds.
+     */
+    static uint64_t bucketUpperBound(size_t bucket) {
+        if (bucket==BucketCount-1) {
+            return UINT64_MAX;
+        }
+        return bucketLowerBound(bucket+1)-1;
+    }
+
+    /**
+     * \brief Adds a value to the histogram.
+     * \param nanoseconds - measured latency.
+     */
+    void record(uint64_t nanoseconds) {
+        ++m_counts[bucketOf(nanoseconds)];
+        ++m_count;
+        m_sum+=nanoseconds;
+        m_min=std::min(m_min, nanoseconds);
+        m_max=std::max(m_max, nanoseconds);
+    }
+
+    /**
+     * \brief Adds the values of another histogram.
+     * \param other - histogram to merge, e.g. from another shard.
+     */
+    void merge(const LatencyHistogram& other) {
+        for (size_t i=0; i<BucketCount; ++i) {
+            m_counts[i]+=other.m_counts[i];
+        }
+        m_count+=other.m_count;
+        m_sum+=other.m_sum;
+        m_min=std::min(m_min, other.m_min);
+        m_max=std::max(m_max, other.m_max);
+    }
+
+    /**
+     * \brief Removes all values.
+     */
+    void reset() {
+        *this=LatencyHistogram();
+    }
+
+    /**
+     * \brief Gets the number of recorded values.
+     * \return Number of values.
+     */
+    uint64_t count() const {
+        return m_count;
+    }
+
+    /**
+     * \brief Gets the smallest recorded value.
+     * \return Minimum in nanoseconds, 0 if the histogram is empty.
+     */
+    uint64_t min() const {
+        return m_count==0 ? 0 : m_min;
+    }
+
+    /**
+     * \brief Gets the largest recorded value.
+     * \return Maximum in nanoseconds.
+     */
+    uint64_t max() const {
+        return m_max;
+    }
+
+    /**
+     * \brief Gets the mean of the recorded values.
+     * \return Mean in nanoseconds, 0 if the histogram is empty.
+     */
+    double mean() const {
+        return m_count==0 ? 0.0 : static_cast<double>(m_sum)/static_cast<double>(m_count);
+    }
+
+    /**
+     * \brief Gets the value below which a share of the recorded values fall.
+     * \param percentile - share in percent, e.g. 99.9.
+     * \return Upper bound of the bucket holding the percentile, capped at
+     *         max(), or 0 if the histogram is empty.
+     */
+    uint64_t valueAtPercentile(double percentile) const {
+        if (m_count==0) {
+            return 0;
+        }
+        double wanted=percentile/100.0*static_cast<double>(m_count);
+        uint64_t rank=std::max<uint64_t>(1, static_cast<uint64_t>(wanted+0.5));
+        uint64_t seen=0;
+        for (size_t i=0; i<BucketCount; ++i) {
+            seen+=m_counts[i];
+            if (seen>=rank) {
+                return std::min(bucketUpperBound(i), m_max);
+            }
+        }
+        return m_max;
+    }
+
+    /**
+     * \brief Calls a function for every non-empty bucket, from the lowest.
+     * \param visit - called as visit(lowerBound, upperBound, count).
+     */
+    template <typename Visitor>
+    void forEachBucket(Visitor&& visit) const {
+        for (size_t i=0; i<BucketCount; ++i) {
+            if (m_counts[i]!=0) {
+                visit(bucketLowerBound(i), bucketUpperBound(i), m_counts[i]);
+            }
+        }
+    }
+};
+
+class QueueStats;
+
+namespace detail {
+
+    /**
+     * \brief Records the time until it goes out of scope.
+     *
+     * A timer without stats is not sampled and reads no clock.
+     */
+    class StatsTimer {
+    private:
+        QueueStats* m_stats;
+        QueueOp m_op;
+        std::chrono::steady_clock::time_point m_start;
+
+    public:
+        StatsTimer(QueueStats* stats, QueueOp op) : m_stats(stats), m_op(op) {
+            if (m_stats!=nullptr) [[unlikely]] {
+                m_start=std::chrono::steady_clock::now();
+            }
+        }
+        StatsTimer(const StatsTimer&)=delete;
+        StatsTimer& operator=(const StatsTimer&)=delete;
+        inline ~StatsTimer();
+    };
+
+}
+
+/**
+ * \brief Counters and latency histograms of one queue.
+ *
+ * The queues fill it only when KP_ENABLE_STATS is defined. The macro must be
+ * set the same way in every translation unit, since it changes the layout
+ * of the queues. Without it the queues keep an empty placeholder, record
+ * nothing and stats() returns an object that stays at zero.
+ *
+ * Insert counters follow tryInsert(): accepted inserts are those that found
+ * room plus those that evicted another element. Batch inserts are counted by
+ * their net effect, so an element kept and evicted again within the same
+ * batch counts as rejected. Like the queue itself, the stats are not
+ * thread-safe; read them from the thread that uses the queue.
+ *
+ * Reading the clock costs more than most operations, so only one operation
+ * in KP_STATS_SAMPLE_RATE is timed, 64 by default. The counters see every
+ * operation. Define KP_STATS_SAMPLE_RATE as 1 to time them all.
+ */
+class QueueStats {
+private:
+    uint64_t m_inserts=0;
+    uint64_t m_accepted=0;
+    uint64_t m_evictions=0;
+    uint64_t m_rejections=0;
+    uint64_t m_pops=0;
+    uint64_t m_emptyPops=0;
+    size_t m_highWaterMark=0;
+    uint64_t m_timed=0;
+    std::array<LatencyHistogram, 3> m_latency;
+
+    static_assert(KP_STATS_SAMPLE_RATE>0 && (KP_STATS_SAMPLE_RATE&(KP_STATS_SAMPLE_RATE-1))==0, "KP_STATS_SAMPLE_RATE must be a power of two");
+
+public:
+    /**
+     * \brief Counts an insert that found room.
+     * \param size - number of elements after the insert.
+     */
+    void recordInserted(size_t size) {
+        ++m_inserts;
+        ++m_accepted;
+        m_highWaterMark=std::max(m_highWaterMark, size);
+    }
+
+    /**
+     * \brief Counts an insert that replaced the lowest element.
+     */
+    void recordEvicted() {
+        ++m_inserts;
+        ++m_accepted;
+        ++m_evictions;
+    }
+
+    /**
+     * \brief Counts an insert that was discarded.
+     */
+    void recordRejected() {
+        ++m_inserts;
+        ++m_rejections;
+    }
+
+    /**
+     * \brief Counts a batch insert.
+     * \param offered - number of elements in the batch.
+     * \param kept - number of them still queued afterwards.
+     * \param evicted - number of older elements removed for them.
+     * \param size - number of elements after the batch.
+     */
+    void recordBatch(size_t offered, size_t kept, size_t evicted, size_t size) {
+        m_inserts+=offered;
+        m_accepted+=kept;
+        m_evictions+=evicted;
+        m_rejections+=offered-kept;
+        m_highWaterMark=std::max(m_highWaterMark, size);
+    }
+
+    /**
+     * \brief Counts removed elements.
+     * \param count - number of elements removed.
+     */
+    void recordPops(size_t count) {
+        m_pops+=count;
+    }
+
+    /**
+     * \brief Counts a pop() on an empty queue.
+     */
+    void recordEmptyPop() {
+        ++m_emptyPops;
+    }
+
+    /**
+     * \brief Adds a latency to the histogram of an operation.
+     * \param op - measured operation.
+     * \param nanoseconds - measured latency.
+     */
+    void recordLatency(QueueOp op, uint64_t nanoseconds) {
+        m_latency[static_cast<size_t>(op)].record(nanoseconds);
+    }
+
+    /**
+     * \brief Starts measuring an operation, if it is sampled.
+     * \param op - operation to measure.
+     * \return Timer that records the latency when it is destroyed.
+     */
+    detail::StatsTimer time(QueueOp op) {
+        bool sampled=(m_timed++&(KP_STATS_SAMPLE_RATE-1))==0;
+        return detail::StatsTimer(sampled ? this : nullptr, op);
+    }
+
+    /**
+     * \brief Clears all counters and histograms.
+     */
+    void reset() {
+        *this=QueueStats();
+    }
+
+    /**
+     * \brief Gets the number of inserts, accepted or not.
+     * \return Number of inserts.
+     */
+    uint64_t insertCount() const {
+        return m_inserts;
+    }
+
+    /**
+     * \brief Gets the number of inserts that were kept.
+     * \return Inserts that found room or evicted an element.
+     */
+    uint64_t acceptedCount() const {
+        return m_accepted;
+    }
+
+    /**
+     * \brief Gets the number of elements evicted by inserts.
+     * \return Number of evictions.
+     */
+    uint64_t evictionCount() const {
+        return m_evictions;
+    }
+
+    /**
+     * \brief Gets the number of discarded inserts.
+     * \return Number of rejections.
+     */
+    uint64_t rejectionCount() const {
+        return m_rejections;
+    }
+
+    /**
+     * \brief Gets the number of removed elements.
+     * \return Elements returned by pop(), tryPop() and popN().
+     */
+    uint64_t popCount() const {
+        return m_pops;
+    }
+
+    /**
+     * \brief Gets the number of pop() calls on an empty queue.
+     * \return Number of empty pops, whatever the error policy did.
+     */
+    uint64_t emptyPopCount() const {
+        return m_emptyPops;
+    }
+
+    /**
+     * \brief Gets the largest size the queue has reached.
+     * \return High-water mark of the number of elements.
+     */
+    size_t highWaterMark() const {
+        return m_highWaterMark;
+    }
+
+    /**
+     * \brief Gets the latency histogram of an operation.
+     * \param op - operation.
+     * \return Histogram in nanoseconds.
+     */
+    const LatencyHistogram& latency(QueueOp op) const {
+        return m_latency[static_cast<size_t>(op)];
+    }
+
+    /**
+     * \brief Hands every counter and histogram to an exporter.
+     *
+     * The exporter is the bridge to a metrics pipeline. It needs
+     * counter(name, value), gauge(name, value) and histogram(name,
+     * histogram) members; names are snake_case and can be prefixed with the
+     * name of the queue.
+     *
+     * \param exporter - receives the values.
+     */
+    template <typename Exporter>
+    void exportTo(Exporter&& exporter) const {
+        exporter.counter(std::string_view("inserts"), m_inserts);
+        exporter.counter(std::string_view("accepted_inserts"), m_accepted);
+        exporter.counter(std::string_view("evictions"), m_evictions);
+        exporter.counter(std::string_view("rejections"), m_rejections);
+        exporter.counter(std::string_view("pops"), m_pops);
+        exporter.counter(std::string_view("empty_pops"), m_emptyPops);
+        exporter.gauge(std::string_view("high_water_mark"), static_cast<uint64_t>(m_highWaterMark));
+        exporter.histogram(std::string_view("insert_latency_ns"), latency(QueueOp::Insert));
+        exporter.histogram(std::string_view("pop_latency_ns"), latency(QueueOp::Pop));
+        exporter.histogram(std::string_view("batch_latency_ns"), latency(QueueOp::Batch));
+    }
+
+    /**
+     * \brief Gets an instance that stays at zero.
+     * \return Stats reported by queues built without KP_ENABLE_STATS.
+     */
+    static const QueueStats& empty() {
+        static const QueueStats stats;
+        return stats;
+    }
+};
+
+namespace detail {
+
+    StatsTimer::~StatsTimer() {
+        if (m_stats==nullptr) [[likely]] {
+            return;
+        }
+        auto elapsed=std::chrono::steady_clock::now()-m_start;
+        m_stats->recordLatency(m_op, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+
+    /**
+     * \brief Placeholder of QueueStats in queues built without KP_ENABLE_STATS.
+     *
+     * Every call compiles to nothing and the member takes no space.
+     */
+    struct NoStats {
+        struct Timer {};
+
+        void recordInserted(size_t) {}
+        void recordEvicted() {}
+        void recordRejected() {}
+        void recordBatch(size_t, size_t, size_t, size_t) {}
+        void recordPops(size_t) {}
+        void recordEmptyPop() {}
+
+        Timer time(QueueOp) {
+            return Timer();
+        }
+
+        void reset() {}
+
+        const QueueStats& get() const {
+            return QueueStats::empty();
+        }
+    };
+
+    /**
+     * \brief QueueStats that can be stored in a queue and read back with get().
+     */
+    struct ActiveStats : QueueStats {
+        const QueueStats& get() const {
+            return *this;
+        }
+    };
+
+#if defined(KP_ENABLE_STATS)
+    inline constexpr bool statsEnabled=true;
+    using StatsSlot=ActiveStats;
+#else
+    inline constexpr bool statsEnabled=false;
+    using StatsSlot=NoStats;
+#endif
+
+    /**
+     * \brief Counts the nodes a batch added, by their identifiers.
+     * \param queue - nodes after the batch.
+     * \param firstId - first identifier handed out by the batch.
+     * \return Number of nodes with an identifier from firstId on.
+     */
+    template <typename Container>
+    size_t countNewNodes(const Container& queue, size_t firstId) {
+        return static_cast<size_t>(std::count_if(queue.begin(), queue.end(), [firstId](const auto& node) {
+            return node.getId()>=firstId;
+        }));
+    }
+
+}
+
+}
@@ -0,0 +1,583 @@
+#pragma once
+#include "MinMaxHeap.hpp"
+#include "DAryHeap.hpp"
+#include "Simd.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+
+namespace kp {
+
+struct NodeCompare;
+
+namespace detail {
+
+    /**
+     * \brief Decides how to add a batch of elements to a heap.
+     *
+     * \param oldSize - number of elements before the batch was appended.
+     * \param newSize - number of elements including the batch.
+     * \return True if heapifying everything is cheaper than pushing the batch.
+     */
+    inline bool rebuildIsCheaper(size_t oldSize, size_t newSize) {
+        size_t depth=1;
+        for (size_t n=newSize; n>1; n>>=1) {
+            ++depth;
+        }
+        return (newSize-oldSize)*depth>=newSize;
+    }
+
+    /**
+     * \brief Moves the count highest elements of a heap to its back.
+     *
+     * Small counts are popped one by one. Large counts are selected with
+     * std::nth_element and sorted, and the rest of the heap is rebuilt once,
+     * after which every element is reported to onMove.
+     *
+     * \param queue - container.
+     * \param count - number of elements to move, at most the size.
+     * \param comp - comparator of the queue.
+     * \param popHeap - pops the highest element of a range to its end and
+     *        reports the moved elements itself.
+     * \param makeHeap - arranges a range into a heap.
+     * \param onMove - called for every element that changes its position.
+     */
+    template <typename Container, typename Compare, typename PopHeap, typename MakeHeap, typename OnMove>
+    void extractHighestFromHeap(Container& queue, size_t count, Compare comp, PopHeap popHeap, MakeHeap makeHeap, OnMove& onMove) {
+        size_t rest=queue.size()-count;
+        if (!rebuildIsCheaper(rest, queue.size())) {
+            for (size_t end=queue.size(); end>rest; --end) {
+                popHeap(queue.begin(), queue.begin()+end);
+            }
+            return;
+        }
+        auto later=[comp](const auto& a, const auto& b) { return comp(b, a); };
+        auto middle=queue.begin()+rest;
+        if (rest>0) {
+            std::nth_element(queue.begin(), middle, queue.end(), later);
+        }
+        std::sort(middle, queue.end(), later);
+        makeHeap(queue.begin(), middle);
+        if constexpr (!std::is_same_v<OnMove, IgnoreMove>) {
+            for (size_t i=0; i<queue.size(); ++i) {
+                onMove(queue[i], i);
+            }
+        }
+    }
+
+    /**
+     * \brief Reports every element of a range to an onMove callback.
+     * \param queue - container.
+     * \param first - position of the first moved element.
+     * \param last - position past the last moved element.
+     * \param onMove - called for every element in [first, last).
+     */
+    template <typename Container, typename OnMove>
+    void reportMoves(Container& queue, size_t first, size_t last, OnMove& onMove) {
+        if constexpr (!std::is_same_v<OnMove, IgnoreMove>) {
+            for (size_t i=first; i<last; ++i) {
+                onMove(queue[i], i);
+            }
+        }
+    }
+
+}
+
+/**
+ * \brief Storage layout that keeps the elements in a min-max heap.
+ *
+ * Insert, eviction of the lowest element and pop of the highest element all
+ * run in O(log n). This is the default layout of BoundedPriorityQueue.
+ *
+ * Every function takes the container holding the nodes and a comparator that
+ * returns true when its first argument leaves the queue before the second.
+ * The functions that move single elements also take an optional onMove
+ * callback, called as onMove(element, index) for every element that changes
+ * its position, so a lookup index can follow the elements.
+ */
+struct MinMaxHeapStorage {
+    /**
+     * \brief Adds the element that was just appended to the container.
+     * \param queue - container, the new element is at its back.
+     * \param comp - comparator of the queue.
+     * \param onMove - called for every element that changes its position.
+     */
+    template <typename Container, typename Compare, typename OnMove = detail::IgnoreMove>
+    static void push(Container& queue, Compare comp, OnMove onMove = OnMove()) {
+        pushMinMaxHeap(queue.begin(), queue.end(), comp, onMove);
+    }
+
+    /**
+     * \brief Arranges arbitrary elements into the layout in O(n).
+     * \param queue - container.
+     * \param comp - comparator of the queue.
+     */
+    template <typename Container, typename Compare>
+    static void build(Container& queue, Compare comp) {
+        makeMinMaxHeap(queue.begin(), queue.end(), comp);
+    }
+
+    /**
+     * \brief Adds a batch of elements that was just appended to the container.
+     * \param queue - container, the new elements are at its back.
+     * \param oldSize - number of elements before the batch was appended.
+     * \param comp - comparator of the queue.
+     */
+    template <typename Container, typename Compare>
+    static void append(Container& queue, size_t oldSize, Compare comp) {
+        if (detail::rebuildIsCheaper(oldSize, queue.size())) {
+            build(queue, comp);
+            return;
+        }
+        for (size_t i=oldSize+1; i<=queue.size(); ++i) {
+            pushMinMaxHeap(queue.begin(), queue.begin()+i, comp);
+        }
+    }
+
+    /**
+     * \brief Finds the element that leaves the queue first.
+     * \param queue - non-empty container.
+     * \return Iterator to the highest-priority element.
+     */
+    template <typename Container, typename Compare>
+    static auto highest(Container& queue, Compare) {
+        return queue.begin();
+    }
+
+    /**
+     * \brief Finds the element that leaves the queue last.
+     * \param queue - non-empty container.
+     * \param comp - comparator of the queue.
+     * \return Iterator to the lowest-priority element.
+     */
+    template <typename Container, typename Compare>
+    static auto lowest(Container& queue, Compare comp) {
+        return minMaxHeapLowest(queue.begin(), queue.end(), comp);
+    }
+
+    /**
+     * \brief Restores the layout after the element at pos was overwritten.
+     * \param queue - container.
+     * \param pos - position of the overwritten element.
+     * \param comp - comparator of the queue.
+     * \param onMove - called for every element that changes its position.
+     */
+    template <typename Container, typename Iterator, typename Compare, typename OnMove = detail::IgnoreMove>
+    static void replaced(Container& queue, Iterator pos, Compare comp, OnMove onMove = OnMove()) {
+        updateMinMaxHeap(queue.begin(), queue.end(), pos, comp, onMove);
+    }
+
+    /**
+     * \brief Moves the highest-priority element to the back of the container.
+     * \param queue - non-empty container.
+     * \param comp - comparator of the queue.
+     * \param onMove - called for every element that changes its position.
+     */
+    template <typename Container, typename Compare, typename OnMove = detail::IgnoreMove>
+    static void popHighest(Container& queue, Compare comp, OnMove onMove = OnMove()) {
+        popMinMaxHeapHighest(queue.begin(), queue.end(), comp, onMove);
+    }
+
+    /**
+     * \brief Moves the count highest elements to the back of the container.
+     *
+     * Afterwards the last element leaves first, the one before it second,
+     * and so on. The elements in front of them still form a valid layout.
+     *
+     * \param queue - container.
+     * \param count - number of elements to move, at most the size.
+     * \param comp - comparator of the queue.
+     * \param onMove - called for every element that changes its position.
+     */
+    template <typename Container, typename Compare, typename OnMove = detail::IgnoreMove>
+    static void extractHighest(Container& queue, size_t count, Compare comp, OnMove onMove = OnMove()) {
+        detail::extractHighestFromHeap(queue, count, comp,
+            [comp, &onMove](auto first, auto last) { popMinMaxHeapHighest(first, last, comp, std::ref(onMove)); },
+            [comp](auto first, auto last) { makeMinMaxHeap(first, last, comp); }, onMove);
+    }
+
+    /**
+     * \brief Drops the lowest-priority elements until newSize remain.
+     * \param queue - container.
+     * \param newSize - number of elements to keep.
+     * \param comp - comparator of the queue.
+     */
+    template <typename Container, typename Compare>
+    static void truncate(Container& queue, size_t newSize, Compare comp) {
+        while (queue.size()>newSize) {
+            popMinMaxHeapLowest(queue.begin(), queue.end(), comp);
+            queue.pop_back();
+        }
+    }
+};
+
+/**
+ * \brief Storage layout that keeps the elements sorted, highest at the back.
+ *
+ * Pop takes the last element, so it is O(1) and moves no other element,
+ * which makes this layout the better choice for consumers that mostly drain
+ * the queue. Insert and eviction find their position with a binary search and
+ * shift the elements in between once, without re-sorting; every shifted
+ * element is reported to onMove.
+ */
+struct SortedStorage {
+    /**
+     * \brief Adds the element that was just appended to the container.
+     * \param queue - container, the new element is at its back.
+     * \param comp - comparator of the queue.
+     * \param onMove - called for every element that changes its position.
+     */
+    template <typename Container, typename Compare, typename OnMove = detail::IgnoreMove>
+    static void push(Container& queue, Compare comp, OnMove onMove = OnMove()) {
+        auto last=queue.end()-1;
+        auto pos=std::upper_bound(queue.begin(), last, *last, later(comp));
+        std::rotate(pos, last, queue.end());
+        detail::reportMoves(queue, static_cast<size_t>(pos-queue.begin()), queue.size(), onMove);
+    }
+
+    /**
+     * \brief Sorts arbitrary elements into the layout in O(n log n).
+     * \param queue - container.
+     * \param comp - comparator of the queue.
+     */
+    template <typename Container, typename Compare>
+    static void build(Container& queue, Compare comp) {
+        std::sort(queue.begin(), queue.end(), later(comp));
+    }
+
+    /**
+     * \brief Adds a batch of elements that was just appended to the container.
+     *
+     * Sorts the batch on its own and merges it with the existing elements.
+     *
+     * \param queue - container, the new elements are at its back.
+     * \param oldSize - number of elements before the batch was appended.
+     * \param comp - comparator of the queue.
+     */
+    template <typename Container, typename Compare>
+    static void append(Container& queue, size_t oldSize, Compare comp) {
+        auto middle=queue.begin()+oldSize;
+        std::sort(middle, queue.end(), later(comp));
+        std::inplace_merge(queue.begin(), middle, queue.end(), later(comp));
+    }
+
+    /**
+     * \brief Finds the element that leaves the queue first.
+     * \param queue - non-empty container.
+     * \return Iterator to the highest-priority element.
+     */
+    template <typename Container, typename Compare>
+    static auto highest(Container& queue, Compare) {
+        return queue.end()-1;
+    }
+
+    /**
+     * \brief Finds the element that leaves the queue last.
+     * \param queue - non-empty container.
+     * \return Iterator to the lowest-priority element.
+     */
+    template <typename Container, typename Compare>
+    static auto lowest(Container& queue, Compare) {
+        return queue.begin();
+    }
+
+    /**
+     * \brief Restores the order after the element at pos was overwritten.
+     * \param queue - container.
+     * \param pos - position of the overwritten element.
+     * \param comp - comparator of the queue.
+     * \param onMove - called for every element that changes its position.
+     */
+    template <typename Container, typename Iterator, typename Compare, typename OnMove = detail::IgnoreMove>
+    static void replaced(Container& queue, Iterator pos, Compare comp, OnMove onMove = OnMove()) {
+        auto index=static_cast<size_t>(pos-queue.begin());
+        auto after=std::upper_bound(pos+1, queue.end(), *pos, later(comp));
+        if (after!=pos+1) {
+            std::rotate(pos, pos+1, after);
+            detail::reportMoves(queue, index, static_cast<size_t>(after-queue.begin()), onMove);
+            return;
+        }
+        auto before=std::upper_bound(queue.begin(), pos, *pos, later(comp));
+        std::rotate(before, pos, pos+1);
+        detail::reportMoves(queue, static_cast<size_t>(before-queue.begin()), index+1, onMove);
+    }
+
+    /**
+     * \brief Moves the highest-priority element to the back of the container.
+     *
+     * The highest-priority element is already at the back, so nothing moves.
+     */
+    template <typename Container, typename Compare, typename OnMove = detail::IgnoreMove>
+    static void popHighest(Container&, Compare, OnMove = OnMove()) {}
+
+    /**
+     * \brief Moves the count highest elements to the back of the container.
+     *
+     * They are already there in the right order, so nothing moves.
+     */
+    template <typename Container, typename Compare, typename OnMove = detail::IgnoreMove>
+    static void extractHighest(Container&, size_t, Compare, OnMove = OnMove()) {}
+
+    /**
+     * \brief Drops the lowest-priority elements until newSize remain.
+     * \param queue - container.
+     * \param newSize - number of elements to keep.
+     * \param comp - comparator of the queue.
+     */
+    template <typename Container, typename Compare>
+    static void truncate(Container& queue, size_t newSize, Compare) {
+        if (queue.size()>newSize) {
+            queue.erase(queue.begin(), queue.begin()+(queue.size()-newSize));
+        }
+    }
+
+private:
+    /**
+     * \brief Turns the queue comparator into the ascending order of storage.
+     * \param comp - comparator of the queue.
+     * \return Comparator that is true if the first argument leaves later.
+     */
+    template <typename Compare>
+    static auto later(Compare comp) {
+        return [comp](const auto& a, const auto& b) { return comp(b, a); };
+    }
+};
+
+/**
+ * \brief Storage layout that keeps the elements in a d-ary heap.
+ *
+ * Only the highest-priority element can be found quickly, so this layout is
+ * meant for unbounded queues. Insert and pop run in O(log n).
+ *
+ * \tparam Arity Number of children of every heap node.
+ */
+template <size_t Arity>
+struct DAryHeapStorage {
+    static_assert(Arity>=2, "A heap needs at least two children per node");
+
+    /**
+     * \brief Adds the element that was just appended to the container.
+     * \param queue - container, the new element is at its back.
+     * \param comp - comparator of the queue.
+     * \param onMove - called for every element that changes its position.
+     */
+    template <typename Container, typename Compare, typename OnMove = detail::IgnoreMove>
+    static void push(Container& queue, Compare comp, OnMove onMove = OnMove()) {
+        pushDAryHeap<Arity>(queue.begin(), queue.end(), comp, onMove);
+    }
+
+    /**
+     * \brief Arranges arbitrary elements into the layout in O(n).
+     * \param queue - container.
+     * \param comp - comparator of the queue.
+     */
+    template <typename Container, typename Compare>
+    static void build(Container& queue, Compare comp) {
+        makeDAryHeap<Arity>(queue.begin(), queue.end(), comp);
+    }
+
+    /**
+     * \brief Adds a batch of elements that was just appended to the container.
+     * \param queue - container, the new elements are at its back.
+     * \param oldSize - number of elements before the batch was appended.
+     * \param comp - comparator of the queue.
+     */
+    template <typename Container, typename Compare>
+    static void append(Container& queue, size_t oldSize, Compare comp) {
+        if (detail::rebuildIsCheaper(oldSize, queue.size())) {
+            build(queue, comp);
+            return;
+        }
+        for (size_t i=oldSize+1; i<=queue.size(); ++i) {
+            pushDAryHeap<Arity>(queue.begin(), queue.begin()+i, comp);
+        }
+    }
+
+    /**
+     * \brief Finds the element that leaves the queue first.
+     * \param queue - non-empty container.
+     * \return Iterator to the highest-priority element.
+     */
+    template <typename Container, typename Compare>
+    static auto highest(Container& queue, Compare) {
+        return queue.begin();
+    }
+
+    /**
+     * \brief Moves the highest-priority element to the back of the container.
+     * \param queue - non-empty container.
+     * \param comp - comparator of the queue.
+     * \param onMove - called for every element that changes its position.
+     */
+    template <typename Container, typename Compare, typename OnMove = detail::IgnoreMove>
+    static void popHighest(Container& queue, Compare comp, OnMove onMove = OnMove()) {
+        popDAryHeap<Arity>(queue.begin(), queue.end(), comp, onMove);
+    }
+
+    /**
+     * \brief Moves the count highest elements to the back of the container.
+     *
+     * Afterwards the last element leaves first, the one before it second,
+     * and so on. The elements in front of them still form a valid layout.
+     *
+     * \param queue - container.
+     * \param count - number of elements to move, at most the size.
+     * \param comp - comparator of the queue.
+     * \param onMove - called for every element that changes its position.
+     */
+    template <typename Container, typename Compare, typename OnMove = detail::IgnoreMove>
+    static void extractHighest(Container& queue, size_t count, Compare comp, OnMove onMove = OnMove()) {
+        detail::extractHighestFromHeap(queue, count, comp,
+            [comp, &onMove](auto first, auto last) { popDAryHeap<Arity>(first, last, comp, std::ref(onMove)); },
+            [comp](auto first, auto last) { makeDAryHeap<Arity>(first, last, comp); }, onMove);
+    }
+};
+
+namespace detail {
+
+    /**
+     * \brief Keeps only the count elements that leave the queue first.
+     *
+     * Runs in O(n) with std::nth_element. The remaining elements are in no
+     * particular order, so the layout has to be built again afterwards.
+     *
+     * \param queue - container.
+     * \param count - number of elements to keep.
+     * \param comp - comparator of the queue.
+     */
+    template <typename Container, typename Compare>
+    void keepHighest(Container& queue, size_t count, Compare comp) {
+        if (queue.size()>count) {
+            std::nth_element(queue.begin(), queue.begin()+count, queue.end(), comp);
+            queue.erase(queue.begin()+count, queue.end());
+        }
+    }
+
+    /**
+     * \brief Appends a range of (priority, value) pairs to an unbounded queue.
+     *
+     * \tparam Storage Layout of the elements.
+     * \param queue - container of the queue.
+     * \param currentId - identifier counter of the queue.
+     * \param first - beginning of the range.
+     * \param last - end of the range.
+     * \param compare - ordering of the queue.
+     * \return Number of elements read from the range.
+     */
+    template <typename Storage, typename Container, typename InputIt, typename Compare>
+    size_t insertRange(Container& queue, size_t& currentId, InputIt first, InputIt last, Compare compare) {
+        using Category=typename std::iterator_traits<InputIt>::iterator_category;
+        if constexpr (std::is_base_of_v<std::forward_iterator_tag, Category>) {
+            queue.reserve(queue.size()+static_cast<size_t>(std::distance(first, last)));
+        }
+        size_t oldSize=queue.size();
+        for (; first!=last; ++first) {
+            auto&& element=*first;
+            queue.emplace_back(element.first, std::forward<decltype(element)>(element).second, currentId++);
+        }
+        Storage::append(queue, oldSize, compare);
+        return queue.size()-oldSize;
+    }
+
+    /**
+     * \brief Inserts a range of (priority, value) pairs into a bounded queue.
+     *
+     * The result is the same as inserting the elements one by one. Candidates
+     * are collected unordered and cut back to maxSize with keepHighest whenever
+     * twice that many have piled up, so memory stays O(maxSize) and the whole
+     * batch costs O(n + k log k). Once the queue is full, elements that cannot
+     * beat its lowest element are skipped before their value is copied.
+     *
+     * With random-access input and the default ordering, a full queue gathers
+     * the priorities of each block of 256 elements and filters them against
+     * its lowest priority with selectAbove(), so only the survivors are
+     * looked at one by one.
+     *
+     * Every element is counted as it is read, so the result is exact for
+     * single-pass input such as an istream_iterator, skipped elements
+     * included.
+     *
+     * \tparam Storage Layout of the elements.
+     * \param queue - container of the queue.
+     * \param maxSize - maximum size of the queue.
+     * \param currentId - identifier counter of the queue.
+     * \param first - beginning of the range.
+     * \param last - end of the range.
+     * \param compare - ordering of the queue, providing before().
+     * \return Number of elements read from the range.
+     */
+    template <typename Storage, typename Container, typename InputIt, typename Compare>
+    size_t insertRange(Container& queue, size_t maxSize, size_t& currentId, InputIt first, InputIt last, Compare compare) {
+        if (maxSize==0) {
+            return static_cast<size_t>(std::distance(first, last));
+        }
+        size_t offered=0;
+        size_t oldSize=queue.size();
+        size_t limit=maxSize>SIZE_MAX/2 ? SIZE_MAX : 2*maxSize;
+        bool full=oldSize>=maxSize;
+        bool trimmed=false;
+        auto lowest=full ? Storage::lowest(queue, compare) : queue.end();
+        using Key=decltype(lowest->getPriority());
+        Key lowestPriority=full ? lowest->getPriority() : Key();
+        size_t lowestId=full ? lowest->getId() : 0;
+
+        auto place=[&](auto&& element) {
+            if (full && !compare.before(element.first, currentId, lowestPriority, lowestId)) {
+                return;
+            }
+            queue.emplace_back(element.first, std::forward<decltype(element)>(element).second, currentId++);
+            if (queue.size()>=limit) {
+                keepHighest(queue, maxSize, compare);
+                auto kept=std::max_element(queue.begin(), queue.end(), compare);
+                lowestPriority=kept->getPriority();
+                lowestId=kept->getId();
+                full=true;
+                trimmed=true;
+            }
+        };
+
+        using Category=typename std::iterator_traits<InputIt>::iterator_category;
+        if constexpr (std::is_base_of_v<std::random_access_iterator_tag, Category> && std::is_same_v<Compare, NodeCompare>) {
+            constexpr size_t Block=256;
+            int priorities[Block];
+            uint32_t selected[Block];
+            while (first!=last) {
+                size_t n=std::min<size_t>(Block, static_cast<size_t>(last-first));
+                if (!full) {
+                    for (size_t i=0; i<n; ++i) {
+                        place(first[i]);
+                    }
+                } else {
+                    for (size_t i=0; i<n; ++i) {
+                        priorities[i]=first[i].first;
+                    }
+                    size_t count=selectAbove(std::span<const int>(priorities, n), lowestPriority, selected);
+                    for (size_t i=0; i<count; ++i) {
+                        place(first[selected[i]]);
+                    }
+                }
+                first+=n;
+                offered+=n;
+            }
+        } else {
+            for (; first!=last; ++first) {
+                place(*first);
+                ++offered;
+            }
+        }
+
+        if (!trimmed && queue.size()<=maxSize) {
+            Storage::append(queue, oldSize, compare);
+            return offered;
+        }
+        keepHighest(queue, maxSize, compare);
+        Storage::build(queue, compare);
+        return offered;
+    }
+
+}
+
+}
@@ -0,0 +1,637 @@
+#pragma once
+#include "ErrorPolicies.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <climits>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+namespace kp {
+
+/**
+ * \brief Handle of a timer in a TimerWheelPriorityQueue.
+ *
+ * Handles stay cheap to copy and store. A handle whose timer has left the
+ * queue never matches a later timer, even if the slot of the timer is reused.
+ */
+struct TimerHandle {
+    uint32_t entry=UINT32_MAX;
+    uint32_t generation=0;
+
+    bool operator==(const TimerHandle&) const=default;
+};
+
+/**
+ * \brief Deadline queue backed by a hierarchical timer wheel.
+ *
+ * Meant for schedulers that use the priority as an expiry tick. Unlike the
+ * other engines, the lowest priority, i.e. the earliest deadline, leaves
+ * first. The queue keeps a current tick, and a timer lives in one of six
+ * wheels of 64 slots; the wheel is given by the highest 6-bit digit in which
+ * its deadline differs from the current tick. Insert and cancel touch one
+ * linked list of a slot and one bit of a 64-bit occupancy mask, so both run
+ * in O(1) no matter how many timers are pending. When the current tick moves
+ * into the range of an outer slot, the timers of that slot are redistributed
+ * to the inner wheels, at most five times per timer, so pop and popExpired()
+ * are O(1) amortized per timer plus a bit scan per wheel.
+ *
+ * Timers leave by deadline, and timers with the same deadline leave in
+ * insertion order, exactly like a plain queue of the lowest priority. The
+ * current tick only moves forward: popExpired() sets it and pop() moves it
+ * towards the deadline it returns. A timer inserted with a deadline before
+ * the current tick is late; it goes to a small binary heap instead of the
+ * wheels, which makes its insert and cancel O(log L) for L late timers. Late
+ * timers are earlier than every timer on the wheels and leave first.
+ *
+ * Timers live in one pool of entries with 32-bit links, so a timer costs its
+ * value plus 20 bytes, and freed entries are reused by later inserts. The
+ * links limit a queue to 2^32 - 1 pending timers; inserts beyond that throw
+ * std::length_error.
+ *
+ * \tparam T The type of the elements in the queue.
+ * \tparam ErrorPolicy Reaction to pop() on an empty queue.
+ */
+template <typename T, typename ErrorPolicy = PrintErrors>
+class TimerWheelPriorityQueue {
+public:
+    using Handle=TimerHandle;
+
+    static constexpr size_t Levels=6;
+    static constexpr size_t SlotBits=6;
+    static constexpr size_t Slots=size_t(1)<<SlotBits;
+
+private:
+    static constexpr uint32_t None=UINT32_MAX;
+    static constexpr uint16_t Free=UINT16_MAX;
+    static constexpr uint16_t Late=UINT16_MAX-1;
+
+    struct Entry {
+        T value;
+        uint32_t tick;
+        uint32_t prev;
+        uint32_t next;
+        uint32_t generation;
+        uint16_t slot;
+    };
+
+    struct Slot {
+        uint32_t head=None;
+        uint32_t tail=None;
+    };
+
+    /**
+     * \brief Timer with a deadline before the current tick.
+     *
+     * The entry's prev field holds the position of the timer in m_late.
+     */
+    struct LateTimer {
+        uint32_t tick;
+        uint32_t entry;
+        uint64_t sequence;
+
+        bool before(const LateTimer& other) const {
+            return tick!=other.tick ? tick<other.tick : sequence<other.sequence;
+        }
+    };
+
+    std::vector<Entry> m_entries;
+    std::array<Slot, Levels*Slots> m_slots{};
+    std::array<uint64_t, Levels> m_occupied{};
+    std::vector<LateTimer> m_late;
+    uint64_t m_lateSequence=0;
+    uint32_t m_now;
+    uint32_t m_freeEntries=None;
+    size_t m_size=0;
+
+    /**
+     * \brief Maps a priority to an unsigned tick with the same order.
+     */
+    static constexpr uint32_t toTick(int priority) {
+        return static_cast<uint32_t>(priority)^0x80000000u;
+    }
+
+    static constexpr int toPriority(uint32_t tick) {
+        return static_cast<int>(tick^0x80000000u);
+    }
+
+    static constexpr uint32_t digit(uint32_t tick, size_t level) {
+        return (tick>>(level*SlotBits))&(Slots-1);
+    }
+
+    /**
+     * \brief Finds the slot a deadline belongs to for the current tick.
+     * \param tick - deadline of a timer, not before the current tick.
+     * \return Index of the slot in m_slots.
+     */
+    uint16_t slotOf(uint32_t tick) const {
+        uint32_t difference=tick^m_now;
+        size_t level=difference==0 ? 0 : (static_cast<size_t>(std::bit_width(difference))-1)/SlotBits;
+        return static_cast<uint16_t>(level*Slots+digit(tick, level));
+    }
+
+    void placeLate(size_t position) {
+        m_entries[m_late[position].entry].prev=static_cast<uint32_t>(position);
+    }
+
+    void siftUpLate(size_t position) {
+        while (position>0) {
+            size_t parent=(position-1)/2;
+            if (!m_late[position].before(m_late[parent])) {
+                break;
+            }
+            std::swap(m_late[position], m_late[parent]);
+            placeLate(position);
+            position=parent;
+        }
+        placeLate(position);
+    }
+
+    void siftDownLate(size_t position) {
+        for (;;) {
+            size_t best=position;
+            for (size_t child=2*position+1; child<=2*position+2 && child<m_late.size(); ++child) {
+                if (m_late[child].before(m_late[best])) {
+                    best=child;
+                }
+            }
+            if (best==position) {
+                break;
+            }
+            std::swap(m_late[position], m_late[best]);
+            placeLate(position);
+            position=best;
+        }
+        placeLate(position);
+    }
+
+    /**
+     * \brief Removes a timer from the heap of late timers.
+     * \param position - position of the timer in m_late.
+     */
+    void removeLate(size_t position) {
+        m_late[position]=m_late.back();
+        m_late.pop_back();
+        if (position>=m_late.size()) {
+            return;
+        }
+        if (position>0 && m_late[position].before(m_late[(position-1)/2])) {
+            siftUpLate(position);
+        } else {
+            siftDownLate(position);
+        }
+    }
+
+    /**
+     * \brief Makes sure a late timer can be added without allocating.
+     *
+     * Called before an entry is taken from the pool, so a failed allocation
+     * leaves no entry behind.
+     *
+     * \param tick - deadline of the timer about to be inserted.
+     */
+    void reserveLate(uint32_t tick) {
+        if (tick<m_now && m_late.size()==m_late.capacity()) {
+            m_late.reserve(std::max<size_t>(16, 2*m_late.capacity()));
+        }
+    }
+
+    /**
+     * \brief Appends an entry to the list of its slot, or to the late heap.
+     * \param index - index of the entry.
+     */
+    void link(uint32_t index) {
+        Entry& entry=m_entries[index];
+        if (entry.tick<m_now) {
+            entry.slot=Late;
+            m_late.push_back(LateTimer{entry.tick, index, m_lateSequence++});
+            siftUpLate(m_late.size()-1);
+            return;
+        }
+        entry.slot=slotOf(entry.tick);
+        Slot& slot=m_slots[entry.slot];
+        entry.prev=slot.tail;
+        entry.next=None;
+        if (slot.tail==None) {
+            slot.head=index;
+            m_occupied[entry.slot/Slots]|=uint64_t(1)<<(entry.slot%Slots);
+        } else {
+            m_entries[slot.tail].next=index;
+        }
+        slot.tail=index;
+    }
+
+    /**
+     * \brief Removes an entry from the list of its slot.
+     * \param index - index of the entry.
+     */
+    void unlink(uint32_t index) {
+        Entry& entry=m_entries[index];
+        if (entry.slot==Late) {
+            removeLate(entry.prev);
+            return;
+        }
+        Slot& slot=m_slots[entry.slot];
+        if (entry.prev==None) {
+            slot.head=entry.next;
+        } else {
+            m_entries[entry.prev].next=entry.next;
+        }
+        if (entry.next==None) {
+            slot.tail=entry.prev;
+        } else {
+            m_entries[entry.next].prev=entry.prev;
+        }
+        if (slot.head==None) {
+            m_occupied[entry.slot/Slots]&=~(uint64_t(1)<<(entry.slot%Slots));
+        }
+    }
+
+    /**
+     * \brief Returns an entry to the pool and invalidates its handles.
+     * \param index - index of the unlinked entry.
+     */
+    void release(uint32_t index) {
+        Entry& entry=m_entries[index];
+        ++entry.generation;
+        entry.slot=Free;
+        entry.next=m_freeEntries;
+        m_freeEntries=index;
+        --m_size;
+    }
+
+    /**
+     * \brief Moves the timers of a slot to the wheels they belong to now.
+     *
+     * The timers keep their order, so equal deadlines still leave in
+     * insertion order.
+     *
+     * \param slot - index of the slot in m_slots.
+     */
+    void cascade(size_t slot) {
+        uint32_t index=m_slots[slot].head;
+        m_slots[slot]=Slot();
+        m_occupied[slot/Slots]&=~(uint64_t(1)<<(slot%Slots));
+        while (index!=None) {
+            uint32_t next=m_entries[index].next;
+            link(index);
+            index=next;
+        }
+    }
+
+    /**
+     * \brief Moves the current tick forward.
+     *
+     * No deadline on the wheels may lie before the new tick. Every
+     * outer slot the new tick falls into is cascaded, from the outermost
+     * wheel inwards.
+     *
+     * \param tick - new current tick, not below the old one.
+     */
+    void advanceTo(uint32_t tick) {
+        m_now=tick;
+        for (size_t level=Levels-1; level>0; --level) {
+            if (m_occupied[level]&(uint64_t(1)<<digit(tick, level))) {
+                cascade(level*Slots+digit(tick, level));
+            }
+        }
+    }
+
+    /**
+     * \brief Finds the innermost slot with the earliest deadlines.
+     *
+     * Moves the current tick to the start of outer slots and cascades them
+     * until the earliest timers sit in the inner wheel, but never past limit.
+     *
+     * \param limit - latest tick the search may move to.
+     * \return Index of the inner slot, or None if no timer is due by limit.
+     */
+    uint32_t nextSlot(uint32_t limit) {
+        while (m_size>0) {
+            uint32_t current=digit(m_now, 0);
+            uint64_t inner=m_occupied[0]&(~uint64_t(0)<<current);
+            if (inner!=0) {
+                uint32_t slot=static_cast<uint32_t>(std::countr_zero(inner));
+                uint32_t tick=(m_now&~uint32_t(Slots-1))|slot;
+                return tick<=limit ? slot : None;
+            }
+            size_t level=1;
+            uint64_t outer=0;
+            for (; level<Levels; ++level) {
+                outer=m_occupied[level]&(~uint64_t(1)<<digit(m_now, level));
+                if (outer!=0) {
+                    break;
+                }
+            }
+            if (level==Levels) {
+                return None;
+            }
+            uint32_t shift=static_cast<uint32_t>(level*SlotBits);
+            uint32_t high=shift+SlotBits>=32 ? 0 : m_now&~((uint32_t(1)<<(shift+SlotBits))-1);
+            uint32_t start=high|(static_cast<uint32_t>(std::countr_zero(outer))<<shift);
+            if (start>limit) {
+                return None;
+            }
+            advanceTo(start);
+        }
+        return None;
+    }
+
+    /**
+     * \brief Unlinks the first timer of an inner slot.
+     * \param slot - index of a non-empty slot of the inner wheel.
+     * \return Value of the removed timer.
+     */
+    T takeFront(uint32_t slot) {
+        uint32_t index=m_slots[slot].head;
+        unlink(index);
+        T value=std::move(m_entries[index].value);
+        release(index);
+        return value;
+    }
+
+    /**
+     * \brief Removes the earliest timer, late timers first.
+     * \return Value of the timer, or std::nullopt if the queue is empty.
+     */
+    std::optional<T> takeNext() {
+        if (!m_late.empty()) {
+            uint32_t index=m_late.front().entry;
+            unlink(index);
+            std::optional<T> value(std::move(m_entries[index].value));
+            release(index);
+            return value;
+        }
+        uint32_t slot=nextSlot(UINT32_MAX);
+        if (slot==None) {
+            return std::nullopt;
+        }
+        return takeFront(slot);
+    }
+
+    /**
+     * \brief Finds the timer that leaves next without moving the current tick.
+     * \return Index of the entry, the queue must not be empty.
+     */
+    uint32_t peekEntry() const {
+        if (!m_late.empty()) {
+            return m_late.front().entry;
+        }
+        uint64_t inner=m_occupied[0]&(~uint64_t(0)<<digit(m_now, 0));
+        if (inner!=0) {
+            return m_slots[static_cast<size_t>(std::countr_zero(inner))].head;
+        }
+        for (size_t level=1; level<Levels; ++level) {
+            uint64_t outer=m_occupied[level]&(~uint64_t(1)<<digit(m_now, level));
+            if (outer!=0) {
+                uint32_t best=None;
+                for (uint32_t index=m_slots[level*Slots+static_cast<size_t>(std::countr_zero(outer))].head; index!=None; index=m_entries[index].next) {
+                    if (best==None || m_entries[index].tick<m_entries[best].tick) {
+                        best=index;
+                    }
+                }
+                return best;
+            }
+        }
+        return None;
+    }
+
+public:
+    /**
+     * \brief Parameterized constructor.
+     *
+     * \param now - current tick. Deadlines before it are late, see the
+     *        class description.
+     */
+    explicit TimerWheelPriorityQueue(int now = INT_MIN) : m_now(toTick(now)) {}
+
+    /**
+     * \brief Inserts a new timer into the queue in O(1).
+     * \param deadline - expiry tick of the timer.
+     * \param value - value of the timer.
+     */
+    void insert(int deadline, const T& value) {
+        emplace(deadline, value);
+    }
+
+    /**
+     * \brief Inserts a new timer into the queue by moving its value.
+     * \param deadline - expiry tick of the timer.
+     * \param value - value of the timer.
+     */
+    void insert(int deadline, T&& value) {
+        emplace(deadline, std::move(value));
+    }
+
+    /**
+     * \brief Inserts a new timer and returns a handle to cancel it.
+     * \param deadline - expiry tick of the timer.
+     * \param value - value of the timer.
+     * \return Handle of the timer.
+     */
+    Handle push(int deadline, const T& value) {
+        return emplace(deadline, value);
+    }
+
+    /**
+     * \brief Inserts a new timer by moving its value and returns its handle.
+     * \param deadline - expiry tick of the timer.
+     * \param value - value of the timer.
+     * \return Handle of the timer.
+     */
+    Handle push(int deadline, T&& value) {
+        return emplace(deadline, std::move(value));
+    }
+
+    /**
+     * \brief Constructs a new timer directly in the queue.
+     * \param deadline - expiry tick of the timer.
+     * \param args - arguments forwarded to the constructor of the value.
+     * \return Handle of the timer.
+     * \throws std::length_error if the queue already holds 2^32 - 1 timers.
+     */
+    template <typename... Args>
+    Handle emplace(int deadline, Args&&... args) {
+        T value(std::forward<Args>(args)...);
+        uint32_t tick=toTick(deadline);
+        if (m_freeEntries==None && m_entries.size()>=None) {
+            throw std::length_error("TimerWheelPriorityQueue holds at most 2^32 - 1 timers");
+        }
+        reserveLate(tick);
+        uint32_t index;
+        if (m_freeEntries!=None) {
+            index=m_freeEntries;
+            m_entries[index].value=std::move(value);
+            m_freeEntries=m_entries[index].next;
+        } else {
+            index=static_cast<uint32_t>(m_entries.size());
+            m_entries.push_back(Entry{std::move(value), 0, None, None, 0, Free});
+        }
+        m_entries[index].tick=tick;
+        link(index);
+        ++m_size;
+        return Handle{index, m_entries[index].generation};
+    }
+
+    /**
+     * \brief Cancels a pending timer in O(1).
+     *
+     * \param handle - handle returned when the timer was inserted.
+     * \return True if the timer was pending, false if it already left the
+     *         queue or was cancelled before.
+     */
+    bool cancel(Handle handle) {
+        if (!contains(handle)) {
+            return false;
+        }
+        unlink(handle.entry);
+        m_entries[handle.entry].value=T();
+        release(handle.entry);
+        return true;
+    }
+
+    /**
+     * \brief Checks if a timer is still pending.
+     * \param handle - handle of the timer.
+     * \return True if the timer has neither left nor been cancelled.
+     */
+    bool contains(Handle handle) const {
+        return handle.entry<m_entries.size() && m_entries[handle.entry].generation==handle.generation
+            && m_entries[handle.entry].slot!=Free;
+    }
+
+    /**
+     * \brief Removes and returns the timer with the earliest deadline.
+     *
+     * The current tick moves forward, at most to the deadline of the timer.
+     * If the queue is empty, the error policy is notified and, unless it
+     * throws, the default element value is returned.
+     *
+     * \return The value of the timer.
+     */
+    T pop() {
+        std::optional<T> value=takeNext();
+        if (!value) {
+            ErrorPolicy::emptyPop();
+            return T();
+        }
+        return std::move(*value);
+    }
+
+    /**
+     * \brief Removes and returns the timer with the earliest deadline, if any.
+     * \return The value of the timer, or std::nullopt.
+     */
+    std::optional<T> tryPop() {
+        return takeNext();
+    }
+
+    /**
+     * \brief Removes every timer that is due at a tick.
+     *
+     * Moves the current tick to now and writes the values of all timers with
+     * a deadline up to now, earliest deadline first, late timers included. A
+     * tick before the current one collects the timers up to the current tick.
+     *
+     * \param now - new current tick.
+     * \param out - output iterator receiving the values.
+     * \return Output iterator past the last written value.
+     */
+    template <typename OutputIt>
+    OutputIt popExpired(int now, OutputIt out) {
+        uint32_t limit=std::max(toTick(now), m_now);
+        while (!m_late.empty()) {
+            *out++=*takeNext();
+        }
+        for (uint32_t slot=nextSlot(limit); slot!=None; slot=nextSlot(limit)) {
+            while (m_slots[slot].head!=None) {
+                *out++=takeFront(slot);
+            }
+        }
+        if (m_now<limit) {
+            advanceTo(limit);
+        }
+        return out;
+    }
+
+    /**
+     * \brief Gets the deadline of the timer that leaves next.
+     * \return Earliest deadline, the queue must not be empty.
+     */
+    int topPriority() const {
+        return toPriority(m_entries[peekEntry()].tick);
+    }
+
+    /**
+     * \brief Gets the value of the timer that leaves next.
+     * \return Value with the earliest deadline, the queue must not be empty.
+     */
+    const T& topValue() const {
+        return m_entries[peekEntry()].value;
+    }
+
+    /**
+     * \brief Gets the current tick.
+     * \return Tick of the last popExpired(), or as far as pop() moved it.
+     */
+    int currentTick() const {
+        return toPriority(m_now);
+    }
+
+    /**
+     * \brief Checks if the queue is empty.
+     * \return True if the queue is empty, false otherwise.
+     */
+    bool isEmpty() const {
+        return m_size==0;
+    }
+
+    /**
+     * \brief Gets the size of the queue.
+     * \return Number of pending timers.
+     */
+    size_t size() const {
+        return m_size;
+    }
+
+    /**
+     * \brief Prints the current state of the queue.
+     *
+     * Displays the pending timers to the standard output, from the earliest
+     * deadline.
+     */
+    void printQueue() const {
+        if (m_size==0) {
+            std::cout<<"Queue is empty"<<std::endl;
+            return;
+        }
+        // Late timers come first in their heap order, then the slot lists
+        // from the inner wheel outwards, which keeps equal deadlines in
+        // insertion order for the stable sort.
+        std::vector<LateTimer> late=m_late;
+        std::sort(late.begin(), late.end(), [](const LateTimer& a, const LateTimer& b) {
+            return a.before(b);
+        });
+        std::vector<uint32_t> pending;
+        pending.reserve(m_size);
+        for (const LateTimer& timer : late) {
+            pending.push_back(timer.entry);
+        }
+        for (const Slot& slot : m_slots) {
+            for (uint32_t index=slot.head; index!=None; index=m_entries[index].next) {
+                pending.push_back(index);
+            }
+        }
+        std::stable_sort(pending.begin(), pending.end(), [this](uint32_t a, uint32_t b) {
+            return m_entries[a].tick<m_entries[b].tick;
+        });
+        for (uint32_t index : pending) {
+            std::cout<<"Deadline: "<<toPriority(m_entries[index].tick)<<", Value: "<<m_entries[index].value<<std::endl;
+        }
+    }
+};
+
+}
@@ -0,0 +1,257 @@
+#pragma once
+#include "BasicPriorityQueue.hpp"
+#include "KeyCompare.hpp"
+#include <deque>
+#include <functional>
+#include <future>
+#include <istream>
+#include <iterator>
+#include <ranges>
+#include <thread>
+
+namespace kp {
+
+/**
+ * \brief Tuning of topK().
+ */
+struct TopKOptions {
+    /**
+     * \brief Number of threads selecting in parallel, 1 to stay on the caller.
+     */
+    size_t threads=1;
+
+    /**
+     * \brief Number of records handed to a thread at once.
+     */
+    size_t chunkSize=1<<16;
+};
+
+namespace detail {
+
+    template <typename Record, typename KeyFn>
+    using TopKKey=std::decay_t<std::invoke_result_t<KeyFn&, const Record&>>;
+
+    /**
+     * \brief Keys and records of a selection, highest key first.
+     */
+    template <typename Key, typename Record>
+    using TopKRun=std::vector<std::pair<Key, Record>>;
+
+    /**
+     * \brief Selects the k highest records of a range with a bounded queue.
+     *
+     * Once the queue is full, a record is only copied out of the range if its
+     * key beats the lowest kept key, so most records of a long stream cost a
+     * key computation and one comparison. Records whose key does not beat
+     * floor are skipped before they reach the queue.
+     *
+     * \param first - beginning of the range.
+     * \param last - end of the range, an iterator or a sentinel.
+     * \param k - number of records to keep.
+     * \param keyFn - key of a record.
+     * \param floor - key a record has to beat, if any.
+     * \return Kept records, highest key first, ties in range order.
+     */
+    template <typename Key, typename Record, typename InputIt, typename Sent, typename KeyFn>
+    TopKRun<Key, Record> selectTopK(InputIt first, Sent last, size_t k, KeyFn& keyFn, const std::optional<Key>& floor) {
+        KeyCompare<Key> compare;
+        BasicPriorityQueue<Record, MinMaxHeapStorage, KeyCompare<Key>, Bounded, SilentErrors> queue(Bounded(k), compare);
+        for (; first!=last; ++first) {
+            decltype(auto) record=*first;
+            Key key=std::invoke(keyFn, std::as_const(record));
+            if (floor && !compare.before(key, 1, *floor, 0)) {
+                continue;
+            }
+            queue.tryEmplace(key, std::forward<decltype(record)>(record));
+        }
+        TopKRun<Key, Record> run;
+        run.reserve(queue.size());
+        while (!queue.isEmpty()) {
+            Key key=queue.top().getPriority();
+            run.emplace_back(key, queue.pop());
+        }
+        return run;
+    }
+
+    /**
+     * \brief Merges the selection of a later chunk into the current one.
+     *
+     * On equal keys the current records stay in front, as they came earlier
+     * in the stream, so the result matches a sequential selection.
+     *
+     * \param current - selection so far, replaced by the merged one.
+     * \param chunk - selection of the next chunk.
+     * \param k - number of records to keep.
+     */
+    template <typename Key, typename Record>
+    void mergeTopK(TopKRun<Key, Record>& current, TopKRun<Key, Record>&& chunk, size_t k) {
+        KeyCompare<Key> compare;
+        TopKRun<Key, Record> merged;
+        merged.reserve(std::min(k, current.size()+chunk.size()));
+        auto a=current.begin();
+        auto b=chunk.begin();
+        while (merged.size()<k && (a!=current.end() || b!=chunk.end())) {
+            bool takeChunk=a==current.end() || (b!=chunk.end() && compare.before(b->first, 1, a->first, 0));
+            merged.push_back(std::move(takeChunk ? *b++ : *a++));
+        }
+        current=std::move(merged);
+    }
+
+    /**
+     * \brief Lowest key a full selection holds.
+     */
+    template <typename Key, typename Record>
+    std::optional<Key> topKFloor(const TopKRun<Key, Record>& current, size_t k) {
+        if (current.size()<k) {
+            return std::nullopt;
+        }
+        return current.back().first;
+    }
+
+    /**
+     * \brief Runs one selection per chunk on worker threads and merges them in order.
+     *
+     * At most options.threads chunks are in flight. Each chunk starts with the
+     * lowest key of the merged selection as its floor, so later chunks reject
+     * most records without queueing them.
+     *
+     * \param nextChunk - returns the next chunk as a callable producing its
+     *        selection from a floor, or an empty function at the end.
+     */
+    template <typename Key, typename Record, typename NextChunk>
+    TopKRun<Key, Record> parallelTopK(size_t k, size_t threads, NextChunk&& nextChunk) {
+        TopKRun<Key, Record> current;
+        std::deque<std::future<TopKRun<Key, Record>>> inFlight;
+        while (true) {
+            auto chunk=nextChunk();
+            if (!chunk) {
+                break;
+            }
+            if (inFlight.size()>=threads) {
+                mergeTopK(current, inFlight.front().get(), k);
+                inFlight.pop_front();
+            }
+            inFlight.push_back(std::async(std::launch::async, std::move(chunk), topKFloor(current, k)));
+        }
+        for (auto& pending : inFlight) {
+            mergeTopK(current, pending.get(), k);
+        }
+        return current;
+    }
+
+    template <typename Key, typename Record>
+    std::vector<Record> topKValues(TopKRun<Key, Record>&& run) {
+        std::vector<Record> values;
+        values.reserve(run.size());
+        for (auto& entry : run) {
+            values.push_back(std::move(entry.second));
+        }
+        return values;
+    }
+
+}
+
+/**
+ * \brief Keeps the k records with the highest keys from a stream.
+ *
+ * The records are fed through a bounded queue, so memory stays at O(k) no
+ * matter how long the stream is, and a record that cannot beat the lowest kept
+ * key is skipped without being copied. Ties keep the earlier record, like
+ * BoundedPriorityQueue.
+ *
+ * With options.threads above 1, the stream is cut into chunks of
+ * options.chunkSize records and the chunks are selected on separate threads.
+ * The per-chunk results are merged in stream order, so the result is the
+ * same as with one thread. Random-access ranges are split in place, other
+ * ranges are read into chunk buffers on the calling thread, which then holds
+ * up to threads x chunkSize records. keyFn is called from several threads in
+ * that mode.
+ *
+ * \param first - beginning of the records.
+ * \param last - end of the records, an iterator or a sentinel such as
+ *        std::default_sentinel. Random-access records are only split in
+ *        place if last - first is defined.
+ * \param k - number of records to keep.
+ * \param keyFn - key of a record, any type KeyCompare can order, e.g. int
+ *        or double.
+ * \param options - threads and chunk size.
+ * \return The kept records, highest key first.
+ */
+template <std::input_iterator InputIt, std::sentinel_for<InputIt> Sent, typename KeyFn>
+std::vector<std::iter_value_t<InputIt>> topK(InputIt first, Sent last, size_t k, KeyFn keyFn, TopKOptions options = TopKOptions()) {
+    using Record=std::iter_value_t<InputIt>;
+    using Key=detail::TopKKey<Record, KeyFn>;
+    if (k==0) {
+        return {};
+    }
+    if (options.threads<=1) {
+        return detail::topKValues(detail::selectTopK<Key, Record>(std::move(first), std::move(last), k, keyFn, std::nullopt));
+    }
+    size_t chunkSize=std::max<size_t>(options.chunkSize, 1);
+    using Chunk=std::function<detail::TopKRun<Key, Record>(std::optional<Key>)>;
+    if constexpr (std::random_access_iterator<InputIt> && std::sized_sentinel_for<Sent, InputIt>) {
+        auto nextChunk=[&]() -> Chunk {
+            if (first==last) {
+                return Chunk();
+            }
+            InputIt chunkEnd=first+static_cast<std::iter_difference_t<InputIt>>(std::min<size_t>(chunkSize, static_cast<size_t>(last-first)));
+            auto chunkBegin=std::exchange(first, chunkEnd);
+            return [chunkBegin, chunkEnd, k, &keyFn](std::optional<Key> floor) {
+                return detail::selectTopK<Key, Record>(chunkBegin, chunkEnd, k, keyFn, floor);
+            };
+        };
+        return detail::topKValues(detail::parallelTopK<Key, Record>(k, options.threads, nextChunk));
+    } else {
+        auto nextChunk=[&]() -> Chunk {
+            auto buffer=std::make_shared<std::vector<Record>>();
+            buffer->reserve(chunkSize);
+            for (; first!=last && buffer->size()<chunkSize; ++first) {
+                buffer->push_back(*first);
+            }
+            if (buffer->empty()) {
+                return Chunk();
+            }
+            return [buffer, k, &keyFn](std::optional<Key> floor) {
+                return detail::selectTopK<Key, Record>(std::make_move_iterator(buffer->begin()), std::make_move_iterator(buffer->end()), k, keyFn, floor);
+            };
+        };
+        return detail::topKValues(detail::parallelTopK<Key, Record>(k, options.threads, nextChunk));
+    }
+}
+
+/**
+ * \brief Keeps the k records with the highest keys from a range.
+ *
+ * \param records - range of records, e.g. a vector or a view over a file
+ *        such as std::views::istream<Record>(in).
+ * \param k - number of records to keep.
+ * \param keyFn - key of a record.
+ * \param options - threads and chunk size.
+ * \return The kept records, highest key first.
+ */
+template <std::ranges::input_range Range, typename KeyFn>
+std::vector<std::ranges::range_value_t<Range>> topK(Range&& records, size_t k, KeyFn keyFn, TopKOptions options = TopKOptions()) {
+    return topK(std::ranges::begin(records), std::ranges::end(records), k, std::move(keyFn), options);
+}
+
+/**
+ * \brief Keeps the k records with the highest keys from an input stream.
+ *
+ * Records are read with operator>> until the stream fails, one at a time, so
+ * a file of any size is processed in O(k) memory. In the parallel mode the
+ * records are still parsed on the calling thread, which bounds the speed for
+ * text formats that are expensive to parse.
+ *
+ * \tparam Record The type of the records read from the stream.
+ * \param in - stream of records.
+ * \param k - number of records to keep.
+ * \param keyFn - key of a record.
+ * \param options - threads and chunk size.
+ * \return The kept records, highest key first.
+ */
+template <typename Record, typename KeyFn>
+std::vector<Record> topK(std::istream& in, size_t k, KeyFn keyFn, TopKOptions options = TopKOptions()) {
+    return topK(std::istream_iterator<Record>(in), std::istream_iterator<Record>(), k, std::move(keyFn), options);
+}
+
+}
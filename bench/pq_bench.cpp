@@ -0,0 +1,541 @@
+#include "AddressablePriorityQueue.hpp"
+#include "AsyncPriorityQueue.hpp"
+#include "BasicPriorityQueue.hpp"
+#include "BoundedPriorityQueue.hpp"
+#include "BucketPriorityQueue.hpp"
+#include "ConcurrentPriorityQueue.hpp"
+#include "DAryHeapPriorityQueue.hpp"
+#include "ExternalPriorityQueue.hpp"
+#include "KeyCompare.hpp"
+#include "PackedPriorityQueue.hpp"
+#include "ShardedBoundedPriorityQueue.hpp"
+#include "StaticBoundedPriorityQueue.hpp"
+#include "TimerWheelPriorityQueue.hpp"
+#include <benchmark/benchmark.h>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * Benchmarks of every queue engine.
+ *
+ * Each engine is run with int, std::string and 256-byte payloads on four
+ * workloads:
+ *   Insert - fills a new queue, construction included. Bounded queues get a
+ *            stream of 4 x size elements, so three quarters of the inserts
+ *            have to beat the lowest element.
+ *   Pop    - drains a queue of the given size, only the pops are timed.
+ *   Mixed  - pops one element and inserts one into a queue held at the
+ *            given size, one pair per iteration.
+ *   Bulk   - insertRange() of the same stream as Insert, then popN() of
+ *            everything, for the engines that have both.
+ * Sizes go from 10 to 10M for int payloads and to 1M for the larger ones,
+ * which would otherwise need several GB. The external queue spills to the
+ * temporary directory with a budget of 4096 elements in memory, so from 10K
+ * elements on its runs measure the disk path. The concurrent engines get a
+ * multi-threaded mixed workload on top, an insert-only one for the sharded
+ * queue, which cannot pop, and AsyncPriorityQueue a producer/consumer run in
+ * which half of the threads insert and the other half wait for elements.
+ *
+ * Results go to the console. Pass --benchmark_out=<file> for a JSON report,
+ * or build the pq_bench_json target, which writes pq_bench.json to the build
+ * directory. Compare two runs with tools/compare.py from Google Benchmark.
+ */
+
+namespace {
+
+/**
+ * \brief Payload of 256 bytes, copied by value.
+ */
+struct Blob {
+    std::array<char, 256> bytes{};
+};
+
+/**
+ * \brief Random priorities, the same sequence for every engine.
+ */
+class PriorityStream {
+private:
+    uint64_t m_state;
+
+public:
+    explicit PriorityStream(uint64_t seed = 0x9E3779B97F4A7C15ull) : m_state(seed) {}
+
+    int next() {
+        m_state^=m_state<<13;
+        m_state^=m_state>>7;
+        m_state^=m_state<<17;
+        return static_cast<int>(m_state>>33);
+    }
+};
+
+/**
+ * \brief Pool of payloads copied into the queues.
+ *
+ * Strings are 40 characters long, past the small-string buffer, so each copy
+ * allocates like it would for real keys or messages.
+ */
+template <typename T>
+const std::vector<T>& payloads() {
+    static const std::vector<T> pool=[] {
+        std::vector<T> values(4096);
+        for (size_t i=0; i<values.size(); ++i) {
+            if constexpr (std::is_same_v<T, int>) {
+                values[i]=static_cast<int>(i);
+            } else if constexpr (std::is_same_v<T, std::string>) {
+                values[i]=std::string(40, static_cast<char>('a'+i%26));
+            } else {
+                std::memset(values[i].bytes.data(), static_cast<int>(i), values[i].bytes.size());
+            }
+        }
+        return values;
+    }();
+    return pool;
+}
+
+template <typename T>
+const T& payload(size_t i) {
+    return payloads<T>()[i%4096];
+}
+
+/**
+ * \brief Uniform access to one engine.
+ *
+ * Engines describe how to create a queue for a size and how to insert and
+ * pop. Defaults cover the engines with insert(priority, value) and pop().
+ */
+template <typename Queue, bool Bounded>
+struct Engine {
+    using QueueType=Queue;
+    static constexpr bool bounded=Bounded;
+    static constexpr bool canPop=true;
+
+    template <typename T>
+    static void push(Queue& queue, int priority, const T& value) {
+        queue.insert(priority, value);
+    }
+
+    static void pop(Queue& queue) {
+        benchmark::DoNotOptimize(queue.pop());
+    }
+};
+
+template <typename T>
+struct BoundedMinMax : Engine<kp::BoundedPriorityQueue<T>, true> {
+    static constexpr const char* name="BoundedPriorityQueue";
+
+    static auto make(size_t n) {
+        return std::make_unique<kp::BoundedPriorityQueue<T>>(n);
+    }
+};
+
+template <typename T>
+struct BoundedSorted : Engine<kp::BoundedPriorityQueue<T, kp::SortedStorage>, true> {
+    static constexpr const char* name="BoundedPriorityQueue<Sorted>";
+
+    static auto make(size_t n) {
+        return std::make_unique<kp::BoundedPriorityQueue<T, kp::SortedStorage>>(n);
+    }
+};
+
+template <typename T>
+struct BoundedVirtual : Engine<kp::PriorityQueue<T>, true> {
+    static constexpr const char* name="PriorityQueueAdapter<Bounded>";
+
+    static std::unique_ptr<kp::PriorityQueue<T>> make(size_t n) {
+        return std::make_unique<kp::PriorityQueueAdapter<kp::BoundedPriorityQueue<T>>>(kp::BoundedPriorityQueue<T>(n));
+    }
+};
+
+template <typename T>
+struct BoundedPacked : Engine<kp::PackedPriorityQueue<T, kp::MinMaxHeapStorage, kp::Bounded>, true> {
+    static constexpr const char* name="PackedPriorityQueue<Bounded>";
+
+    static auto make(size_t n) {
+        return std::make_unique<kp::PackedPriorityQueue<T, kp::MinMaxHeapStorage, kp::Bounded>>(kp::Bounded(n));
+    }
+};
+
+template <typename T, size_t N>
+struct StaticBounded : Engine<kp::StaticBoundedPriorityQueue<T, N>, true> {
+    static constexpr const char* name="StaticBoundedPriorityQueue";
+
+    static auto make(size_t) {
+        return std::make_unique<kp::StaticBoundedPriorityQueue<T, N>>();
+    }
+};
+
+template <typename T>
+struct BinaryHeap : Engine<kp::BinaryHeapPriorityQueue<T>, false> {
+    static constexpr const char* name="BinaryHeapPriorityQueue";
+
+    static auto make(size_t) {
+        return std::make_unique<kp::BinaryHeapPriorityQueue<T>>();
+    }
+};
+
+template <typename T>
+struct DAryHeap : Engine<kp::DAryHeapPriorityQueue<T, 4>, false> {
+    static constexpr const char* name="DAryHeapPriorityQueue<4>";
+
+    static auto make(size_t) {
+        return std::make_unique<kp::DAryHeapPriorityQueue<T, 4>>();
+    }
+};
+
+
+template <typename T>
+using UnstableQueue=kp::BasicPriorityQueue<T, kp::DAryHeapStorage<4>, kp::UnstableCompare<>>;
+
+template <typename T>
+struct DAryUnstable : Engine<UnstableQueue<T>, false> {
+    static constexpr const char* name="DAryHeapQueue<4,Unstable>";
+
+    static auto make(size_t) {
+        return std::make_unique<UnstableQueue<T>>();
+    }
+};
+
+template <typename T>
+struct Packed : Engine<kp::PackedPriorityQueue<T>, false> {
+    static constexpr const char* name="PackedPriorityQueue";
+
+    static auto make(size_t) {
+        return std::make_unique<kp::PackedPriorityQueue<T>>();
+    }
+};
+
+template <typename T>
+struct Addressable : Engine<kp::AddressablePriorityQueue<T>, false> {
+    static constexpr const char* name="AddressablePriorityQueue";
+
+    static auto make(size_t) {
+        return std::make_unique<kp::AddressablePriorityQueue<T>>();
+    }
+};
+
+template <typename T>
+struct Bucket : Engine<kp::BucketPriorityQueue<T>, false> {
+    static constexpr const char* name="BucketPriorityQueue";
+
+    static auto make(size_t) {
+        return std::make_unique<kp::BucketPriorityQueue<T>>(0, 1023);
+    }
+
+    static void push(kp::BucketPriorityQueue<T>& queue, int priority, const T& value) {
+        queue.insert(priority&1023, value);
+    }
+};
+
+template <typename T>
+struct TimerWheel : Engine<kp::TimerWheelPriorityQueue<T>, false> {
+    static constexpr const char* name="TimerWheelPriorityQueue";
+
+    static auto make(size_t) {
+        return std::make_unique<kp::TimerWheelPriorityQueue<T>>();
+    }
+};
+
+template <typename T>
+struct External : Engine<kp::ExternalPriorityQueue<T>, false> {
+    static constexpr const char* name="ExternalPriorityQueue";
+
+    static auto make(size_t) {
+        kp::ExternalOptions options;
+        options.memoryElements=4096;
+        options.blockElements=1024;
+        return std::make_unique<kp::ExternalPriorityQueue<T>>(std::filesystem::temp_directory_path(), options);
+    }
+};
+
+template <typename T>
+struct Concurrent : Engine<kp::ConcurrentPriorityQueue<T>, false> {
+    static constexpr const char* name="ConcurrentPriorityQueue";
+
+    static auto make(size_t) {
+        return std::make_unique<kp::ConcurrentPriorityQueue<T>>();
+    }
+
+    static void pop(kp::ConcurrentPriorityQueue<T>& queue) {
+        benchmark::DoNotOptimize(queue.tryPop());
+    }
+};
+
+template <typename T>
+struct Async : Engine<kp::AsyncPriorityQueue<T>, false> {
+    static constexpr const char* name="AsyncPriorityQueue";
+
+    static auto make(size_t) {
+        return std::make_unique<kp::AsyncPriorityQueue<T>>();
+    }
+
+    // Bounded wait, so a consumer left without producers cannot hang the run.
+    static void pop(kp::AsyncPriorityQueue<T>& queue) {
+        benchmark::DoNotOptimize(queue.waitPop(std::chrono::milliseconds(10)));
+    }
+};
+
+template <typename T>
+struct Sharded : Engine<kp::ShardedBoundedPriorityQueue<T>, true> {
+    static constexpr const char* name="ShardedBoundedPriorityQueue";
+    static constexpr bool canPop=false;
+
+    static auto make(size_t n) {
+        return std::make_unique<kp::ShardedBoundedPriorityQueue<T>>(n);
+    }
+};
+
+template <typename T>
+constexpr const char* payloadName() {
+    if constexpr (std::is_same_v<T, int>) {
+        return "int";
+    } else if constexpr (std::is_same_v<T, std::string>) {
+        return "string";
+    } else {
+        return "blob256";
+    }
+}
+
+/**
+ * \brief Number of elements inserted to fill a queue of size n.
+ */
+template <typename E>
+size_t streamLength(size_t n) {
+    return E::bounded ? 4*n : n;
+}
+
+template <typename E, typename T>
+void fill(typename E::QueueType& queue, size_t count, PriorityStream& priorities) {
+    for (size_t i=0; i<count; ++i) {
+        E::push(queue, priorities.next(), payload<T>(i));
+    }
+}
+
+template <typename E, typename T>
+void benchInsert(benchmark::State& state) {
+    size_t n=static_cast<size_t>(state.range(0));
+    size_t count=streamLength<E>(n);
+    for (auto _ : state) {
+        PriorityStream priorities;
+        auto queue=E::make(n);
+        fill<E, T>(*queue, count, priorities);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()*count));
+}
+
+template <typename E, typename T>
+void benchPop(benchmark::State& state) {
+    size_t n=static_cast<size_t>(state.range(0));
+    for (auto _ : state) {
+        PriorityStream priorities;
+        auto queue=E::make(n);
+        fill<E, T>(*queue, n, priorities);
+        auto start=std::chrono::steady_clock::now();
+        for (size_t i=0; i<n; ++i) {
+            E::pop(*queue);
+        }
+        auto end=std::chrono::steady_clock::now();
+        state.SetIterationTime(std::chrono::duration<double>(end-start).count());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()*n));
+}
+
+template <typename E, typename T>
+void benchMixed(benchmark::State& state) {
+    size_t n=static_cast<size_t>(state.range(0));
+    PriorityStream priorities;
+    auto queue=E::make(n);
+    fill<E, T>(*queue, n, priorities);
+    size_t i=0;
+    for (auto _ : state) {
+        E::pop(*queue);
+        E::push(*queue, priorities.next(), payload<T>(i++));
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+
+template <typename E, typename T>
+void benchBulk(benchmark::State& state) {
+    size_t n=static_cast<size_t>(state.range(0));
+    std::vector<std::pair<int, T>> items;
+    items.reserve(streamLength<E>(n));
+    PriorityStream priorities;
+    for (size_t i=0; i<streamLength<E>(n); ++i) {
+        items.emplace_back(priorities.next(), payload<T>(i));
+    }
+    std::vector<T> out;
+    out.reserve(n);
+    for (auto _ : state) {
+        auto queue=E::make(n);
+        queue->insertRange(items.begin(), items.end());
+        out.clear();
+        queue->popN(n, std::back_inserter(out));
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()*items.size()));
+}
+
+/**
+ * \brief Queue shared by the threads of a multi-threaded run.
+ */
+template <typename E, typename T>
+std::unique_ptr<typename E::QueueType>& sharedQueue() {
+    static std::unique_ptr<typename E::QueueType> queue;
+    return queue;
+}
+
+template <typename E, typename T>
+void setupShared(const benchmark::State& state) {
+    size_t n=static_cast<size_t>(state.range(0));
+    PriorityStream priorities;
+    sharedQueue<E, T>()=E::make(n);
+    fill<E, T>(*sharedQueue<E, T>(), n, priorities);
+}
+
+template <typename E, typename T>
+void teardownShared(const benchmark::State&) {
+    sharedQueue<E, T>().reset();
+}
+
+template <typename E, typename T>
+void benchConcurrentMixed(benchmark::State& state) {
+    auto& queue=*sharedQueue<E, T>();
+    PriorityStream priorities(0x9E3779B97F4A7C15ull+static_cast<uint64_t>(state.thread_index()));
+    size_t i=0;
+    for (auto _ : state) {
+        if constexpr (E::canPop) {
+            E::pop(queue);
+        }
+        E::push(queue, priorities.next(), payload<T>(i++));
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+
+/**
+ * \brief Even threads insert, odd threads pop and wait when the queue is empty.
+ */
+template <typename E, typename T>
+void benchProducerConsumer(benchmark::State& state) {
+    auto& queue=*sharedQueue<E, T>();
+    PriorityStream priorities(0x9E3779B97F4A7C15ull+static_cast<uint64_t>(state.thread_index()));
+    bool producer=state.thread_index()%2==0;
+    size_t i=0;
+    for (auto _ : state) {
+        if (producer) {
+            E::push(queue, priorities.next(), payload<T>(i++));
+        } else {
+            E::pop(queue);
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+
+template <typename E>
+std::string benchName(const char* workload) {
+    return std::string(workload)+"/"+E::name;
+}
+
+/**
+ * \brief Registers the workloads of one engine for one payload type.
+ * \param maxSize - largest queue size to run.
+ */
+template <template <typename> class EngineOf, typename T>
+void registerEngine(int64_t maxSize) {
+    using E=EngineOf<T>;
+    std::string suffix=std::string("/")+payloadName<T>();
+    benchmark::RegisterBenchmark((benchName<E>("Insert")+suffix).c_str(), benchInsert<E, T>)
+        ->RangeMultiplier(10)->Range(10, maxSize)->Unit(benchmark::kMicrosecond);
+    if constexpr (E::canPop) {
+        benchmark::RegisterBenchmark((benchName<E>("Pop")+suffix).c_str(), benchPop<E, T>)
+            ->RangeMultiplier(10)->Range(10, maxSize)->UseManualTime()->Unit(benchmark::kMicrosecond);
+        benchmark::RegisterBenchmark((benchName<E>("Mixed")+suffix).c_str(), benchMixed<E, T>)
+            ->RangeMultiplier(10)->Range(10, maxSize);
+    }
+    if constexpr (requires(typename E::QueueType& queue, std::pair<int, T>* items, T* out) {
+        queue.insertRange(items, items);
+        queue.popN(size_t(), out);
+    }) {
+        benchmark::RegisterBenchmark((benchName<E>("Bulk")+suffix).c_str(), benchBulk<E, T>)
+            ->RangeMultiplier(10)->Range(10, maxSize)->Unit(benchmark::kMicrosecond);
+    }
+}
+
+/**
+ * \brief Registers the fixed-capacity queue for the sizes it is built for.
+ */
+template <typename T, size_t N>
+void registerStatic() {
+    using E=StaticBounded<T, N>;
+    std::string suffix=std::string("/")+payloadName<T>();
+    benchmark::RegisterBenchmark((benchName<E>("Insert")+suffix).c_str(), benchInsert<E, T>)
+        ->Arg(N)->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark((benchName<E>("Pop")+suffix).c_str(), benchPop<E, T>)
+        ->Arg(N)->UseManualTime()->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark((benchName<E>("Mixed")+suffix).c_str(), benchMixed<E, T>)
+        ->Arg(N);
+}
+
+template <template <typename> class EngineOf, typename T>
+void registerThreaded() {
+    using E=EngineOf<T>;
+    std::string suffix=std::string("/")+payloadName<T>();
+    benchmark::RegisterBenchmark((benchName<E>(E::canPop ? "ThreadedMixed" : "ThreadedInsert")+suffix).c_str(), benchConcurrentMixed<E, T>)
+        ->Arg(10000)->Setup(setupShared<E, T>)->Teardown(teardownShared<E, T>)
+        ->ThreadRange(1, 8)->UseRealTime();
+}
+
+/**
+ * \brief Registers producer/consumer runs that start from an empty queue.
+ */
+template <template <typename> class EngineOf, typename T>
+void registerProducerConsumer() {
+    using E=EngineOf<T>;
+    std::string suffix=std::string("/")+payloadName<T>();
+    benchmark::RegisterBenchmark((benchName<E>("ProducerConsumer")+suffix).c_str(), benchProducerConsumer<E, T>)
+        ->Arg(0)->Setup(setupShared<E, T>)->Teardown(teardownShared<E, T>)
+        ->ThreadRange(2, 8)->UseRealTime();
+}
+
+template <typename T>
+void registerPayload(int64_t maxSize) {
+    registerEngine<BoundedMinMax, T>(maxSize);
+    registerEngine<BoundedSorted, T>(maxSize<10000 ? maxSize : 10000);
+    registerEngine<BoundedVirtual, T>(maxSize);
+    registerEngine<BoundedPacked, T>(maxSize);
+    registerStatic<T, 10>();
+    registerStatic<T, 1000>();
+    registerEngine<BinaryHeap, T>(maxSize);
+    registerEngine<DAryHeap, T>(maxSize);
+
+    registerEngine<DAryUnstable, T>(maxSize);
+    registerEngine<Packed, T>(maxSize);
+    registerEngine<Addressable, T>(maxSize);
+    registerEngine<Bucket, T>(maxSize);
+    registerEngine<TimerWheel, T>(maxSize);
+    registerEngine<External, T>(maxSize<1000000 ? maxSize : 1000000);
+    registerEngine<Concurrent, T>(maxSize);
+    registerEngine<Sharded, T>(maxSize);
+    registerThreaded<Concurrent, T>();
+    registerThreaded<Sharded, T>();
+    registerProducerConsumer<Async, T>();
+}
+
+}
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    registerPayload<int>(10000000);
+    registerPayload<std::string>(1000000);
+    registerPayload<Blob>(1000000);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -1,4 +1,6 @@
 #include "BoundedPriorityQueue.hpp"
+#include "DAryHeapPriorityQueue.hpp"
+#include "BasicPriorityQueue.hpp"
 #include <iostream>
 #include <string>
 
@@ -78,5 +80,26 @@ int main() {
     defaultQueue.printQueue();
     std::cout<<"Default queue size: "<<defaultQueue.getMaxSize()<<std::endl;
 
+    // 10: Unbounded heap queue built from a range
+    std::cout<<"\n10: Unbounded heap queue built from a range"<<std::endl;
+    std::vector<std::pair<int, std::string>> jobs={{5, "job5"}, {1, "job1"}, {9, "job9"}, {5, "job5b"}};
+    kp::BinaryHeapPriorityQueue<std::string> heapQueue(jobs.begin(), jobs.end());
+    heapQueue.insert(7, "job7");
+    heapQueue.printQueue();
+
+    std::cout<<"\nRemoving elements from the heap queue:"<<std::endl;
+    while (!heapQueue.isEmpty()) {
+        std::cout<<"Removed: "<<heapQueue.pop()<<std::endl;
+    }
+
+    // 11: Policy-based queue without virtual calls
+    std::cout<<"\n11: Policy-based bounded queue with sorted storage"<<std::endl;
+    kp::BoundedQueue<int, kp::SortedStorage> policyQueue(2);
+    policyQueue.insert(3, 300);
+    policyQueue.insert(8, 800);
+    policyQueue.insert(5, 500);
+    policyQueue.printQueue();
+    std::cout<<"Top element: "<<policyQueue.top()<<std::endl;
+
     return 0;
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -0,0 +1,969 @@
+#include "AddressablePriorityQueue.hpp"
+#include "AsyncPriorityQueue.hpp"
+#include "BasicPriorityQueue.hpp"
+#include "BoundedPriorityQueue.hpp"
+#include "BucketPriorityQueue.hpp"
+#include "ConcurrentPriorityQueue.hpp"
+#include "DAryHeapPriorityQueue.hpp"
+#include "ExternalPriorityQueue.hpp"
+#include "KeyCompare.hpp"
+#include "PackedPriorityQueue.hpp"
+#include "ShardedBoundedPriorityQueue.hpp"
+#include "Snapshot.hpp"
+#include "StaticBoundedPriorityQueue.hpp"
+#include "TimerWheelPriorityQueue.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <climits>
+#include <coroutine>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+/*
+ * Checks of the queue engines against a reference model.
+ *
+ * Every exact engine runs random sequences of inserts, pops and, where the
+ * engine has it, setMaxSize() next to ReferenceQueue, a sorted vector that
+ * follows the documented rules: higher priorities leave first, equal
+ * priorities in insertion order, and a full bounded queue keeps a new
+ * element only if it beats the lowest one. Priorities come from a small
+ * range, so ties are frequent. The relaxed concurrent engines are checked
+ * for losing or duplicating nothing. Snapshots are checked for round trips
+ * across storages and for leaving the queue unchanged on truncated input.
+ *
+ * Failures are printed with their line; the exit code is the number of
+ * failed checks, capped at 255.
+ */
+
+namespace {
+
+int failures=0;
+
+void check(bool ok, const char* what, const char* context, int line) {
+    if (!ok) {
+        ++failures;
+        std::cerr<<"pq_tests.cpp:"<<line<<": "<<context<<": check failed: "<<what<<std::endl;
+    }
+}
+
+#define CHECK(context, cond) check((cond), #cond, (context), __LINE__)
+
+/**
+ * \brief Random numbers, the same sequence on every platform.
+ */
+class Random {
+private:
+    uint64_t m_state;
+
+public:
+    explicit Random(uint64_t seed) : m_state(seed*0x9E3779B97F4A7C15ull+1) {}
+
+    uint32_t next() {
+        m_state^=m_state<<13;
+        m_state^=m_state>>7;
+        m_state^=m_state<<17;
+        return static_cast<uint32_t>(m_state>>32);
+    }
+
+    int below(int bound) {
+        return static_cast<int>(next()%static_cast<uint32_t>(bound));
+    }
+};
+
+/**
+ * \brief Sorted vector that follows the documented rules of the queues.
+ */
+class ReferenceQueue {
+private:
+    struct Element {
+        int priority;
+        size_t sequence;
+        int value;
+    };
+
+    std::vector<Element> m_elements;
+    size_t m_maxSize;
+    size_t m_sequence=0;
+    bool m_lowestFirst;
+
+    bool before(const Element& a, const Element& b) const {
+        if (a.priority==b.priority) {
+            return a.sequence<b.sequence;
+        }
+        return m_lowestFirst ? a.priority<b.priority : a.priority>b.priority;
+    }
+
+    void order() {
+        std::sort(m_elements.begin(), m_elements.end(), [this](const Element& a, const Element& b) {
+            return before(a, b);
+        });
+        if (m_elements.size()>m_maxSize) {
+            m_elements.resize(m_maxSize);
+        }
+    }
+
+public:
+    explicit ReferenceQueue(size_t maxSize = SIZE_MAX, bool lowestFirst = false) : m_maxSize(maxSize), m_lowestFirst(lowestFirst) {}
+
+    void insert(int priority, int value) {
+        m_elements.push_back(Element{priority, m_sequence++, value});
+        order();
+    }
+
+    int pop() {
+        int value=m_elements.front().value;
+        m_elements.erase(m_elements.begin());
+        return value;
+    }
+
+    void setMaxSize(size_t maxSize) {
+        m_maxSize=maxSize;
+        order();
+    }
+
+    bool updatePriority(int value, int priority) {
+        for (auto& element : m_elements) {
+            if (element.value==value) {
+                element.priority=priority;
+                order();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool erase(int value) {
+        for (auto it=m_elements.begin(); it!=m_elements.end(); ++it) {
+            if (it->value==value) {
+                m_elements.erase(it);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool contains(int value) const {
+        return std::any_of(m_elements.begin(), m_elements.end(), [value](const Element& element) {
+            return element.value==value;
+        });
+    }
+
+    int topPriority() const {
+        return m_elements.front().priority;
+    }
+
+    size_t size() const {
+        return m_elements.size();
+    }
+
+    std::vector<int> priorities() const {
+        std::vector<int> result;
+        for (const auto& element : m_elements) {
+            result.push_back(element.priority);
+        }
+        return result;
+    }
+};
+
+/**
+ * \brief Runs random inserts, pops and resizes on a queue and the model.
+ * \param name - engine name for failure messages.
+ * \param make - creates an empty queue.
+ * \param maxSize - maximum size of the queue, SIZE_MAX if unbounded.
+ * \param priorityRange - priorities are drawn from [0, priorityRange).
+ * \param lowestFirst - true if the lowest priority leaves first.
+ */
+template <typename Make>
+void checkAgainstModel(const char* name, Make make, size_t maxSize, int priorityRange, bool lowestFirst = false) {
+    for (uint64_t seed=1; seed<=20; ++seed) {
+        Random random(seed);
+        auto queue=make();
+        ReferenceQueue model(maxSize, lowestFirst);
+        int nextValue=0;
+        for (int step=0; step<2000; ++step) {
+            int action=random.below(100);
+            if (action<60 || model.size()==0) {
+                int priority=random.below(priorityRange);
+                queue.insert(priority, nextValue);
+                model.insert(priority, nextValue);
+                ++nextValue;
+            } else if (action<98) {
+                int expected=model.pop();
+                int actual=queue.pop();
+                CHECK(name, actual==expected);
+            } else if constexpr (requires { queue.getMaxSize(); queue.setMaxSize(size_t()); }) {
+                size_t newSize=static_cast<size_t>(random.below(40));
+                queue.setMaxSize(newSize);
+                model.setMaxSize(newSize);
+            }
+            CHECK(name, queue.size()==model.size());
+        }
+        while (model.size()>0) {
+            CHECK(name, queue.pop()==model.pop());
+        }
+        CHECK(name, queue.isEmpty());
+    }
+}
+
+void checkExactEngines() {
+    checkAgainstModel("BoundedPriorityQueue", [] { return kp::BoundedPriorityQueue<int>(25); }, 25, 16);
+    checkAgainstModel("BoundedPriorityQueue<Sorted>", [] { return kp::BoundedPriorityQueue<int, kp::SortedStorage>(25); }, 25, 16);
+    checkAgainstModel("BoundedPriorityQueue<HashIndex>", [] {
+        return kp::BoundedPriorityQueue<int, kp::MinMaxHeapStorage, kp::PrintErrors, kp::HashIndex<int>>(25);
+    }, 25, 16);
+    checkAgainstModel("BoundedPriorityQueue<lazy>", [] {
+        kp::BoundedPriorityQueue<int> queue(25);
+        queue.setLazyOrdering(true);
+        return queue;
+    }, 25, 16);
+    checkAgainstModel("BoundedQueue", [] { return kp::BoundedQueue<int>(kp::Bounded(25)); }, 25, 16);
+    checkAgainstModel("BoundedQueue<Sorted>", [] { return kp::BoundedQueue<int, kp::SortedStorage>(kp::Bounded(25)); }, 25, 16);
+    checkAgainstModel("PackedPriorityQueue<Bounded>", [] {
+        return kp::PackedPriorityQueue<int, kp::MinMaxHeapStorage, kp::Bounded>(kp::Bounded(25));
+    }, 25, 16);
+    checkAgainstModel("StaticBoundedPriorityQueue", [] { return kp::StaticBoundedPriorityQueue<int, 25>(); }, 25, 16);
+    checkAgainstModel("BinaryHeapPriorityQueue", [] { return kp::BinaryHeapPriorityQueue<int>(); }, SIZE_MAX, 16);
+    checkAgainstModel("DAryHeapPriorityQueue<4>", [] { return kp::DAryHeapPriorityQueue<int, 4>(); }, SIZE_MAX, 16);
+    checkAgainstModel("DAryHeapQueue<4>", [] { return kp::DAryHeapQueue<int, 4>(); }, SIZE_MAX, 16);
+    checkAgainstModel("PackedPriorityQueue", [] { return kp::PackedPriorityQueue<int>(); }, SIZE_MAX, 16);
+    checkAgainstModel("KeyCompare<long long>", [] {
+        return kp::BasicPriorityQueue<int, kp::DAryHeapStorage<4>, kp::KeyCompare<long long>>();
+    }, SIZE_MAX, 16);
+    checkAgainstModel("KeyCompare<double>", [] {
+        return kp::BasicPriorityQueue<int, kp::DAryHeapStorage<4>, kp::KeyCompare<double>>();
+    }, SIZE_MAX, 16);
+    checkAgainstModel("PackedPriorityQueue<KeyCompare<double>>", [] {
+        return kp::PackedPriorityQueue<int, kp::MinMaxHeapStorage, kp::Bounded, kp::PrintErrors, kp::KeyCompare<double>>(kp::Bounded(25));
+    }, 25, 16);
+    checkAgainstModel("PackedPriorityQueue<KeyCompare<long long>>", [] {
+        return kp::PackedPriorityQueue<int, kp::DAryHeapStorage<4>, kp::Unbounded, kp::PrintErrors, kp::KeyCompare<long long>>();
+    }, SIZE_MAX, 16);
+    checkAgainstModel("AddressablePriorityQueue", [] { return kp::AddressablePriorityQueue<int>(); }, SIZE_MAX, 16);
+    checkAgainstModel("BucketPriorityQueue", [] { return kp::BucketPriorityQueue<int>(0, 15); }, SIZE_MAX, 16);
+    checkAgainstModel("TimerWheelPriorityQueue", [] { return kp::TimerWheelPriorityQueue<int>(0); }, SIZE_MAX, 16, true);
+    checkAgainstModel("TimerWheelPriorityQueue<wide>", [] { return kp::TimerWheelPriorityQueue<int>(0); }, SIZE_MAX, 1<<20, true);
+
+    std::filesystem::path directory=std::filesystem::temp_directory_path();
+    checkAgainstModel("ExternalPriorityQueue", [directory] {
+        kp::ExternalOptions options;
+        options.memoryElements=16;
+        options.blockElements=4;
+        options.fanIn=3;
+        return kp::ExternalPriorityQueue<int>(directory, options);
+    }, SIZE_MAX, 16);
+}
+
+/**
+ * \brief Runs random timers, cancels and expiries on a timer wheel and the model.
+ *
+ * Deadlines are drawn around the current tick, so some timers are late when
+ * they are inserted, and a few far ones land on the outer wheels. Handles of
+ * timers that left the queue are kept and retried after their entries have
+ * been reused, and must neither match nor cancel the new timers.
+ *
+ * \param name - engine name for failure messages.
+ * \param seed - seed of the random sequence.
+ */
+void checkTimerWheel(const char* name, uint64_t seed) {
+    Random random(seed);
+    kp::TimerWheelPriorityQueue<int> queue(0);
+    ReferenceQueue model(SIZE_MAX, true);
+    std::vector<kp::TimerHandle> handles;
+    std::vector<int> expired;
+    for (int step=0; step<3000; ++step) {
+        int action=random.below(100);
+        int now=queue.currentTick();
+        if (action<45 || model.size()==0) {
+            int deadline=now+random.below(200)-20;
+            if (action<3) {
+                deadline=now+random.below(1<<20);
+            }
+            int value=static_cast<int>(handles.size());
+            handles.push_back(queue.push(deadline, value));
+            model.insert(deadline, value);
+        } else if (action<65) {
+            int value=random.below(static_cast<int>(handles.size()));
+            kp::TimerHandle handle=handles[static_cast<size_t>(value)];
+            CHECK(name, queue.contains(handle)==model.contains(value));
+            CHECK(name, queue.cancel(handle)==model.erase(value));
+            CHECK(name, !queue.contains(handle));
+        } else if (action<85) {
+            int deadline=model.topPriority();
+            CHECK(name, queue.pop()==model.pop());
+            CHECK(name, queue.currentTick()>=now && queue.currentTick()<=std::max(now, deadline));
+        } else {
+            int tick=now+random.below(100)-10;
+            expired.clear();
+            queue.popExpired(tick, std::back_inserter(expired));
+            int limit=std::max(now, tick);
+            for (int value : expired) {
+                CHECK(name, model.size()>0 && model.topPriority()<=limit && value==model.pop());
+            }
+            CHECK(name, model.size()==0 || model.topPriority()>limit);
+            CHECK(name, queue.currentTick()==limit);
+        }
+        CHECK(name, queue.size()==model.size());
+        if (model.size()>0) {
+            CHECK(name, queue.topPriority()==model.topPriority());
+        }
+    }
+    while (model.size()>0) {
+        CHECK(name, queue.pop()==model.pop());
+    }
+    for (size_t i=0; i<handles.size(); ++i) {
+        CHECK(name, !queue.contains(handles[i]) && !queue.cancel(handles[i]));
+    }
+}
+
+void checkTimerWheel() {
+    for (uint64_t seed=1; seed<=10; ++seed) {
+        checkTimerWheel("TimerWheelPriorityQueue cancel and expiry", seed);
+    }
+}
+
+void checkAddressable() {
+    const char* name="AddressablePriorityQueue updates";
+    Random random(7);
+    kp::AddressablePriorityQueue<int> queue;
+    ReferenceQueue model;
+    std::vector<kp::AddressablePriorityQueue<int>::Handle> handles;
+    for (int step=0; step<3000; ++step) {
+        int action=random.below(100);
+        if (action<50 || handles.empty()) {
+            int priority=random.below(16);
+            int value=static_cast<int>(handles.size());
+            handles.push_back(queue.push(priority, value));
+            model.insert(priority, value);
+        } else if (action<75) {
+            int value=random.below(static_cast<int>(handles.size()));
+            int priority=random.below(16);
+            CHECK(name, queue.updatePriority(handles[static_cast<size_t>(value)], priority)==model.updatePriority(value, priority));
+        } else if (action<85) {
+            int value=random.below(static_cast<int>(handles.size()));
+            CHECK(name, queue.erase(handles[static_cast<size_t>(value)])==model.erase(value));
+        } else if (model.size()>0) {
+            CHECK(name, queue.pop()==model.pop());
+        }
+        CHECK(name, queue.size()==model.size());
+    }
+}
+
+/**
+ * \brief Runs random inserts and pops on an indexed queue and a plain one.
+ *
+ * After every step, find() and count() of the index have to agree with the
+ * scans of the plain queue, so every element the storage moves has to be
+ * tracked by the index.
+ *
+ * \param name - engine name for failure messages.
+ * \param lazy - true to insert in lazy ordering mode.
+ */
+template <typename Storage>
+void checkIndexLookups(const char* name, bool lazy) {
+    Random random(7);
+    kp::BoundedPriorityQueue<int, Storage, kp::SilentErrors, kp::HashIndex<int>> indexed(30);
+    kp::BoundedPriorityQueue<int, Storage, kp::SilentErrors> plain(30);
+    indexed.setLazyOrdering(lazy);
+    plain.setLazyOrdering(lazy);
+    std::vector<int> popped;
+    for (int step=0; step<3000; ++step) {
+        int action=random.below(100);
+        if (action<70) {
+            int priority=random.below(12);
+            int value=random.below(4);
+            indexed.insert(priority, value);
+            plain.insert(priority, value);
+        } else if (action<90) {
+            CHECK(name, indexed.tryPop()==plain.tryPop());
+        } else {
+            size_t n=static_cast<size_t>(random.below(25));
+            popped.clear();
+            indexed.popN(n, std::back_inserter(popped));
+            std::vector<int> expected;
+            plain.popN(n, std::back_inserter(expected));
+            CHECK(name, popped==expected);
+        }
+        int priority=random.below(12);
+        int value=random.below(4);
+        const kp::Node<int>* found=indexed.find(priority, value);
+        const kp::Node<int>* scanned=plain.find(priority, value);
+        CHECK(name, (found==nullptr)==(scanned==nullptr));
+        if (found!=nullptr && scanned!=nullptr) {
+            CHECK(name, found->getPriority()==priority && found->getValue()==value && found->getId()==scanned->getId());
+        }
+        CHECK(name, indexed.count(priority, value)==plain.count(priority, value));
+        CHECK(name, indexed.contains(priority, value)==(scanned!=nullptr));
+    }
+}
+
+void checkIndexLookups() {
+    checkIndexLookups<kp::MinMaxHeapStorage>("HashIndex MinMax", false);
+    checkIndexLookups<kp::MinMaxHeapStorage>("HashIndex MinMax lazy", true);
+    checkIndexLookups<kp::SortedStorage>("HashIndex Sorted", false);
+    checkIndexLookups<kp::SortedStorage>("HashIndex Sorted lazy", true);
+}
+
+/**
+ * \brief Runs random inserts and pops through the PriorityQueue interface.
+ * \param name - engine name for failure messages.
+ * \param queue - adapter of an empty queue.
+ * \param maxSize - maximum size of the queue, SIZE_MAX if unbounded.
+ */
+void checkAdapter(const char* name, kp::PriorityQueue<int>& queue, size_t maxSize) {
+    Random random(3);
+    ReferenceQueue model(maxSize);
+    for (int step=0; step<2000; ++step) {
+        if (random.below(100)<60 || model.size()==0) {
+            int priority=random.below(16);
+            queue.insert(priority, step);
+            model.insert(priority, step);
+        } else {
+            CHECK(name, queue.tryPop()==model.pop());
+        }
+        CHECK(name, queue.size()==model.size());
+    }
+    std::vector<const kp::Node<int>*> top(5);
+    auto highest=queue.topK(top);
+    std::vector<int> priorities=model.priorities();
+    for (size_t i=0; i<highest.size(); ++i) {
+        CHECK(name, highest[i]->getPriority()==priorities[i]);
+    }
+    std::vector<int> values;
+    CHECK(name, queue.drainInto(values)==model.size());
+    for (int value : values) {
+        CHECK(name, value==model.pop());
+    }
+    CHECK(name, queue.isEmpty() && !queue.tryPop());
+}
+
+void checkAdapters() {
+    kp::PriorityQueueAdapter<kp::BoundedPriorityQueue<int>> bounded(kp::BoundedPriorityQueue<int>(25));
+    checkAdapter("PriorityQueueAdapter<BoundedPriorityQueue>", bounded, 25);
+    kp::PriorityQueueAdapter<kp::DAryHeapPriorityQueue<int, 4>> heap;
+    checkAdapter("PriorityQueueAdapter<DAryHeapPriorityQueue>", heap, SIZE_MAX);
+}
+
+void checkLazyReads() {
+    const char* name="BoundedPriorityQueue lazy reads";
+    kp::BoundedPriorityQueue<int> queue(3);
+    queue.setLazyOrdering(true);
+    for (int i=0; i<5; ++i) {
+        queue.insert(i, i);
+    }
+    std::vector<kp::Node<int>> buffered(queue.begin(), queue.end());
+    std::vector<const kp::Node<int>*> top(5);
+    CHECK(name, queue.size()==3);
+    CHECK(name, queue.topK(top).size()==3);
+    CHECK(name, queue.count(0, 0)==0 && queue.count(4, 4)==1);
+    CHECK(name, std::equal(queue.begin(), queue.end(), buffered.begin(), buffered.end()));
+    CHECK(name, queue.nodes().size()==5);
+    queue.settle();
+    CHECK(name, queue.nodes().size()==3);
+    CHECK(name, queue.pop()==4);
+}
+
+void checkStaticTopK() {
+    const char* name="StaticBoundedPriorityQueue topK";
+    kp::StaticBoundedPriorityQueue<int, 8> queue;
+    for (int i=0; i<20; ++i) {
+        queue.insert((i*7)%13, i);
+    }
+    std::array<const kp::Node<int>*, 8> buffer;
+    auto top=queue.topK(std::span<const kp::Node<int>*>(buffer).first(3));
+    CHECK(name, top.size()==3);
+    CHECK(name, top[0]->getPriority()==12 && top[1]->getPriority()==11 && top[2]->getPriority()==10);
+    CHECK(name, queue.topK(buffer).size()==8);
+}
+
+void checkMerge() {
+    const char* name="BoundedPriorityQueue merge";
+    Random random(11);
+    std::vector<kp::BoundedPriorityQueue<int>> queues(4, kp::BoundedPriorityQueue<int>(10));
+    int value=0;
+    for (auto& queue : queues) {
+        for (int i=0; i<15; ++i, ++value) {
+            int priority=random.below(100);
+            queue.insert(priority, value);
+        }
+    }
+    std::vector<int> expected;
+    std::vector<const kp::Node<int>*> top(15);
+    for (auto& queue : queues) {
+        for (const kp::Node<int>* node : queue.topK(top)) {
+            expected.push_back(node->getPriority());
+        }
+    }
+    std::sort(expected.rbegin(), expected.rend());
+    expected.resize(10);
+    auto merged=kp::BoundedPriorityQueue<int>::mergeAll(queues, 10, 2);
+    std::vector<int> priorities;
+    for (const kp::Node<int>* node : merged.topK(top)) {
+        priorities.push_back(node->getPriority());
+    }
+    CHECK(name, priorities==expected);
+    for (const auto& queue : queues) {
+        CHECK(name, queue.isEmpty());
+    }
+}
+
+void checkRelaxedEngines() {
+    {
+        const char* name="ConcurrentPriorityQueue";
+        kp::ConcurrentPriorityQueue<int> queue(2);
+        std::vector<int> popped;
+        for (int i=0; i<1000; ++i) {
+            queue.insert(i%37, i);
+        }
+        while (auto value=queue.tryPop()) {
+            popped.push_back(*value);
+        }
+        std::sort(popped.begin(), popped.end());
+        CHECK(name, popped.size()==1000);
+        CHECK(name, std::adjacent_find(popped.begin(), popped.end())==popped.end());
+    }
+    {
+        const char* name="ShardedBoundedPriorityQueue";
+        Random random(3);
+        kp::ShardedBoundedPriorityQueue<int> queue(20, 4);
+        ReferenceQueue model(20);
+        for (int i=0; i<1000; ++i) {
+            int priority=random.below(200);
+            queue.insert(priority, i);
+            model.insert(priority, i);
+        }
+        std::vector<int> priorities;
+        for (const auto& node : queue.takeTopK()) {
+            priorities.push_back(node.getPriority());
+        }
+        CHECK(name, priorities==model.priorities());
+    }
+    {
+        const char* name="AsyncPriorityQueue";
+        kp::AsyncPriorityQueue<int> queue;
+        constexpr int PerProducer=2000;
+        std::vector<std::thread> threads;
+        std::vector<std::vector<int>> popped(2);
+        for (int c=0; c<2; ++c) {
+            threads.emplace_back([&queue, &popped, c] {
+                while (auto value=queue.waitPop()) {
+                    popped[static_cast<size_t>(c)].push_back(*value);
+                }
+            });
+        }
+        std::vector<std::thread> producers;
+        for (int p=0; p<2; ++p) {
+            producers.emplace_back([&queue, p] {
+                for (int i=0; i<PerProducer; ++i) {
+                    queue.insert(i%50, p*PerProducer+i);
+                }
+            });
+        }
+        for (auto& producer : producers) {
+            producer.join();
+        }
+        queue.close();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        std::vector<int> all=popped[0];
+        all.insert(all.end(), popped[1].begin(), popped[1].end());
+        std::sort(all.begin(), all.end());
+        CHECK(name, all.size()==2*PerProducer);
+        CHECK(name, std::adjacent_find(all.begin(), all.end())==all.end());
+    }
+}
+
+/**
+ * \brief Coroutine that starts at once and frees its own frame when it ends.
+ */
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() {
+            return {};
+        }
+
+        std::suspend_never initial_suspend() noexcept {
+            return {};
+        }
+
+        std::suspend_never final_suspend() noexcept {
+            return {};
+        }
+
+        void return_void() {}
+
+        void unhandled_exception() {
+            std::terminate();
+        }
+    };
+};
+
+/**
+ * \brief Pops with co_await until the queue is closed and empty.
+ * \param popped - receives the popped values.
+ * \param finished - set once the queue returned std::nullopt.
+ */
+Detached consume(kp::AsyncPriorityQueue<int>& queue, std::vector<int>& popped, bool& finished) {
+    while (std::optional<int> value=co_await queue.popAsync()) {
+        popped.push_back(*value);
+    }
+    finished=true;
+}
+
+/**
+ * \brief Pops one value with co_await.
+ * \param result - receives the value, or std::nullopt if the queue was closed.
+ * \param resumed - set when the coroutine continues.
+ */
+Detached consumeOne(kp::AsyncPriorityQueue<int>& queue, std::optional<int>& result, bool& resumed) {
+    result=co_await queue.popAsync();
+    resumed=true;
+}
+
+template <typename Queue>
+void awaitWaiters(const Queue& queue, size_t count) {
+    while (queue.waitingCount()<count) {
+        std::this_thread::yield();
+    }
+}
+
+/**
+ * \brief Checks the hand-off to suspended coroutines and waiting threads.
+ *
+ * Runs without producer threads where possible, so every wakeup happens
+ * at a known point: inserts resume the coroutines they feed before
+ * returning, and close() resumes the rest.
+ */
+void checkAsync() {
+    {
+        const char* name="popAsync ready";
+        kp::AsyncPriorityQueue<int> queue(1);
+        queue.insert(5, 50);
+        std::optional<int> result;
+        bool resumed=false;
+        consumeOne(queue, result, resumed);
+        CHECK(name, resumed && result==50);
+        CHECK(name, queue.waitingCount()==0 && queue.isEmpty());
+    }
+    {
+        const char* name="popAsync hand-off";
+        kp::AsyncPriorityQueue<int> queue(1);
+        std::array<std::optional<int>, 3> results;
+        std::array<bool, 3> resumed{};
+        for (size_t i=0; i<3; ++i) {
+            consumeOne(queue, results[i], resumed[i]);
+        }
+        CHECK(name, queue.waitingCount()==3);
+        CHECK(name, !resumed[0] && !resumed[1] && !resumed[2]);
+        queue.insert(1, 10);
+        CHECK(name, resumed[0] && results[0]==10);
+        CHECK(name, !resumed[1] && queue.waitingCount()==2);
+        std::vector<std::pair<int, int>> batch={{2, 20}, {3, 30}};
+        queue.insertRange(batch.begin(), batch.end());
+        CHECK(name, resumed[1] && resumed[2]);
+        CHECK(name, results[1] && results[2] && *results[1]+*results[2]==50);
+        CHECK(name, queue.waitingCount()==0 && queue.isEmpty());
+    }
+    {
+        const char* name="popAsync close";
+        kp::AsyncPriorityQueue<int> queue(1);
+        std::vector<int> popped;
+        bool finished=false;
+        consume(queue, popped, finished);
+        std::array<std::optional<int>, 2> results;
+        std::array<bool, 2> resumed{};
+        for (size_t i=0; i<2; ++i) {
+            consumeOne(queue, results[i], resumed[i]);
+        }
+        queue.insert(4, 40);
+        CHECK(name, popped==std::vector<int>{40} && !finished);
+        CHECK(name, queue.waitingCount()==3);
+        queue.engine().emplace(7, 70);
+        CHECK(name, !resumed[0] && queue.waitingCount()==3);
+        queue.close();
+        CHECK(name, resumed[0] && resumed[1] && finished);
+        CHECK(name, popped==std::vector<int>{40} && results[0]==70 && !results[1]);
+        CHECK(name, queue.waitingCount()==0 && queue.isClosed());
+        std::optional<int> late;
+        bool lateResumed=false;
+        consumeOne(queue, late, lateResumed);
+        CHECK(name, lateResumed && !late);
+    }
+    {
+        const char* name="popAsync from producer thread";
+        kp::AsyncPriorityQueue<int> queue(2);
+        std::vector<int> popped;
+        bool finished=false;
+        consume(queue, popped, finished);
+        std::thread producer([&queue] {
+            for (int i=0; i<100; ++i) {
+                queue.insert(i%7, i);
+            }
+            queue.close();
+        });
+        producer.join();
+        std::sort(popped.begin(), popped.end());
+        CHECK(name, finished && popped.size()==100);
+        CHECK(name, std::adjacent_find(popped.begin(), popped.end())==popped.end());
+    }
+    {
+        const char* name="waitPop timeout";
+        kp::AsyncPriorityQueue<int> queue(1);
+        auto timeout=std::chrono::milliseconds(20);
+        auto start=std::chrono::steady_clock::now();
+        std::optional<int> value=queue.waitPop(timeout);
+        CHECK(name, !value);
+        CHECK(name, std::chrono::steady_clock::now()-start>=timeout);
+        CHECK(name, queue.waitingCount()==0);
+        queue.insert(1, 10);
+        CHECK(name, queue.waitPop(timeout)==10);
+        std::thread producer([&queue] {
+            awaitWaiters(queue, 1);
+            queue.insert(2, 20);
+        });
+        CHECK(name, queue.waitPop(std::chrono::seconds(30))==20);
+        producer.join();
+        queue.close();
+        start=std::chrono::steady_clock::now();
+        CHECK(name, !queue.waitPop(std::chrono::seconds(30)));
+        CHECK(name, std::chrono::steady_clock::now()-start<std::chrono::seconds(30));
+    }
+    {
+        const char* name="waitPop batch wakeup";
+        kp::AsyncPriorityQueue<int> queue(1);
+        std::array<std::optional<int>, 3> results;
+        std::vector<std::thread> threads;
+        for (size_t i=0; i<3; ++i) {
+            threads.emplace_back([&queue, &results, i] {
+                results[i]=queue.waitPop(std::chrono::seconds(30));
+            });
+        }
+        awaitWaiters(queue, 3);
+        std::vector<std::pair<int, int>> batch={{1, 10}, {2, 20}};
+        queue.insertRange(batch.begin(), batch.end());
+        queue.insert(3, 30);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        std::vector<int> values;
+        for (const auto& result : results) {
+            CHECK(name, result.has_value());
+            values.push_back(result.value_or(0));
+        }
+        std::sort(values.begin(), values.end());
+        CHECK(name, values==std::vector<int>({10, 20, 30}));
+        CHECK(name, queue.waitingCount()==0 && queue.isEmpty());
+    }
+}
+
+/**
+ * \brief Input iterator over (priority, value) pairs that can be read once.
+ */
+class SinglePass {
+private:
+    const std::vector<std::pair<int, int>>* m_items;
+    size_t m_index;
+
+public:
+    using iterator_category=std::input_iterator_tag;
+    using value_type=std::pair<int, int>;
+    using difference_type=std::ptrdiff_t;
+    using pointer=const value_type*;
+    using reference=const value_type&;
+
+    SinglePass(const std::vector<std::pair<int, int>>& items, size_t index) : m_items(&items), m_index(index) {}
+
+    reference operator*() const {
+        return (*m_items)[m_index];
+    }
+
+    SinglePass& operator++() {
+        ++m_index;
+        return *this;
+    }
+
+    SinglePass operator++(int) {
+        SinglePass old=*this;
+        ++m_index;
+        return old;
+    }
+
+    bool operator==(const SinglePass& other) const {
+        return m_index==other.m_index;
+    }
+};
+
+template <typename Queue>
+void checkBatchStats(const char* name, Queue queue) {
+    std::vector<std::pair<int, int>> items;
+    for (int i=0; i<100; ++i) {
+        items.emplace_back(i%16, i);
+    }
+    queue.insertRange(SinglePass(items, 0), SinglePass(items, items.size()));
+    const kp::QueueStats& stats=queue.stats();
+    CHECK(name, stats.insertCount()==100);
+    CHECK(name, stats.acceptedCount()+stats.rejectionCount()==100);
+    CHECK(name, stats.acceptedCount()-stats.evictionCount()==queue.size());
+}
+
+/**
+ * \brief Checks that batch inserts count every element they read.
+ *
+ * Only runs when the tests are built with KP_ENABLE_STATS.
+ */
+void checkStats() {
+    if constexpr (kp::detail::statsEnabled) {
+        checkBatchStats("stats BoundedPriorityQueue", kp::BoundedPriorityQueue<int>(10));
+        checkBatchStats("stats BoundedPriorityQueue<HashIndex>", kp::BoundedPriorityQueue<int, kp::MinMaxHeapStorage, kp::PrintErrors, kp::HashIndex<int>>(10));
+        checkBatchStats("stats DAryHeapPriorityQueue", kp::DAryHeapPriorityQueue<int, 4>());
+    }
+}
+
+template <typename Queue>
+auto drainValues(Queue& queue) {
+    std::vector<kp::detail::SnapshotValue<Queue>> values;
+    queue.drainInto(values);
+    return values;
+}
+
+template <typename From, typename To, typename MakeValue>
+void checkRoundTrip(const char* name, From source, To target, MakeValue makeValue) {
+    Random random(5);
+    for (int i=0; i<200; ++i) {
+        source.insert(random.below(16), makeValue(i));
+    }
+    std::stringstream stream;
+    kp::saveSnapshot(source, stream);
+    kp::loadSnapshot(target, stream);
+    CHECK(name, target.size()==source.size());
+    CHECK(name, drainValues(target)==drainValues(source));
+}
+
+void checkSnapshots() {
+    auto intValue=[](int i) {
+        return i;
+    };
+    auto stringValue=[](int i) {
+        return std::string(static_cast<size_t>(i%40), static_cast<char>('a'+i%26));
+    };
+    checkRoundTrip("snapshot MinMax", kp::BoundedPriorityQueue<int>(50), kp::BoundedPriorityQueue<int>(1), intValue);
+    checkRoundTrip("snapshot MinMax to Sorted", kp::BoundedPriorityQueue<int>(50), kp::BoundedPriorityQueue<int, kp::SortedStorage>(1), intValue);
+    checkRoundTrip("snapshot Sorted to MinMax", kp::BoundedPriorityQueue<int, kp::SortedStorage>(50), kp::BoundedPriorityQueue<int>(1), intValue);
+    checkRoundTrip("snapshot DAryHeap", kp::DAryHeapPriorityQueue<int, 4>(), kp::DAryHeapPriorityQueue<int, 4>(), intValue);
+    checkRoundTrip("snapshot DAryHeap to Bounded", kp::DAryHeapPriorityQueue<int, 4>(), kp::BoundedPriorityQueue<int>(300), intValue);
+    checkRoundTrip("snapshot string", kp::BoundedPriorityQueue<std::string>(50), kp::BoundedPriorityQueue<std::string>(1), stringValue);
+    {
+        kp::BoundedPriorityQueue<int> lazy(50);
+        lazy.setLazyOrdering(true);
+        checkRoundTrip("snapshot lazy", std::move(lazy), kp::BoundedPriorityQueue<int>(1), intValue);
+    }
+    {
+        const char* name="snapshot ids";
+        kp::BoundedPriorityQueue<int> source(10);
+        source.insert(1, 1);
+        std::stringstream stream;
+        kp::saveSnapshot(source, stream);
+        kp::BoundedPriorityQueue<int> target(3);
+        kp::loadSnapshot(target, stream);
+        CHECK(name, target.getMaxSize()==10);
+        target.insert(1, 2);
+        CHECK(name, target.pop()==1 && target.pop()==2);
+    }
+    {
+        const char* name="snapshot mapped";
+        kp::BoundedPriorityQueue<int> source(20);
+        for (int i=0; i<30; ++i) {
+            source.insert(i%7, i);
+        }
+        std::filesystem::path path=std::filesystem::temp_directory_path()/"pq_tests_snapshot.bin";
+        kp::saveSnapshot(source, path);
+        {
+            kp::MappedSnapshot<int> mapped(path);
+            CHECK(name, mapped.size()==20);
+            kp::BoundedPriorityQueue<int> target(1);
+            mapped.loadInto(target);
+            CHECK(name, drainValues(target)==drainValues(source));
+        }
+        std::filesystem::remove(path);
+    }
+}
+
+template <typename T, typename MakeValue>
+void checkTruncatedLoads(const char* name, MakeValue makeValue) {
+    kp::BoundedPriorityQueue<T> source(40);
+    for (int i=0; i<40; ++i) {
+        source.insert(i%9, makeValue(i));
+    }
+    std::stringstream stream;
+    kp::saveSnapshot(source, stream);
+    std::string bytes=stream.str();
+
+    kp::BoundedPriorityQueue<T> reference(5);
+    for (int i=0; i<5; ++i) {
+        reference.insert(100+i, makeValue(1000+i));
+    }
+    std::vector<size_t> cuts={0, 1, sizeof(kp::SnapshotHeader)-1, sizeof(kp::SnapshotHeader), sizeof(kp::SnapshotHeader)+1, bytes.size()/2, bytes.size()-1};
+    for (size_t cut : cuts) {
+        kp::BoundedPriorityQueue<T> target(5);
+        for (int i=0; i<5; ++i) {
+            target.insert(100+i, makeValue(1000+i));
+        }
+        std::stringstream truncated(bytes.substr(0, cut));
+        bool threw=false;
+        try {
+            kp::loadSnapshot(target, truncated);
+        } catch (const std::runtime_error&) {
+            threw=true;
+        }
+        CHECK(name, threw);
+        CHECK(name, target.getMaxSize()==5);
+        kp::BoundedPriorityQueue<T> expected=reference;
+        CHECK(name, drainValues(target)==drainValues(expected));
+    }
+
+    kp::BoundedPriorityQueue<double> other(5);
+    std::stringstream whole(bytes);
+    bool threw=false;
+    try {
+        kp::loadSnapshot(other, whole);
+    } catch (const std::runtime_error&) {
+        threw=true;
+    }
+    CHECK(name, threw);
+}
+
+}
+
+int main() {
+    checkExactEngines();
+    checkAddressable();
+    checkTimerWheel();
+    checkIndexLookups();
+    checkAdapters();
+    checkLazyReads();
+    checkStaticTopK();
+    checkMerge();
+    checkStats();
+    checkRelaxedEngines();
+    checkAsync();
+    checkSnapshots();
+    checkTruncatedLoads<int>("truncated int snapshot", [](int i) {
+        return i;
+    });
+    checkTruncatedLoads<std::string>("truncated string snapshot", [](int i) {
+        return std::string(static_cast<size_t>(20+i%30), 'x');
+    });
+    if (failures>0) {
+        std::cerr<<failures<<" checks failed"<<std::endl;
+    }
+    return std::min(failures, 255);
+}